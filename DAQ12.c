@@ -2,24 +2,68 @@
 #define PRESSURE     1  // AN1
 #define INT_TEMP     2  // AN2
 
-#define LTC_INT      RB0_bit   //entrada
+#define LTC_INT      0x01      //RB0, entrada
+#define LTC_CS       0x10      //RB4, sada
 #define INPUT_STAT   RB1_bit   //entrada
 #define CHRG_STAT    RB2_bit   //entrada
 #define LTC_RESET    RB3_bit   //sada
 #define DEBUG_LED    RB5_bit   //sada
-#define BATT_CHECK   RB6_bit   //sada
+#define BATT_CHECK   RB6_bit   //sada, ADC_BATT_CHECK em adcSeq.h
 
 #define HIGH 1
 #define LOW 0
+#define STAT_ACTIVE  LOW   // INPUT_STAT e CHRG_STAT, dreno aberto do carregador
 
-sbit Chip_Select at RB4_bit;   //LTC_CS
-sbit Chip_Select_Direction at TRISB4_bit;
+#define ACQ_FREE_RUN   0  // varredura contnua
+#define ACQ_TRIGGERED  1  // varredura somente por trigger (broadcast)
+
+// Reconverso de canais com falha: sem VALID ou fora da faixa. Sensor
+// aberto ou em curto (SENSOR_HARD_FAILURE) no passa sozinho, no repete.
+#define RETRY_DEFAULT  1
+#define RETRY_MAX      3
+#define RETRY_FAULT(f) (((f) & SENSOR_HARD_FAILURE) == 0 && \
+                        (((f) & VALID) == 0 || \
+                         ((f) & (SENSOR_ABOVE | SENSOR_BELOW)) != 0))
+
+// Canais com sensor aberto ou em curto em PRUNE_SCANS varreduras seguidas
+// saem da varredura; uma varredura de sondagem com todos os canais a cada
+// uintProbeInterval s traz de volta os que voltarem a ler vlido
+#define PRUNE_SCANS         3
+#define PRUNE_INTERVAL      60    // s
+#define PRUNE_INTERVAL_MAX  3600
+
+// Bytes gravados na EEPROM por execuo da taskPersist, ~4 ms cada: 64 ms
+// cabem no prazo de 100 ms
+#define PERSIST_WRITES  16
+
+#define SCAN_RESULTS   0x00003FFC  // canais com resultado publicado, 3 a 14
+
+// Gateway (MODBUS_GATEWAY em modbus.h): downstream port on a software UART
+// clocked by Timer2 on the high priority vector, the start bit is caught by
+// CCP2 capture.  modbusRxIsr shares the vector, keep the downstream baud
+// rate low enough for it to fit well inside half a bit.
+#define GW_BAUD        BAUD_2400
+#define GW_TX          RC0_bit   //sada
+#define GW_RX          RC1_bit   //entrada, CCP2
+#define GW_TX_DIR      RC2_bit   //sada, RS-485 DE
+#define GW_TIMER_HZ    (SCHED_TICK_COMPARE * 250UL)  // Fosc/4, prescaler 1:4
+#define GW_POLLS       2
+#define GW_CACHE_REGS  56
 
 #include <headers.h>   // // prottipos de funes
 #include <stdint.h>
 #include <stdbool.h>
 #include <built_in.h>
 #include "modbus.h"
+#include "adcSeq.h"
+#include "ltcFilter.h"
+#include "scheduler.h"
+#include "nodeConfig.h"
+#include "arena.h"
+#include "ltcTiming.h"
+#include "ltcStream.h"
+#include "chanStats.h"
+#include "chanAlarm.h"
 #include "LTC2983_configuration_constants.h"
 #include "LT_SPI.h"
 #include "LT_SPI.c"
@@ -29,25 +73,305 @@ sbit Chip_Select_Direction at TRISB4_bit;
 //#include "LTC2983_table_coeffs.h"
 
 // variveis MODBUS
-static volatile modbusBlockDef statusBitsBlock,
-                               inputRegsBlock;
+//  FC-01/05       1      trigger, starts a scan tagged with the sequence
+//                        last written to holding register 1, once the
+//                        scan in progress has finished (see below)
+//  FC-02          1      input power present (INPUT_STAT)
+//                 2      battery charging (CHRG_STAT)
+//                 3      an alarm is latched
+//                 4      an alarm is active
+//                 5      LTC2983 results available
+//                 9..23  alarm latched, channels 3..14, internal
+//                        temperature, pressure, battery. Acknowledged by
+//                        writing 846 once the alarm has cleared.
+//                 25..39 high alarm active, same channels
+//                 41..55 low alarm active, same channels
+//                        Read 1..64 (8 bytes) on the fast cycle.
+//  FC-03/06/16    1      trigger sequence, writing it starts a tagged scan
+//                        once the scan in progress has finished
+//                 2      acquisition mode, ACQ_FREE_RUN or ACQ_TRIGGERED.
+//                        Broadcast ACQ_TRIGGERED here and wait one scan
+//                        (about 2 s, until 901 reads 0xFFFF) before
+//                        relying on triggers to align the nodes
+//                 101..106 ADC calibration, gain (Q16, output at full scale)
+//                          and signed offset for AN0, AN1 and AN2, saved
+//                          to EEPROM when written
+//                 107..109 ADC oversampling of AN0, AN1 and AN2, log2 of
+//                          the samples averaged, 0..6 (default 4, 6, 4),
+//                          from the next pass, not saved
+//                 201..212 filter for channels 3..14, 0 bypass, see
+//                          ltcFilter.h, changing one restarts that
+//                          channel's filter
+//                 301..302 wall clock, seconds since the epoch, hi word
+//                          first, write both with FC-16
+//                 401..402 slave address and baud rate (BAUD_ value, 96 for
+//                          9600), saved to EEPROM, used from the next boot
+//                 501..528 LTC2983 channel assignment words, channels 1..14,
+//                          hi word first. A write is checked as a whole
+//                          (cfgChannelValid) and refused if any channel is
+//                          invalid. Changed words are sent to the LTC2983
+//                          between scans and saved to EEPROM, the other
+//                          channels keep converting. A sense resistor or a
+//                          differential sensor also takes channel N-1,
+//                          which must be unassigned. Channels 3..14 with a
+//                          sensor, not a sense resistor, are scanned (805).
+//                 601      speed and noise profile, 0 50/60 Hz, 1 50 Hz,
+//                          2 60 Hz, 3 60 Hz without mux delay (CFG_PROFILE_
+//                          in nodeConfig.h), 255 reads back for a custom
+//                          image. Applied between scans, saved to EEPROM.
+//                 602..603 streaming: channel 1..14 to convert alone, 0 to
+//                          scan, and how long for in s (0 = 60, max 3600).
+//                          Writing either restarts the time, scanning
+//                          resumes when it is up.
+//                 604      streaming: number of entries read, frees them
+//                 701      statistics window in s (0 = 60, max 3600),
+//                          writing it starts a new window
+//                 801..815 alarm high limits, 816..830 low limits,
+//                          831..845 hysteresis, channels as FC-02 9..23,
+//                          0.01 C for 3..14, the units of 404..406 for
+//                          the rest (chanAlarm.h). 32767 and -32768 never
+//                          trip. Saved to EEPROM.
+//                 846      alarm acknowledge, a bit per channel as FC-02
+//                          9..23, reads back 0
+//                 901      conversions of a channel that read invalid or
+//                          out of range, repeated alone after the scan and
+//                          before publishing, 0 off, max 3 (default 1)
+//                 902      s between probe scans of the channels dropped
+//                          for an open or shorted sensor (805..806), 0
+//                          never drops one (default 60, max 3600)
+//  FC-04          1..24  channels 3..14, IEEE float, hi word first
+//                 25..27 internal temperature, pressure, battery (raw ADC,
+//                        averaged 16, 64 and 16 times)
+//                 28     sequence of the trigger that started these results
+//                 29..31 time the scan started, epoch seconds (hi, lo), ms
+//                 101..112 channels 3..14, int16 in 0.01 C, saturated at
+//                          327.67 C
+//                 201..224 channels 3..14, int32 in 1/1024 C, hi word first
+//                 301..306 FC08 counters: bus, errors, exceptions, slave,
+//                          no response, overruns
+//                 307..314 turnaround histogram, <64 cycles then doubling
+//                 401..403 internal temperature, pressure, battery,
+//                          oversampled ADC left justified to 16 bits
+//                          (12, 13 and 12 significant bits)
+//                 404..406 internal temperature 0.01 C, pressure 0.1 mbar,
+//                          battery mV, from 401..403 and the calibration
+//                 501..524 channels 3..14 filtered, int32 in 1/1024 C,
+//                          hi word first. An invalid result is published
+//                          unfiltered and does not enter the filter
+//                 601..610 per task overruns and worst run time in us:
+//                          acquisition, internal ADC, modbus, heartbeat,
+//                          persistence
+//                 611      time spent in tasks, 0.1 %
+//                 701..702 uptime in ms, hi word first
+//                 703..705 wall clock, epoch seconds (hi, lo), ms
+//                 706..708 time 25..27 and 401..406 were updated, same form
+//                 709      boot to first valid LTC2983 data, ms
+//                          701..709 are updated every 100 ms. Until 301 is
+//                          written the wall clock counts from power up.
+//                 801      channels written to 501..528 and not yet sent to
+//                          the LTC2983, bit 0 is channel 1
+//                 802      channels that made the last write to 501..528
+//                          fail validation
+//                 803      channels of the last scan re-converted (901),
+//                          bit 0 is channel 1
+//                 804      channels still faulted after their re-conversions
+//                 805      channels scanned, bit 0 is channel 1. A channel
+//                          whose sensor reads open or shorted in PRUNE_SCANS
+//                          (3) scans in a row is dropped and only converted
+//                          again by a probe scan (902), it is back once that
+//                          reads it valid. A dropped channel reads NaN, -32768 and
+//                          0x80000000.
+//                 806      channels dropped
+//                 901      ms until the results of the scan in progress
+//                          should be published, re-conversions included,
+//                          0xFFFF when none is running, poll just after
+//                 902      last scan, start to LTC2983 INT, ms
+//                 903      between the last two published scans, ms
+//                 904      expected time of the scan in progress, start to
+//                          publication: the model (905) corrected by the
+//                          measured scans, then the measured time plus the
+//                          re-conversions started, ms
+//                 905      scan time from the channel mask, sensor types,
+//                          rejection and mux delay alone (ltcTiming.c), ms
+//                 911..924 conversions of channels 1..14 in the last minute
+//                 3001..3052 streaming ring (ltcStream.h): write index,
+//                          entries held, entries dropped, channel, then 16
+//                          entries of ms tick and result (hi, lo): the
+//                          fault byte in the top 8 bits, then the raw 24
+//                          bit result, 1/1024 C. Read all 52 in one FC-04,
+//                          then write the number used to 604. 1..224 and
+//                          501..524 are not updated while streaming,
+//                          triggers wait.
+//                 1001.. gateway only, cached downstream registers
+//                 2001.. gateway only, per poll age (x100 ms) and status
+//                 4001..4092 statistics of the last window (chanStats.h):
+//                          windows published, window length in s, then for
+//                          channels 3..14, internal temperature, pressure and
+//                          battery: samples, mean (hi, lo), minimum - mean,
+//                          maximum - mean, standard deviation, raw codes
+//                          (1/1024 C, 401..403). Busy for a few ms while a
+//                          window closes.
+//  FC-08          diagnostics, counters 0x0B..0x0F and 0x12, clear 0x0A
+// Until the LTC2983 has finished initialising and delivered its first scan
+// 1..31, 101..112, 201..224 and 501..524 answer SLAVE_DEVICE_BUSY.
+// A channel that is reconfigured, or uses a sense resistor or cold junction
+// that is, reads NaN, -32768 and 0x80000000 until its next result.
+// Adjacent blocks can be read in one request, 301..314 for example.
+// A repeated read of 1..31, 101..112, 201..224 or 501..524 is answered with
+// the frame already sent while the registers read have not changed. Two
+// different reads are kept, the FC-04 poll and the FC-02 status poll for
+// example, each up to 31 registers.
+// Triggers are normally sent to the broadcast address so every node on the
+// bus starts converting at the same time. A scan in progress is never cut
+// short, a trigger only starts a scan once it has finished, so a node
+// still in free run can start up to a whole scan late. For a synchronised
+// start:
+//   1. broadcast ACQ_TRIGGERED to holding register 2
+//   2. wait one scan, until 901 reads 0xFFFF on every node
+//   3. broadcast the sequence to 1, or the coil 1
+// Every node then starts within a ms of the write and tags its scan with
+// the same sequence. A trigger sent to a node still in free run switches
+// it to ACQ_TRIGGERED as well, so only the first scan after it is late.
+static volatile modbusBlockDef coilsBlock,
+                               statusBitsBlock,
+                               triggerSeqBlock,
+                               acqModeBlock,
+                               inputRegsBlock,
+                               temp16Block,
+                               temp32Block,
+                               diagCountersBlock,
+                               latencyBlock,
+                               adcHiResBlock,
+                               adcCalBlock,
+                               adcOsBlock,
+                               filterCfgBlock,
+                               tempFilteredBlock,
+                               schedStatsBlock,
+                               epochBlock,
+                               clockBlock,
+                               commCfgBlock,
+                               channelCfgBlock,
+                               channelStatusBlock,
+                               timingBlock,
+                               throughputBlock,
+                               profileBlock,
+                               streamCfgBlock,
+                               streamFreeBlock,
+                               streamBlock,
+                               statsWindowBlock,
+                               statsBlock,
+                               alarmCfgBlock,
+                               retryCfgBlock,
+                               pruneCfgBlock;
 
-static volatile uint aryuintInputRegs[28];
+static volatile uint aryuintInputRegs[31];
+static volatile uint aryuintEpoch[2];
+static volatile uint aryuintClock[9];     // uptime, agora, ADC interno, boot
+static volatile uint aryuintCommCfg[2];
+static volatile uint aryuintChannelCfg[2 * CFG_CHANNELS];
+static volatile uint aryuintChannelStatus[6];  // pendentes, recusados,
+                                               // reconvertidos, falhos,
+                                               // varridos, descartados
+static uint aryuintScanStart[3];
+static volatile uint aryuintTemp16[12];
+static volatile uint aryuintTemp32[24];
+static volatile uint aryuintTempFiltered[24];
+static volatile uint aryuintAdcHiRes[6];   // 3 oversampled, 3 scaled
+static volatile uint aryuintAdcOs[ADC_CHANNELS];   // log2 das amostras
+static const byte arybytAdcOrder[3] = { INT_TEMP, PRESSURE, VBATT };
 static volatile byte arybytStatusBits[8];
+static volatile byte arybytCoils[1];
+static volatile uint uintTriggerSeq;
+static volatile uint uintAcqMode;
+static volatile uint uintProfile;
+static volatile uint aryuintStreamCfg[2];   // canal, tempo (s)
+static volatile uint uintStreamFree;
+static volatile uint uintStatsWindow;
+static volatile uint uintRetryMax;
+static volatile uint uintProbeInterval;
 
+arenaDef arena;   // rascunho compartilhado entre tarefas, ver arena.h
 float temperatureValue = 0.0;
-bool updateInternal = false;
+bool calSavePending = false;
+bool alarmSavePending = false;
+bool cfgSavePending = false;
+ltc_device ltcMain;          // LTC2983: CS e INT, mscara gravada
+bool ltcReady = false;       // LTC2983 configurado
+bool firstData = false;      // primeira varredura entregue
+bool triggerPending = false;
+bool scanInProgress = false;
+unsigned short streamInProgress = 0;  // canal em converso sozinho, 0 nenhum
+byte bytRetryChannel = 0;    // canal reconvertendo aps a varredura, 0 nenhum
+byte bytRetriesLeft = 0;
+uint uintRetryPending = 0;   // canais com falha ainda a reconverter
+uint uintRetried = 0;        // reconvertidos nesta varredura
+uint uintRetryFailed = 0;    // ainda com falha depois das reconverses
+uint uintChannelStaged = 0;  // palavras novas ainda no enviadas ao LTC2983
+ulong ulngScanMask = 0;      // canais com sensor em SCAN_RESULTS, bit 0 = canal 1
+uint uintScanActive = 0;     // canais da varredura em curso, sem os descartados
+uint uintPruned = 0;         // descartados por sensor aberto ou em curto
+byte arybytHardScans[14];    // varreduras seguidas com sensor aberto ou em
+                             // curto, [0] = canal 1
+ulong ulngProbeStart = 0;    // uptime da ltima sondagem, ms
+bool globalStaged = false;   // perfil novo ainda no enviado ao LTC2983
+uint uintScanSeq = 0;
+byte bytTicks100 = 0;
+
+// tarefas: funo, perodo (ms), prazo (ms)
+#define TASKS 5
+static taskDef aryTasks[TASKS] = {
+   { taskAcquisition, 1,   10  },
+   { taskInternal,    100, 20  },
+   { taskModbus,      1,   5   },
+   { taskHeartbeat,   500, 50  },
+   { taskPersist,     100, 100 }
+};
+static volatile uint aryuintSchedStats[(2 * TASKS) + 1];
 
+#ifdef MODBUS_GATEWAY
+static volatile modbusBlockDef gatewayCacheBlock,
+                               gatewayStatusBlock;
+static modbusPollDef gatewayPolls[GW_POLLS];
+static volatile uint aryuintGatewayCache[GW_CACHE_REGS];
+static volatile uint aryuintGatewayStatus[2 * GW_POLLS];
+// Porta downstream: buffer, bytes que faltam, bit do caractere (0 start,
+// 9 stop), deslocamento, sentido e estado (PORT_ em modbus.h)
+static byte* pGwBuffer;
+static volatile byte bytGwLength;
+static volatile byte bytGwBit;
+static volatile byte bytGwShift;
+static volatile boolean blnGwTx;
+static volatile byte bytGwStatus = PORT_DONE;
+#endif
+
+// Alta prioridade: somente a recepo MODBUS e os bits do gateway, nunca
+// espera o resto
 void interrupt() {
- decodePacket(); // usa o Timer0 e RCIF (USART) - modbus
+ modbusRxIsr(); // usa o Timer0 e RCIF (USART) - modbus
+#ifdef MODBUS_GATEWAY
+ gwPortIsr();   // Timer2 e CCP2, porta downstream
+#endif
+}
+
+// Baixa prioridade: ADC, tick de 1mS e a decodificao do quadro
+void interrupt_low() {
+ adcSeqIsr();    // ADIF, AN0:2 em segundo plano
  
- if (TMR1IF_bit){ // Timer1 @ 100mS
-    TMR1IF_bit = 0;
-    TMR1H         = 0x3C;
-    TMR1L         = 0xB0;
-    
-    updateInternal = true;
+ if (CCP1IF_bit){ // CCP1 @ 1mS, Timer1 zerado pelo hardware
+    CCP1IF_bit = 0;
+
+    schedTick();
+
+    if(++bytTicks100 >= 100) { // 100mS
+       bytTicks100 = 0;
+       adcSeqTick();   // nova passada AN2, AN1 (e AN0)
+
+#ifdef MODBUS_GATEWAY
+       modbusMasterTick();   // idade das leituras e timeout da resposta
+#endif
     }
+ }
+ modbusFrameIsr(); // TMR3IF pedido pelo modbusRxIsr
 }
 
 void MCHPtoIEEE(float *f) {
@@ -59,229 +383,1015 @@ void MCHPtoIEEE(float *f) {
 }
 
 void main() {
-     Delay_ms(500);
+     // sem atrasos fixos: espera o oscilador, o LTC2983 avisa pelo INT
+     while(OSTS_bit == 0 && IOFS_bit == 0) {
+     }
      setup();
 
      while(1) {
-        if(LTC_INT == HIGH) { // idle
-
-            DEBUG_LED = ~DEBUG_LED;
-            updateInputRegisters();
-           
-           convert_channel(0x00); // multiple channels conforme a mscara abaixo
-           transfer_byte(WRITE_TO_RAM, 0x0F4, 0x00);
-           transfer_byte(WRITE_TO_RAM, 0x0F5, 0x00);
-           transfer_byte(WRITE_TO_RAM, 0x0F6, 0b00111111);
-           transfer_byte(WRITE_TO_RAM, 0x0F7, 0b11111100);
-
-        }
-        
-        if(updateInternal == true) {
-           aryuintInputRegs[24] = ADC_Read(INT_TEMP);
-           aryuintInputRegs[25] = ADC_Read(PRESSURE);
-           
-           BATT_CHECK = 1;
-           aryuintInputRegs[26] = ADC_Read(VBATT);
-           BATT_CHECK = 0;
-           
-           // FC-02
-           //arybytStatusBits[0] = INPUT_STAT;
-           //arybytStatusBits[1] = CHRG_STAT;
-
-           arybytStatusBits[0] = 1;
-           arybytStatusBits[2] = 1;
-           
-           updateInternal = false; // clear flag
-
-           //DEBUG_LED = ~DEBUG_LED;
-        }
-
-
-        serviceIOBlocks();   // Any updates?
-        //DEBUG_LED = ~DEBUG_LED;
+        schedRun();   // tarefas vencidas, na ordem da tabela
      }
 
 }
 
+void taskAcquisition() {
+   ulong ulngUptime;
+
+   // estatsticas: a janela fecha um canal por tick
+   switch(statsWindow()) {
+   case STATS_CLOSING:
+      statsBlock.blnBusy = TRUE;   // canais de janelas diferentes
+      break;
+   case STATS_CLOSED:
+      statsBlock.blnBusy = FALSE;
+      modbusBlockChanged(&statsBlock);
+      break;
+   }
+
+   if(ltcReady == false) {
+      // INT sobe quando o LTC2983 termina a inicializao
+      if(ltc_idle(&ltcMain)) {
+         configure_channels();
+         configure_global_parameters();
+         uintChannelStaged = 0;
+         globalStaged = false;
+         ltcReady = true;
+      }
+      return;
+   }
+
+   if(ltc_idle(&ltcMain)) { // idle
+      if(scanInProgress == true) {
+         if(bytRetryChannel == 0) {
+            timingScanDone();   // antes da leitura, mede s a converso
+         }
+         if(retryFaulted() == TRUE) {
+            return;   // um canal reconvertendo, publica quando terminar
+         }
+         updateScanList();     // antes da publicao, que pula os descartados
+         updateInputRegisters();
+         updateStatusBits();   // alarmes novos sem esperar a tarefa interna
+         GIEL_bit = 0;
+         aryuintChannelStatus[2] = uintRetried;
+         aryuintChannelStatus[3] = uintRetryFailed;
+         aryuintInputRegs[27] = uintScanSeq;
+         aryuintInputRegs[28] = aryuintScanStart[0];
+         aryuintInputRegs[29] = aryuintScanStart[1];
+         aryuintInputRegs[30] = aryuintScanStart[2];
+         GIEL_bit = 1;
+         resultsChanged();
+         timingPublished();   // 901 s volta a 0xFFFF com tudo publicado
+         scanInProgress = false;
+
+         if(firstData == false) {
+            firstData = true;
+            ulngUptime = schedUptime();
+            aryuintClock[8] = ulngUptime > 0xFFFF ? 0xFFFF : LoWord(ulngUptime);
+            inputRegsBlock.blnBusy    = FALSE;
+            temp16Block.blnBusy       = FALSE;
+            temp32Block.blnBusy       = FALSE;
+            tempFilteredBlock.blnBusy = FALSE;
+         }
+      }
+
+      if(streamInProgress != 0) {
+         timingScanDone();
+         read_results_block(&ltcMain, streamInProgress, 1, arena.acq.arybytBurst);
+         streamPush(arena.acq.arybytBurst[0],   // byte de falha junto
+                    get_raw_from_buffer(arena.acq.arybytBurst));
+         timingPublished();
+         streamInProgress = 0;
+      }
+
+      // entre varreduras: s as palavras alteradas
+      if(uintChannelStaged != 0) {
+         applyChannelCfg();
+      }
+      if(globalStaged == true) {
+         globalStaged = false;
+         configure_global_parameters();
+         cfgSavePending = true;
+      }
+
+      // um canal s enquanto no acabar o tempo, depois volta a varredura
+      if(streamChannel() != 0) {
+         startStream();
+         return;
+      }
+      aryuintStreamCfg[0] = 0;
+
+      // sem nenhum sensor configurado no h o que converter
+      if(ulngScanMask != 0
+         && (uintAcqMode == ACQ_FREE_RUN || triggerPending == true)) {
+         startScan();
+      }
+   } else {
+      timingUpdate();   // ms at o prximo resultado
+   }
+}
+
+void taskInternal() {
+   uint aryuintNow[3];
+   ulong ulngUptime;
+
+   schedTimestamp(aryuintNow);
+   ulngUptime = schedUptime();
+
+   if(bytAdcReady != 0) {
+      updateAdcRegisters(); // mdias prontas, nunca espera o ADC
+      GIEL_bit = 0;
+      aryuintClock[5] = aryuintNow[0];
+      aryuintClock[6] = aryuintNow[1];
+      aryuintClock[7] = aryuintNow[2];
+      GIEL_bit = 1;
+   }
+
+   timingWindow();   // converses por minuto
+
+   GIEL_bit = 0;
+   aryuintClock[0] = HiWord(ulngUptime);
+   aryuintClock[1] = LoWord(ulngUptime);
+   aryuintClock[2] = aryuintNow[0];
+   aryuintClock[3] = aryuintNow[1];
+   aryuintClock[4] = aryuintNow[2];
+   GIEL_bit = 1;
+
+   updateStatusBits();   // carregador a cada 100 mS
+
+#ifdef MODBUS_GATEWAY
+   updateGatewayStatus();
+#endif
+}
+
+void taskModbus() {
+   serviceIOBlocks();   // Any updates?
+#ifdef MODBUS_GATEWAY
+   serviceModbusMaster(); // um passo da leitura downstream, nunca espera
+#endif
+}
+
+void taskHeartbeat() {
+   DEBUG_LED = ~DEBUG_LED;
+}
+
+// Uma gravao por execuo, no mximo PERSIST_WRITES bytes; a imagem e os
+// alarmes continuam na prxima execuo se no couberem
+void taskPersist() {
+   if(calSavePending == true) {
+      calSavePending = false;
+      adcSaveCal();   // 14 bytes, ~56 ms de escrita na EEPROM
+   } else if(cfgSavePending == true) {
+      cfgSavePending = !cfgSave(PERSIST_WRITES);     // s os bytes alterados
+   } else if(alarmSavePending == true) {
+      alarmSavePending = !alarmSave(PERSIST_WRITES); // s os bytes alterados
+   }
+}
+
 void setup() {
+     unsigned short i;
+
      TRISA = 0x07;        // AN0:2 entradas; resto  sada.
      PORTA = 0;
      ADCON1 = 0b00001100; // AN0:2 analgicas
      CMCON = 0x07;        // comparadores OFF
-     TRISB = 0X07;        // RB0, RB2 - entradas;  resto  sada
+     TRISB = 0X07;        // RB0:2 - entradas;  resto  sada
      PORTB = 0;
      TRISC = 0;
      PORTC = 0;
       
-     Chip_Select = 1;                       // Deselect DAC
-     Chip_Select_Direction = 0;             // Set CS# pin as Output
+     ltc_init(&ltcMain, &LATB, LTC_CS, &PORTB, LTC_INT);   // CS em 1
      SPI1_Init_Advanced(_SPI_MASTER_OSC_DIV4, _SPI_DATA_SAMPLE_MIDDLE, _SPI_CLK_IDLE_LOW, _SPI_LOW_2_HIGH);
-     Delay_ms(300);
-     
-/*UART1_Init(9600);
-     Delay_ms(300);*/
-   
+
+     // libera o LTC2983, a configurao  feita pela tarefa de aquisio
+     // quando o INT subir; o MODBUS j responde enquanto isso
      LTC_RESET = 1;
-     wait_for_interrupt();
-     configure_channels();
-     configure_global_parameters();
-     
+
+     cfgLoad();           // imagem da EEPROM ou os valores de fbrica
+     ulngScanMask = cfgScanMask() & SCAN_RESULTS;
+     // prioridades: UART e Timer0 do MODBUS na alta (modbusSerialInit),
+     // todo o resto na baixa
+     IPEN_bit = 1;
+     IPR1 = 0;
+     IPR2 = 0;
+     adcSeqInit();        // ADC por interrupo (ADIF)
      InitTimer1();
+     schedInit(aryTasks, TASKS, (uint*)aryuintSchedStats);
      
-     modbusSerialInit(BAUD_9600, 1, 1); // inicializa mdulo MODBUS e Timer0
+     // inicializa mdulo MODBUS e Timer0
+     modbusSerialInit((baudRate)nodeCfg.uintBaud, 1, nodeCfg.bytSlaveAddress);
      // Make sure the data areas are all cleared
+     memset(arybytCoils,        0, sizeof(arybytCoils));
      memset(arybytStatusBits,   0, sizeof(arybytStatusBits));
      memset(aryuintInputRegs,   0, sizeof(aryuintInputRegs));
+     memset(aryuintTemp16,      0, sizeof(aryuintTemp16));
+     memset(aryuintTemp32,      0, sizeof(aryuintTemp32));
+     memset(aryuintTempFiltered, 0, sizeof(aryuintTempFiltered));
+     filterInit();        // todos os canais em bypass
+     memset(aryuintAdcHiRes,    0, sizeof(aryuintAdcHiRes));
+     memset(aryuintEpoch,       0, sizeof(aryuintEpoch));
+     memset(aryuintClock,       0, sizeof(aryuintClock));
+     for (i=0; i<ADC_CHANNELS; i++) {
+        aryuintAdcOs[i] = arybytAdcOversample[i];
+     }
+     aryuintCommCfg[0] = nodeCfg.bytSlaveAddress;
+     aryuintCommCfg[1] = nodeCfg.uintBaud;
+     for (i=0; i<CFG_CHANNELS; i++) {
+        aryuintChannelCfg[2*i]     = HiWord(nodeCfg.arylngChannel[i]);
+        aryuintChannelCfg[(2*i)+1] = LoWord(nodeCfg.arylngChannel[i]);
+     }
+     memset(aryuintChannelStatus, 0, sizeof(aryuintChannelStatus));
+     memset(arybytHardScans,     0, sizeof(arybytHardScans));
+     aryuintChannelStatus[4] = (uint)ulngScanMask;
+     timingInit();
+     uintProfile = cfgProfile();
+     streamInit();
+     aryuintStreamCfg[0] = 0;
+     aryuintStreamCfg[1] = STREAM_TIMEOUT;
+     uintStreamFree = 0;
+     statsInit();
+     alarmLoad();         // limites da EEPROM, ou nunca disparam
+     uintStatsWindow = STATS_WINDOW;
+     uintRetryMax = RETRY_DEFAULT;
+     uintProbeInterval = PRUNE_INTERVAL;
+     uintTriggerSeq = 0;
+     uintAcqMode = ACQ_FREE_RUN;
      
 // Create the various data I/O blocks
-     addModbusBlock(1, STATUS_INPUTS,     &statusBitsBlock,  1, 8,
+     addModbusBlock(1, COILS,             &coilsBlock,       1, 1,
+                   (void*)arybytCoils, triggerCoilWritten);   // FC-01/05
+     addModbusBlock(1, STATUS_INPUTS,     &statusBitsBlock,  1, 64,
                    (void*)arybytStatusBits, NULL);  // fc-02
-     addModbusBlock(1, INPUT_REGISTERS,   &inputRegsBlock,   1, 27,
+     addModbusBlock(1, HOLDING_REGISTERS, &triggerSeqBlock,  1, 1,
+                   (void*)&uintTriggerSeq, triggerSeqWritten); // FC-03/06
+     addModbusBlock(1, HOLDING_REGISTERS, &acqModeBlock,     2, 1,
+                   (void*)&uintAcqMode, acqModeWritten);
+     addModbusBlock(1, INPUT_REGISTERS,   &inputRegsBlock,   1, 31,
                    (void*)aryuintInputRegs, NULL);       // FC-04
+     addModbusBlock(1, INPUT_REGISTERS,   &temp16Block,      101, 12,
+                   (void*)aryuintTemp16, NULL);
+     addModbusBlock(1, INPUT_REGISTERS,   &temp32Block,      201, 24,
+                   (void*)aryuintTemp32, NULL);
+     addModbusBlock(1, INPUT_REGISTERS,   &diagCountersBlock, 301,
+                   sizeof(mbDiag) / sizeof(uint), (void*)&mbDiag, NULL);
+     addModbusBlock(1, INPUT_REGISTERS,   &latencyBlock,
+                   301 + sizeof(mbDiag) / sizeof(uint), MB_LATENCY_BINS,
+                   (void*)aryuintMbLatency, NULL);
+     addModbusBlock(1, HOLDING_REGISTERS, &adcCalBlock,      101,
+                   2 * ADC_CHANNELS, (void*)aryuintAdcCal, adcCalWritten);
+     addModbusBlock(1, HOLDING_REGISTERS, &adcOsBlock,       107,
+                   ADC_CHANNELS, (void*)aryuintAdcOs, adcOsWritten);
+     addModbusBlock(1, INPUT_REGISTERS,   &adcHiResBlock,    401, 6,
+                   (void*)aryuintAdcHiRes, NULL);
+     addModbusBlock(1, HOLDING_REGISTERS, &filterCfgBlock,   201,
+                   FILTER_CHANNELS, (void*)aryuintFilterCfg, filterCfgWritten);
+     addModbusBlock(1, INPUT_REGISTERS,   &tempFilteredBlock, 501, 24,
+                   (void*)aryuintTempFiltered, NULL);
+     addModbusBlock(1, INPUT_REGISTERS,   &schedStatsBlock,  601,
+                   (2 * TASKS) + 1, (void*)aryuintSchedStats, NULL);
+     addModbusBlock(1, HOLDING_REGISTERS, &epochBlock,       301, 2,
+                   (void*)aryuintEpoch, epochWritten);
+     addModbusBlock(1, INPUT_REGISTERS,   &clockBlock,       701, 9,
+                   (void*)aryuintClock, NULL);
+     addModbusBlock(1, HOLDING_REGISTERS, &commCfgBlock,     401, 2,
+                   (void*)aryuintCommCfg, commCfgWritten);
+     addModbusBlock(1, HOLDING_REGISTERS, &channelCfgBlock,  501,
+                   2 * CFG_CHANNELS, (void*)aryuintChannelCfg,
+                   channelCfgWritten);
+     addModbusBlock(1, INPUT_REGISTERS,   &channelStatusBlock, 801, 6,
+                   (void*)aryuintChannelStatus, NULL);
+     addModbusBlock(1, INPUT_REGISTERS,   &timingBlock,      901,
+                   TIMING_REGS, (void*)aryuintTiming, NULL);
+     addModbusBlock(1, INPUT_REGISTERS,   &throughputBlock,  911,
+                   CFG_CHANNELS, (void*)aryuintThroughput, NULL);
+     addModbusBlock(1, HOLDING_REGISTERS, &profileBlock,     601, 1,
+                   (void*)&uintProfile, profileWritten);
+     addModbusBlock(1, HOLDING_REGISTERS, &streamCfgBlock,   602, 2,
+                   (void*)aryuintStreamCfg, streamCfgWritten);
+     addModbusBlock(1, HOLDING_REGISTERS, &streamFreeBlock,  604, 1,
+                   (void*)&uintStreamFree, streamFreeWritten);
+     addModbusBlock(1, INPUT_REGISTERS,   &streamBlock,      3001,
+                   STREAM_REGS, (void*)aryuintStream, NULL);
+     addModbusBlock(1, HOLDING_REGISTERS, &statsWindowBlock, 701, 1,
+                   (void*)&uintStatsWindow, statsWindowWritten);
+     addModbusBlock(1, INPUT_REGISTERS,   &statsBlock,       4001,
+                   STATS_REGS, (void*)aryuintStats, NULL);
+     addModbusBlock(1, HOLDING_REGISTERS, &alarmCfgBlock,    801,
+                   ALARM_REGS, (void*)aryintAlarmCfg, alarmCfgWritten);
+     addModbusBlock(1, HOLDING_REGISTERS, &retryCfgBlock,    901, 1,
+                   (void*)&uintRetryMax, retryCfgWritten);
+     addModbusBlock(1, HOLDING_REGISTERS, &pruneCfgBlock,    902, 1,
+                   (void*)&uintProbeInterval, pruneCfgWritten);
+     // sem dados at a primeira varredura: SLAVE_DEVICE_BUSY
+     inputRegsBlock.blnBusy    = TRUE;
+     temp16Block.blnBusy       = TRUE;
+     temp32Block.blnBusy       = TRUE;
+     tempFilteredBlock.blnBusy = TRUE;
+     resultsChanged();   // daqui em diante toda mudana  anunciada
+#ifdef MODBUS_GATEWAY
+     setupGateway();
+#endif
+}
+
+void startScan() {
+   ulong ulngUptime = schedUptime();
+
+   schedTimestamp(aryuintScanStart);
+
+   if(triggerPending == true) {
+      uintScanSeq = uintTriggerSeq;
+      triggerPending = false;
+   } else {
+      uintScanSeq = 0;
+   }
+
+   // sem os descartados, salvo na sondagem ou se no sobrar nenhum
+   uintScanActive = (uint)ulngScanMask & ~uintPruned;
+   if(uintPruned != 0 && (uintScanActive == 0 ||
+      ulngUptime - ulngProbeStart >= (ulong)uintProbeInterval * 1000)) {
+      uintScanActive = (uint)ulngScanMask;
+      ulngProbeStart = ulngUptime;
+   }
+
+   // mscara de canais, antes da converso; s  gravada se mudou
+   ltc_set_scan_mask(&ltcMain, uintScanActive);
+   convert_channel(&ltcMain, 0x00); // multiple channels conforme a mscara acima
+   timingScanStart(uintScanActive);
+   scanInProgress = true;
+}
+
+void startStream() {
+   byte bytChannel = streamChannel();
+
+   convert_channel(&ltcMain, bytChannel);
+   timingScanStart((ulong)1 << (bytChannel - 1));
+   streamInProgress = bytChannel;
+}
+
+// Called from serviceIOBlocks() after a FC-05/FC-15 on the coil block
+void triggerCoilWritten(modbusBlockDef* pBlock) {
+   if(arybytCoils[0].B0 == 1) {
+      arybytCoils[0].B0 = 0; // auto reset
+      // mesma sequncia em todos os ns: a ltima escrita no registro 1
+      triggerPending = true;
+      uintAcqMode = ACQ_TRIGGERED;
+   }
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on holding register 1
+void triggerSeqWritten(modbusBlockDef* pBlock) {
+   triggerPending = true;
+   uintAcqMode = ACQ_TRIGGERED;
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on 101..106
+void adcCalWritten(modbusBlockDef* pBlock) {
+   calSavePending = true;   // gravada pela tarefa de persistncia
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on 107..109
+void adcOsWritten(modbusBlockDef* pBlock) {
+   unsigned short i;
+
+   for (i=0; i<ADC_CHANNELS; i++) {
+      if(aryuintAdcOs[i] > ADC_OS_MAX) {
+         aryuintAdcOs[i] = ADC_OS_MAX;
+      }
+      arybytAdcOversample[i] = aryuintAdcOs[i];   // vale na prxima passada
+   }
+}
+
+void commCfgWritten(modbusBlockDef* pBlock) {
+   // valores invlidos voltam ao que est na imagem
+   if(aryuintCommCfg[0] >= 1 && aryuintCommCfg[0] <= 247) {
+      nodeCfg.bytSlaveAddress = aryuintCommCfg[0];
+   }
+   switch(aryuintCommCfg[1]) {
+   case BAUD_1200:  case BAUD_2400:  case BAUD_4800:   case BAUD_9600:
+   case BAUD_19200: case BAUD_38400: case BAUD_57600:  case BAUD_115200:
+      nodeCfg.uintBaud = aryuintCommCfg[1];
+      break;
+   }
+   aryuintCommCfg[0] = nodeCfg.bytSlaveAddress;
+   aryuintCommCfg[1] = nodeCfg.uintBaud;
+   cfgSavePending = true;   // vale a partir do prximo boot
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on holding register 601
+void profileWritten(modbusBlockDef* pBlock) {
+   if(uintProfile <= 0xFF && cfgSetProfile(uintProfile) == TRUE) {
+      globalStaged = true;   // enviado entre varreduras
+   }
+   uintProfile = cfgProfile();
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on 602..603
+void streamCfgWritten(modbusBlockDef* pBlock) {
+   uint uintChannel = aryuintStreamCfg[0];
+
+   if(uintChannel == 0) {
+      streamStop();
+   } else if(uintChannel <= CFG_CHANNELS
+          && CFG_SENSOR_TYPE(nodeCfg.arylngChannel[uintChannel - 1]) != 0
+          && CFG_SENSOR_TYPE(nodeCfg.arylngChannel[uintChannel - 1])
+             != CFG_TYPE_RSENSE) {
+      streamStart(uintChannel, aryuintStreamCfg[1]);
+   } else {
+      aryuintStreamCfg[0] = aryuintStream[STREAM_CHANNEL];  // recusado
+   }
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on holding register 604
+void streamFreeWritten(modbusBlockDef* pBlock) {
+   streamFree(uintStreamFree);
+   uintStreamFree = 0;
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on holding register 701
+void statsWindowWritten(modbusBlockDef* pBlock) {
+   uintStatsWindow = statsSetWindow(uintStatsWindow);
+   statsBlock.blnBusy = FALSE;   // a janela que fechava foi descartada
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on holding register 901
+void retryCfgWritten(modbusBlockDef* pBlock) {
+   if(uintRetryMax > RETRY_MAX) {
+      uintRetryMax = RETRY_MAX;
+   }
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on holding register 902
+void pruneCfgWritten(modbusBlockDef* pBlock) {
+   if(uintProbeInterval > PRUNE_INTERVAL_MAX) {
+      uintProbeInterval = PRUNE_INTERVAL_MAX;
+   } else if(uintProbeInterval == 0) {
+      // sem descarte: todos voltam na prxima varredura
+      uintPruned = 0;
+      memset(arybytHardScans, 0, sizeof(arybytHardScans));
+   }
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on 801..846
+void alarmCfgWritten(modbusBlockDef* pBlock) {
+   alarmAck(aryintAlarmCfg[ALARM_ACK]);
+   aryintAlarmCfg[ALARM_ACK] = 0;
+   alarmSavePending = true;   // gravados pela tarefa de persistncia
+   updateStatusBits();
 }
 
+// FC-02: carregador, resumo e alarmes por canal. Anunciado s quando muda,
+// a leitura rpida repetida sai da resposta guardada.
+void updateStatusBits() {
+   byte arybytNew[7];
+   bool statusChanged = false;
+   unsigned short i;
+
+   arybytNew[0] = 0;
+   if(INPUT_STAT == STAT_ACTIVE) {
+      arybytNew[0] |= 0x01;
+   }
+   if(CHRG_STAT == STAT_ACTIVE) {
+      arybytNew[0] |= 0x02;
+   }
+   if(uintAlarmLatched != 0) {
+      arybytNew[0] |= 0x04;
+   }
+   if((uintAlarmHigh | uintAlarmLow) != 0) {
+      arybytNew[0] |= 0x08;
+   }
+   if(firstData == true) {
+      arybytNew[0] |= 0x10;
+   }
+   arybytNew[1] = Lo(uintAlarmLatched);
+   arybytNew[2] = Hi(uintAlarmLatched);
+   arybytNew[3] = Lo(uintAlarmHigh);
+   arybytNew[4] = Hi(uintAlarmHigh);
+   arybytNew[5] = Lo(uintAlarmLow);
+   arybytNew[6] = Hi(uintAlarmLow);
+
+   GIEL_bit = 0;
+   for (i=0; i<7; i++) {
+      if(arybytStatusBits[i] != arybytNew[i]) {
+         arybytStatusBits[i] = arybytNew[i];
+         statusChanged = true;
+      }
+   }
+   GIEL_bit = 1;
+
+   if(statusChanged) {
+      modbusBlockChanged(&statusBitsBlock);
+   }
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on 501..528. The words
+// are only checked and staged here, taskAcquisition sends them between scans
+void channelCfgWritten(modbusBlockDef* pBlock) {
+   ulong* arylngWords = arena.cfg.arylngWords;
+   uint uintChanged = 0, uintRejected = 0;
+   unsigned short i;
+
+   GIEL_bit = 0;
+   for (i=0; i<CFG_CHANNELS; i++) {
+      HiWord(arylngWords[i]) = aryuintChannelCfg[2*i];
+      LoWord(arylngWords[i]) = aryuintChannelCfg[(2*i)+1];
+   }
+   GIEL_bit = 1;
+
+   // o conjunto todo, um Rsense e os RTDs que o usam podem mudar juntos
+   for (i=0; i<CFG_CHANNELS; i++) {
+      if(arylngWords[i] != nodeCfg.arylngChannel[i]) {
+         uintChanged |= 1 << i;
+      }
+      if(cfgChannelValid(i+1, arylngWords) == FALSE) {
+         uintRejected |= 1 << i;
+      }
+   }
+
+   for (i=0; i<CFG_CHANNELS; i++) {
+      if(uintRejected == 0) {
+         nodeCfg.arylngChannel[i] = arylngWords[i];
+      } else {
+         // recusada: os registros voltam  configurao em uso
+         GIEL_bit = 0;
+         aryuintChannelCfg[2*i]     = HiWord(nodeCfg.arylngChannel[i]);
+         aryuintChannelCfg[(2*i)+1] = LoWord(nodeCfg.arylngChannel[i]);
+         GIEL_bit = 1;
+      }
+   }
+   if(uintRejected == 0) {
+      uintChannelStaged |= uintChanged;
+   }
+   aryuintChannelStatus[0] = uintChannelStaged;
+   aryuintChannelStatus[1] = uintRejected;
+}
+
+// Sends the staged words to the LTC2983, only call while it is idle
+void applyChannelCfg() {
+   uint uintAffected = uintChannelStaged;
+   unsigned short i;
+   byte bytRef;
+
+   for (i=0; i<CFG_CHANNELS; i++) {
+      if(uintChannelStaged & (1 << i)) {
+         assign_channel(&ltcMain, i+1, nodeCfg.arylngChannel[i]);
+      }
+      // quem usa um Rsense ou junta fria alterado tambm perde o valor
+      bytRef = cfgChannelRef(nodeCfg.arylngChannel[i]);
+      if(bytRef != 0 && (uintChannelStaged & (1 << (bytRef-1)))) {
+         uintAffected |= 1 << i;
+      }
+   }
+   uintChannelStaged = 0;
+   aryuintChannelStatus[0] = 0;
+   cfgSavePending = true;
+   ulngScanMask = cfgScanMask() & SCAN_RESULTS;   // s canais com sensor
+   // sensor novo: volta para a varredura e a contagem de falhas recomea
+   uintPruned &= ~uintAffected;
+   for (i=0; i<14; i++) {
+      if(uintAffected & (1 << i)) {
+         arybytHardScans[i] = 0;
+      }
+   }
+   GIEL_bit = 0;
+   aryuintChannelStatus[4] = (uint)ulngScanMask & ~uintPruned;
+   GIEL_bit = 1;
+   invalidateChannels(uintAffected);
+}
+
+// Drops the channels whose sensor read open or shorted (SENSOR_HARD_FAILURE)
+// in PRUNE_SCANS scans in a row from the scan, and brings a dropped one back
+// once a probe scan reads it valid. Works from the burst read by
+// retryFaulted(), call before updateInputRegisters().
+void updateScanList() {
+   unsigned short i;
+   uint uintBit, uintHard = 0, uintValid = 0;
+   byte bytFault;
+
+   for (i=3; i<=14; i++) {
+      uintBit = 1 << (i-1);
+      if((uintScanActive & uintBit) == 0) {
+         continue;
+      }
+      bytFault = arena.acq.arybytBurst[4*(i-3)];
+      if(bytFault & SENSOR_HARD_FAILURE) {
+         uintHard |= uintBit;
+      } else if(bytFault & VALID) {
+         uintValid |= uintBit;
+      }
+   }
+   uintPruned &= ~uintValid;
+
+   if(uintProbeInterval != 0) {
+      for (i=3; i<=14; i++) {
+         uintBit = 1 << (i-1);
+         if((uintHard & uintBit) == 0) {
+            arybytHardScans[i-1] = 0;      // leu, ou nem foi convertido
+         } else if(arybytHardScans[i-1] < PRUNE_SCANS) {
+            arybytHardScans[i-1]++;
+         }
+         if(arybytHardScans[i-1] >= PRUNE_SCANS && (uintPruned & uintBit) == 0) {
+            uintPruned |= uintBit;
+            ulngProbeStart = schedUptime();   // primeira sondagem daqui a 902 s
+         }
+      }
+   }
+   // descartados agora ou ainda com falha na sondagem: invlidos
+   if((uintHard & uintPruned) != 0) {
+      invalidateChannels(uintHard & uintPruned);
+   }
+   GIEL_bit = 0;
+   aryuintChannelStatus[4] = (uint)ulngScanMask & ~uintPruned;
+   aryuintChannelStatus[5] = uintPruned;
+   GIEL_bit = 1;
+}
+
+// Marks the results of the channels in uintMask (bit 0 = channel 1) as not
+// available until their next conversion, the others are left alone
+void invalidateChannels(uint uintMask) {
+   unsigned short i;
+
+   uintMask >>= 2;   // os resultados comeam no canal 3
+   filterReset(uintMask);
+   statsReset(uintMask);
+   alarmClear(uintMask);
+
+   for (i=0; i<12; i++) {
+      if(uintMask & (1 << i)) {
+         GIEL_bit = 0;
+         aryuintInputRegs[2*i]       = 0x7FC0;   // NaN
+         aryuintInputRegs[(2*i)+1]   = 0x0000;
+         aryuintTemp16[i]            = 0x8000;
+         aryuintTemp32[2*i]          = 0x8000;
+         aryuintTemp32[(2*i)+1]      = 0x0000;
+         aryuintTempFiltered[2*i]     = 0x8000;
+         aryuintTempFiltered[(2*i)+1] = 0x0000;
+         GIEL_bit = 1;
+      }
+   }
+   resultsChanged();
+}
+
+// Os bancos de resultados mudaram, as respostas guardadas deles no valem
+// mais. Chamar depois de escrever os registros.
+void resultsChanged() {
+   modbusBlockChanged(&inputRegsBlock);
+   modbusBlockChanged(&temp16Block);
+   modbusBlockChanged(&temp32Block);
+   modbusBlockChanged(&tempFilteredBlock);
+}
+
+void epochWritten(modbusBlockDef* pBlock) {
+   ulong ulngSeconds;
+
+   HiWord(ulngSeconds) = aryuintEpoch[0];
+   LoWord(ulngSeconds) = aryuintEpoch[1];
+   schedSetEpoch(ulngSeconds);
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on holding 201..212, only
+// the channels whose word changed start again from their next result
+void filterCfgWritten(modbusBlockDef* pBlock) {
+   filterReset(filterChanged());
+}
+
+void updateAdcRegisters() {
+   unsigned short i;
+   uint uintScaled;
+   bool adcChanged;
+
+   GIEL_bit = 0;
+   // mdias iguais: a resposta guardada de 1..31 continua valendo
+   adcChanged = aryuintInputRegs[24] != aryuintAdcAverage[INT_TEMP]
+             || aryuintInputRegs[25] != aryuintAdcAverage[PRESSURE]
+             || aryuintInputRegs[26] != aryuintAdcAverage[VBATT];
+   aryuintInputRegs[24] = aryuintAdcAverage[INT_TEMP];
+   aryuintInputRegs[25] = aryuintAdcAverage[PRESSURE];
+   aryuintInputRegs[26] = aryuintAdcAverage[VBATT];
+   for (i=0; i<3; i++) {
+      aryuintAdcHiRes[i] = aryuintAdcDecimated[arybytAdcOrder[i]];
+   }
+   bytAdcReady = 0;
+   GIEL_bit = 1;
+
+   if(adcChanged) {
+      modbusBlockChanged(&inputRegsBlock);
+   }
+
+   // unidades de engenharia em ponto fixo, sem float no lao peridico
+   for (i=0; i<3; i++) {
+      statsAdd(STATS_ADC + i, aryuintAdcHiRes[i]);
+      uintScaled = adcScale(arybytAdcOrder[i], aryuintAdcHiRes[i]);
+      alarmCheck(STATS_ADC + i, uintScaled > 32767 ? 32767 : uintScaled);
+      GIEL_bit = 0;
+      aryuintAdcHiRes[i+3] = uintScaled;
+      GIEL_bit = 1;
+   }
+}
+
+// Called from serviceIOBlocks() after a FC-06/FC-16 on holding register 2
+void acqModeWritten(modbusBlockDef* pBlock) {
+   if(uintAcqMode != ACQ_TRIGGERED) {
+      uintAcqMode = ACQ_FREE_RUN;
+   }
+}
+
+#ifdef MODBUS_GATEWAY
+void setupGateway() {
+     memset(aryuintGatewayCache,  0, sizeof(aryuintGatewayCache));
+     memset(aryuintGatewayStatus, 0, sizeof(aryuintGatewayStatus));
+     GW_TX_DIR = 0;
+     modbusMasterInit(GW_BAUD);
+
+// Downstream DAQ12 nodes 2 and 3, temperatures and internals every second
+     addModbusPoll(&gatewayPolls[0], 2, READ_INPUT_REGISTERS, 1, 28,
+                   (void*)&aryuintGatewayCache[0], 10);
+     addModbusPoll(&gatewayPolls[1], 3, READ_INPUT_REGISTERS, 1, 28,
+                   (void*)&aryuintGatewayCache[28], 10);
+
+// The whole cache is one block so the upstream master reads it in one go
+     addModbusBlock(1, INPUT_REGISTERS,   &gatewayCacheBlock,  1001,
+                   GW_CACHE_REGS, (void*)aryuintGatewayCache, NULL);
+     addModbusBlock(1, INPUT_REGISTERS,   &gatewayStatusBlock, 2001,
+                   2 * GW_POLLS, (void*)aryuintGatewayStatus, NULL);
+}
+
+// Age (x100 ms, 0xFFFF = never read) and status of each downstream poll.
+// modbusMasterTick muda a idade na baixa prioridade: lida e publicada com
+// ela desligada, o par sai sempre da mesma leitura
+void updateGatewayStatus() {
+   unsigned short i;
+
+   for (i=0; i<GW_POLLS; i++) {
+      GIEL_bit = 0;
+      aryuintGatewayStatus[2*i]     = gatewayPolls[i].uintAge;
+      aryuintGatewayStatus[(2*i)+1] = gatewayPolls[i].bytStatus;
+      GIEL_bit = 1;
+   }
+}
+
+void mbMasterPortInit(ulong ulngBaud) {
+   GW_TX = 1;           // repouso
+   TRISC1_bit = 1;      // RX, entrada da captura
+   T2CON = 0x01;        // prescaler 1:4, postscaler 1:1, parado
+   PR2 = ((GW_TIMER_HZ + (ulngBaud / 2)) / ulngBaud) - 1;   // um bit
+   CCP2CON = 0;
+   TMR2IF_bit = 0;
+   CCP2IF_bit = 0;
+   TMR2IP_bit = 1;
+   CCP2IP_bit = 1;
+   TMR2IE_bit = 1;
+   CCP2IE_bit = 0;
+   bytGwStatus = PORT_DONE;
+}
+
+// Abandons the transfer in progress, the interrupt leaves the port alone
+void mbMasterPortStop() {
+   TMR2ON_bit = 0;
+   CCP2IE_bit = 0;
+   CCP2CON = 0;
+   TMR2IF_bit = 0;
+   GW_TX = 1;
+   GW_TX_DIR = 0;
+}
+
+// Starts sending, the first interrupt a bit later sends the start bit so the
+// transceiver has a bit time to turn round
+void mbMasterPortWrite(byte* pBuffer, byte bytLength) {
+   mbMasterPortStop();
+   pGwBuffer = pBuffer;
+   bytGwLength = bytLength;
+   bytGwBit = 0;
+   blnGwTx = TRUE;
+   bytGwStatus = PORT_BUSY;
+   GW_TX_DIR = 1;
+   TMR2 = 0;
+   TMR2ON_bit = 1;
+}
+
+// Starts receiving, CCP2 catches the falling edge of the first start bit
+void mbMasterPortRead(byte* pBuffer, byte bytLength) {
+   mbMasterPortStop();
+   pGwBuffer = pBuffer;
+   bytGwLength = bytLength;
+   blnGwTx = FALSE;
+   bytGwStatus = PORT_BUSY;
+   CCP2CON = 0x04;      // captura na borda de descida
+   CCP2IF_bit = 0;
+   CCP2IE_bit = 1;
+}
+
+byte mbMasterPortStatus() {
+   return bytGwStatus;
+}
+
+// Downstream port, high priority. A start bit starts Timer2 half a bit on so
+// every later match is in the middle of a bit. Sending, each match drives
+// the next bit.
+void gwPortIsr() {
+   if(CCP2IF_bit && CCP2IE_bit) {
+      CCP2IE_bit = 0;
+      CCP2IF_bit = 0;
+      TMR2 = PR2 >> 1;
+      TMR2IF_bit = 0;
+      TMR2ON_bit = 1;
+      bytGwBit = 0;
+   }
+   if(TMR2IF_bit == 0) {
+      return;
+   }
+   TMR2IF_bit = 0;
+
+   if(blnGwTx) {
+      if(bytGwBit == 0) {
+         if(bytGwLength == 0) {   // o stop bit do ltimo j saiu
+            TMR2ON_bit = 0;
+            GW_TX_DIR = 0;
+            bytGwStatus = PORT_DONE;
+            return;
+         }
+         GW_TX = 0;               // start
+         bytGwShift = *pGwBuffer++;
+         bytGwLength--;
+      } else if(bytGwBit <= 8) {
+         GW_TX = bytGwShift & 0x01;
+         bytGwShift >>= 1;
+      } else {
+         GW_TX = 1;               // stop
+         bytGwBit = 0;
+         return;
+      }
+      bytGwBit++;
+      return;
+   }
+
+   if(bytGwBit == 0) {
+      if(GW_RX != 0) {            // rudo, no era start bit
+         TMR2ON_bit = 0;
+         CCP2IF_bit = 0;
+         CCP2IE_bit = 1;
+         return;
+      }
+   } else if(bytGwBit <= 8) {
+      bytGwShift >>= 1;
+      if(GW_RX != 0) {
+         bytGwShift |= 0x80;
+      }
+   } else {
+      TMR2ON_bit = 0;
+      if(GW_RX == 0) {
+         bytGwStatus = PORT_ERROR;   // sem stop bit
+         return;
+      }
+      *pGwBuffer++ = bytGwShift;
+      if(--bytGwLength == 0) {
+         bytGwStatus = PORT_DONE;
+      } else {
+         CCP2IF_bit = 0;             // prximo start bit
+         CCP2IE_bit = 1;
+      }
+      return;
+   }
+   bytGwBit++;
+}
+#endif
+
 void configure_channels() {
   uint8_t channel_number;
-  uint32_t channel_assignment_data;
-
-  // ----- Channel 2: Assign Sense Resistor -----
-  channel_assignment_data =
-    SENSOR_TYPE__SENSE_RESISTOR |
-    (uint32_t) 0xFA000 << SENSE_RESISTOR_VALUE_LSB;                // sense resistor - value: 1000.
-  assign_channel(2, channel_assignment_data);
-  // ----- Channel 3: Assign RTD PT-100 -----
-  channel_assignment_data =
-    SENSOR_TYPE__RTD_PT_100 |
-    RTD_RSENSE_CHANNEL__2 |
-    RTD_NUM_WIRES__2_WIRE |
-    RTD_EXCITATION_MODE__NO_ROTATION_SHARING |
-    RTD_EXCITATION_CURRENT__100UA |
-    RTD_STANDARD__AMERICAN;
-  assign_channel(3, channel_assignment_data);
-  // ----- Channel 4: Assign RTD PT-100 -----
-  channel_assignment_data =
-    SENSOR_TYPE__RTD_PT_100 |
-    RTD_RSENSE_CHANNEL__2 |
-    RTD_NUM_WIRES__2_WIRE |
-    RTD_EXCITATION_MODE__NO_ROTATION_SHARING |
-    RTD_EXCITATION_CURRENT__100UA |
-    RTD_STANDARD__AMERICAN;
-  assign_channel(4, channel_assignment_data);
-  // ----- Channel 5: Assign RTD PT-100 -----
-  channel_assignment_data =
-    SENSOR_TYPE__RTD_PT_100 |
-    RTD_RSENSE_CHANNEL__2 |
-    RTD_NUM_WIRES__2_WIRE |
-    RTD_EXCITATION_MODE__NO_ROTATION_SHARING |
-    RTD_EXCITATION_CURRENT__100UA |
-    RTD_STANDARD__AMERICAN;
-  assign_channel(5, channel_assignment_data);
-  // ----- Channel 6: Assign RTD PT-100 -----
-  channel_assignment_data =
-    SENSOR_TYPE__RTD_PT_100 |
-    RTD_RSENSE_CHANNEL__2 |
-    RTD_NUM_WIRES__2_WIRE |
-    RTD_EXCITATION_MODE__NO_ROTATION_SHARING |
-    RTD_EXCITATION_CURRENT__100UA |
-    RTD_STANDARD__AMERICAN;
-  assign_channel(6, channel_assignment_data);
-  // ----- Channel 7: Assign RTD PT-100 -----
-  channel_assignment_data =
-    SENSOR_TYPE__RTD_PT_100 |
-    RTD_RSENSE_CHANNEL__2 |
-    RTD_NUM_WIRES__2_WIRE |
-    RTD_EXCITATION_MODE__NO_ROTATION_SHARING |
-    RTD_EXCITATION_CURRENT__100UA |
-    RTD_STANDARD__AMERICAN;
-  assign_channel(7, channel_assignment_data);
-  // ----- Channel 8: Assign RTD PT-100 -----
-  channel_assignment_data =
-    SENSOR_TYPE__RTD_PT_100 |
-    RTD_RSENSE_CHANNEL__2 |
-    RTD_NUM_WIRES__2_WIRE |
-    RTD_EXCITATION_MODE__NO_ROTATION_SHARING |
-    RTD_EXCITATION_CURRENT__100UA |
-    RTD_STANDARD__AMERICAN;
-  assign_channel(8, channel_assignment_data);
-  // ----- Channel 9: Assign RTD PT-100 -----
-  channel_assignment_data =
-    SENSOR_TYPE__RTD_PT_100 |
-    RTD_RSENSE_CHANNEL__2 |
-    RTD_NUM_WIRES__2_WIRE |
-    RTD_EXCITATION_MODE__NO_ROTATION_SHARING |
-    RTD_EXCITATION_CURRENT__100UA |
-    RTD_STANDARD__AMERICAN;
-  assign_channel(9, channel_assignment_data);
-  // ----- Channel 10: Assign RTD PT-100 -----
-  channel_assignment_data =
-    SENSOR_TYPE__RTD_PT_100 |
-    RTD_RSENSE_CHANNEL__2 |
-    RTD_NUM_WIRES__2_WIRE |
-    RTD_EXCITATION_MODE__NO_ROTATION_SHARING |
-    RTD_EXCITATION_CURRENT__100UA |
-    RTD_STANDARD__AMERICAN;
-  assign_channel(10, channel_assignment_data);
-  // ----- Channel 11: Assign RTD PT-100 -----
-  channel_assignment_data =
-    SENSOR_TYPE__RTD_PT_100 |
-    RTD_RSENSE_CHANNEL__2 |
-    RTD_NUM_WIRES__2_WIRE |
-    RTD_EXCITATION_MODE__NO_ROTATION_SHARING |
-    RTD_EXCITATION_CURRENT__100UA |
-    RTD_STANDARD__AMERICAN;
-  assign_channel(11, channel_assignment_data);
-  // ----- Channel 12: Assign RTD PT-100 -----
-  channel_assignment_data =
-    SENSOR_TYPE__RTD_PT_100 |
-    RTD_RSENSE_CHANNEL__2 |
-    RTD_NUM_WIRES__2_WIRE |
-    RTD_EXCITATION_MODE__NO_ROTATION_SHARING |
-    RTD_EXCITATION_CURRENT__100UA |
-    RTD_STANDARD__AMERICAN;
-  assign_channel(12, channel_assignment_data);
-  // ----- Channel 13: Assign RTD PT-100 -----
-  channel_assignment_data =
-    SENSOR_TYPE__RTD_PT_100 |
-    RTD_RSENSE_CHANNEL__2 |
-    RTD_NUM_WIRES__2_WIRE |
-    RTD_EXCITATION_MODE__NO_ROTATION_SHARING |
-    RTD_EXCITATION_CURRENT__100UA |
-    RTD_STANDARD__AMERICAN;
-  assign_channel(13, channel_assignment_data);
-  // ----- Channel 14: Assign RTD PT-100 -----
-  channel_assignment_data =
-    SENSOR_TYPE__RTD_PT_100 |
-    RTD_RSENSE_CHANNEL__2 |
-    RTD_NUM_WIRES__2_WIRE |
-    RTD_EXCITATION_MODE__NO_ROTATION_SHARING |
-    RTD_EXCITATION_CURRENT__100UA |
-    RTD_STANDARD__AMERICAN;
-  assign_channel(14, channel_assignment_data);
+
+  // palavras de configurao da imagem (nodeConfig.c), canal 1 em [0]
+  for (channel_number = 1; channel_number <= CFG_CHANNELS; channel_number++) {
+    assign_channel(&ltcMain, channel_number, nodeCfg.arylngChannel[channel_number - 1]);
+  }
 }
 
 void configure_global_parameters() {
-  transfer_byte(WRITE_TO_RAM, 0xF0, TEMP_UNIT__C | REJECTION__50_60_HZ);   // -- Set global parameters
-  transfer_byte(WRITE_TO_RAM, 0xFF, 2); // -- Set any extra delay between conversions (in this case, 2*100us)
+  transfer_byte(&ltcMain, WRITE_TO_RAM, 0xF0, nodeCfg.bytGlobal);   // -- Set global parameters
+  transfer_byte(&ltcMain, WRITE_TO_RAM, 0xFF, nodeCfg.bytMuxDelay); // -- Set any extra delay between conversions (x100us)
 }
 
 void InitTimer1(){
 //Timer1
-//Prescaler 1:2; TMR1 Preload = 15536; Actual Interrupt Time : 100 ms
-  T1CON         = 0x11;
-  TMR1IF_bit         = 0;
-  TMR1H         = 0x3C;
-  TMR1L         = 0xB0;
-  TMR1IE_bit         = 1;
+//Prescaler 1:1; CCP1 special event a cada 1000 contagens: 1 ms
+//sem recarga por software, o perodo no depende da latncia da interrupo
+//RD16, leitura de 16 bits para schedMicros()
+  T1CON         = 0x81;
+  TMR1H         = 0;
+  TMR1L         = 0;
+  CCPR1H        = (SCHED_TICK_COMPARE >> 8);
+  CCPR1L        = (SCHED_TICK_COMPARE & 0xFF);
+  CCP1CON       = 0x0B;   // compare, special event trigger
+  TMR1IE_bit         = 0;
+  CCP1IF_bit         = 0;
+  CCP1IE_bit         = 1;
   INTCON         = 0xC0;
 }
 
+// Re-converts the channels of the scan that read invalid or out of range
+// one at a time, up to uintRetryMax conversions each, before the scan is
+// published. Returns TRUE while one is converting, call again once the
+// LTC2983 is idle. When it returns FALSE arena.acq.arybytBurst holds the
+// results of channels 3..14, the re-converted ones included.
+boolean retryFaulted() {
+   unsigned short i;
+   uint uintBit;
+   byte bytFault;
+
+   if(bytRetryChannel == 0) {
+      // fim da varredura: os 12 resultados numa s transao SPI
+      read_results_block(&ltcMain, 3, 12, arena.acq.arybytBurst);
+      uintRetryPending = 0;
+      uintRetried = 0;
+      uintRetryFailed = 0;
+
+      if(uintRetryMax == 0) {
+         return FALSE;
+      }
+      for (i=3; i<=14; i++) {
+         uintBit = 1 << (i-1);
+         bytFault = arena.acq.arybytBurst[4*(i-3)];
+         if((uintScanActive & uintBit) && RETRY_FAULT(bytFault)) {
+            uintRetryPending |= uintBit;
+         }
+      }
+   } else {
+      // resultado da reconverso, s o byte de falha interessa aqui
+      read_results_block(&ltcMain, bytRetryChannel, 1, arena.acq.arybytBurst);
+      uintBit = 1 << (bytRetryChannel-1);
+      bytFault = arena.acq.arybytBurst[0];
+
+      if(RETRY_FAULT(bytFault)) {
+         if(bytRetriesLeft > 1) {   // 901 pode ter mudado no meio
+            bytRetriesLeft--;
+            convert_channel(&ltcMain, bytRetryChannel);
+            timingRetry(bytRetryChannel);   // 901 e 904 contam a reconverso
+            return TRUE;
+         }
+         uintRetryFailed |= uintBit;
+      }
+      uintRetryPending &= ~uintBit;
+   }
+
+   for (i=1; i<=CFG_CHANNELS; i++) {
+      uintBit = 1 << (i-1);
+      if(uintRetryPending & uintBit) {
+         bytRetryChannel = i;
+         bytRetriesLeft = uintRetryMax;
+         uintRetried |= uintBit;
+         convert_channel(&ltcMain, i);
+         timingRetry(i);
+         return TRUE;
+      }
+   }
+
+   if(bytRetryChannel != 0) {
+      // a arena no sobrevive entre execues da tarefa: l tudo de novo
+      bytRetryChannel = 0;
+      read_results_block(&ltcMain, 3, 12, arena.acq.arybytBurst);
+   }
+   return FALSE;
+}
+
+// Publishes the results of channels 3..14 read by retryFaulted(), the three
+// banks come from the same value. Channels not converted by this scan, or
+// dropped by updateScanList(), are left as they are.
 void updateInputRegisters() {
    unsigned short i = 0;
-   
+   long lngRaw, lngCenti, lngFiltered;
+
    for (i=1; i<=12; i++) {
-      temperatureValue = get_result((i+2), TEMPERATURE);
+      if(((uintScanActive & ~uintPruned) & (1 << (i+1))) == 0) {
+         continue;   // descartado: continua invlido
+      }
+      lngRaw = get_raw_from_buffer(&arena.acq.arybytBurst[4*(i-1)]);   // 1/1024 C
+      temperatureValue = lngRaw / 1024.0;
       MCHPtoIEEE(&temperatureValue);
+      // 0.01 C, arredondado, sem float
+      lngCenti = lngRaw * 100;
+      if(lngCenti < 0) {
+         lngCenti = -((512 - lngCenti) >> 10);
+      } else {
+         lngCenti = (lngCenti + 512) >> 10;
+      }
+      if(lngCenti > 32767) {
+         lngCenti = 32767;
+      } else if(lngCenti < -32768) {
+         lngCenti = -32768;
+      }
+      lngFiltered = lngRaw;   // invlido: publicado sem filtrar
+      if(arena.acq.arybytBurst[4*(i-1)] & VALID) {   // s resultados vlidos
+         lngFiltered = filterApply(i-1, lngRaw);
+         statsAdd(i-1, lngRaw);
+         alarmCheck(i-1, lngCenti);   // limites em 0,01 C
+      }
+      // pares de registros escritos com a baixa prioridade desligada, o mestre
+      // nunca l metade de um valor novo
+      GIEL_bit = 0;
       aryuintInputRegs[((2*i)-2)] = HiWord(temperatureValue);
       aryuintInputRegs[(2*i)-1]   = LoWord(temperatureValue);
+      aryuintTemp16[i-1]          = LoWord(lngCenti);
+      aryuintTemp32[((2*i)-2)]    = HiWord(lngRaw);
+      aryuintTemp32[(2*i)-1]      = LoWord(lngRaw);
+      aryuintTempFiltered[((2*i)-2)] = HiWord(lngFiltered);
+      aryuintTempFiltered[(2*i)-1]   = LoWord(lngFiltered);
+      GIEL_bit = 1;
    }
 }
\ No newline at end of file
@@ -22,19 +22,50 @@ All rights reserved.
 
 
 
+// ***********************
+// The device
+// ***********************
+// Sets up the chip select and INT pins of a device, the part holds no known
+// scan mask until ltc_set_scan_mask has written one
+void ltc_init(ltc_device *dev, volatile uint8_t *cs_port, uint8_t cs_mask,
+              volatile uint8_t *int_port, uint8_t int_mask) {
+  dev->spi.cs_port = cs_port;
+  dev->spi.cs_mask = cs_mask;
+  dev->int_port = int_port;
+  dev->int_mask = int_mask;
+  dev->mask_valid = 0;
+  dev->scan_mask = 0;
+  spi_select(&dev->spi, 1);
+}
+
+// INT is high once a conversion has finished, and after power up
+uint8_t ltc_idle(ltc_device *dev) {
+  return (*dev->int_port & dev->int_mask) != 0;
+}
+
+// Writes the multiple channel mask, bit 0 is channel 1, only when it differs
+// from the one the part holds so a repeated scan is a single command
+void ltc_set_scan_mask(ltc_device *dev, uint32_t mask) {
+  if (dev->mask_valid && dev->scan_mask == mask)
+    return;
+  transfer_four_bytes(dev, WRITE_TO_RAM, 0xF4, mask);
+  dev->scan_mask = mask;
+  dev->mask_valid = 1;
+}
+
 // ***********************
 // Program the part
 // ***********************
-void assign_channel(uint8_t channel_number, uint32_t channel_assignment_data) {
+void assign_channel(ltc_device *dev, uint8_t channel_number, uint32_t channel_assignment_data) {
   uint16_t start_address = get_start_address(CH_ADDRESS_BASE, channel_number);
-  transfer_four_bytes(WRITE_TO_RAM, start_address, channel_assignment_data);
+  transfer_four_bytes(dev, WRITE_TO_RAM, start_address, channel_assignment_data);
 }
 
-void write_custom_table(struct table_coeffs coefficients[64], uint16_t start_address, uint8_t table_length) {
+void write_custom_table(ltc_device *dev, struct table_coeffs coefficients[64], uint16_t start_address, uint8_t table_length) {
   int8_t i;
   uint32_t coeff;
 
-  Chip_Select = 0; //output_low(chip_select);
+  spi_select(&dev->spi, 0); //output_low(chip_select);
 
   SPI1_Write(WRITE_TO_RAM);
   SPI1_Write(hi(start_address));
@@ -51,15 +82,15 @@ void write_custom_table(struct table_coeffs coefficients[64], uint16_t start_add
     SPI1_Write((uint8_t)(coeff >> 8));
     SPI1_Write((uint8_t)coeff);
   }
-  Chip_Select = 1; //output_high(chip_select);
+  spi_select(&dev->spi, 1); //output_high(chip_select);
 }
 
 
-void write_custom_steinhart_hart(uint32_t steinhart_hart_coeffs[6], uint16_t start_address) {
+void write_custom_steinhart_hart(ltc_device *dev, uint32_t steinhart_hart_coeffs[6], uint16_t start_address) {
   int8_t i;
   uint32_t coeff;
 
-  Chip_Select = 0; //output_low(chip_select);
+  spi_select(&dev->spi, 0); //output_low(chip_select);
 
   SPI1_Write(WRITE_TO_RAM);
   SPI1_Write(hi(start_address));
@@ -72,56 +103,57 @@ void write_custom_steinhart_hart(uint32_t steinhart_hart_coeffs[6], uint16_t sta
     SPI1_Write((uint8_t)(coeff >> 8));
     SPI1_Write((uint8_t)coeff);
   }
-  Chip_Select = 1; //output_high(chip_select);
+  spi_select(&dev->spi, 1); //output_high(chip_select);
 }
 
 // *****************
 // Measure channel
 // *****************
-float measure_channel(uint8_t channel_number, uint8_t channel_output) {
-    convert_channel(channel_number);
-    return get_result(channel_number, channel_output);
+float measure_channel(ltc_device *dev, uint8_t channel_number, uint8_t channel_output) {
+    convert_channel(dev, channel_number);
+    wait_for_process_to_finish(dev);
+    return get_result(dev, channel_number, channel_output);
 }
 
-void convert_channel(uint8_t channel_number) { // Start conversion
-  transfer_byte(WRITE_TO_RAM, COMMAND_STATUS_REGISTER, CONVERSION_CONTROL_BYTE | channel_number);
-  if(channel_number != 0) { // multiple channels
-     wait_for_process_to_finish();
-  }
+// Starts a conversion and returns, channel_number 0 converts the scan mask.
+// Wait with wait_for_process_to_finish, or poll check() or ltc_idle(), so
+// other devices can be started meanwhile.
+void convert_channel(ltc_device *dev, uint8_t channel_number) { // Start conversion
+  transfer_byte(dev, WRITE_TO_RAM, COMMAND_STATUS_REGISTER, CONVERSION_CONTROL_BYTE | channel_number);
 }
 
-bool check() {
+bool check(ltc_device *dev) {
   uint8_t process_finished = 0;
   uint8_t data_;
-    data_ = transfer_byte(READ_FROM_RAM, COMMAND_STATUS_REGISTER, 0);
+    data_ = transfer_byte(dev, READ_FROM_RAM, COMMAND_STATUS_REGISTER, 0);
     return process_finished  = data_ & 0x40;
 }
 
-void wait_for_process_to_finish() {
+void wait_for_process_to_finish(ltc_device *dev) {
   uint8_t process_finished = 0;
   uint8_t data_;
   while (process_finished == 0)  {
-    data_ = transfer_byte(READ_FROM_RAM, COMMAND_STATUS_REGISTER, 0);
+    data_ = transfer_byte(dev, READ_FROM_RAM, COMMAND_STATUS_REGISTER, 0);
     process_finished  = data_ & 0x40;
   }
 }
 
-void wait_for_interrupt() {
-  while (LTC_INT == 0)  {
+void wait_for_interrupt(ltc_device *dev) {
+  while (!ltc_idle(dev))  {
   }
 }
 
 // *********************************
 // Get results
 // *********************************
-float get_result(uint8_t channel_number, uint8_t channel_output) {
+float get_result(ltc_device *dev, uint8_t channel_number, uint8_t channel_output) {
   uint32_t raw_data;
   uint8_t fault_data;
   
   uint16_t start_address = get_start_address(CONVERSION_RESULT_MEMORY_BASE, channel_number);
   uint32_t raw_conversion_result;
 
-  raw_data = transfer_four_bytes(READ_FROM_RAM, start_address, 0);
+  raw_data = transfer_four_bytes(dev, READ_FROM_RAM, start_address, 0);
 
   //UART_Write_Text("\nChannel ");
   //UART_Write(channel_number+48);
@@ -141,11 +173,38 @@ float get_result(uint8_t channel_number, uint8_t channel_output) {
   UART1_Write(fault_data);*/
 }
 
+// Reads the results of count channels from first_channel on in one SPI
+// transaction, 4 bytes per channel (fault byte first) into buffer
+void read_results_block(ltc_device *dev, uint8_t first_channel, uint8_t count, uint8_t *buffer) {
+  uint16_t start_address = get_start_address(CONVERSION_RESULT_MEMORY_BASE, first_channel);
+  uint8_t i;
+
+  spi_select(&dev->spi, 0);
+  SPI1_Write(READ_FROM_RAM);
+  SPI1_Write(hi(start_address));
+  SPI1_Write(lo(start_address));
+
+  for (i=0; i < 4 * count; i++)
+    buffer[i] = SPI1_Read(0);
+
+  spi_select(&dev->spi, 1);
+}
+
+// Signed 24 bit result from 4 bytes read by read_results_block
+int32_t get_raw_from_buffer(uint8_t *result) {
+  int32_t signed_data;
+
+  signed_data = (uint32_t) result[1] << 16 |
+                (uint32_t) result[2] << 8  |
+                (uint32_t) result[3];
+  if(signed_data & 0x800000)
+    signed_data = signed_data | 0xFF000000; // Convert the 24 LSB's into a signed 32-bit integer
+  return signed_data;
+}
 
 float print_conversion_result(uint32_t raw_conversion_result, uint8_t channel_output) {
   int32_t signed_data = raw_conversion_result;
   float scaled_result;
-  unsigned int txt[4];
 
   if(signed_data & 0x800000)
     signed_data = signed_data | 0xFF000000; // Convert the 24 LSB's into a signed 32-bit integer
@@ -207,7 +266,7 @@ void print_fault_data(uint8_t fault_byte) {
 // To read from the RAM, set ram_read_or_write = READ_FROM_RAM.
 // input_data is the data to send into the RAM. If you are reading from the part, set input_data = 0.
 
-uint32_t transfer_four_bytes(uint8_t ram_read_or_write, uint16_t start_address, uint32_t input_data) {
+uint32_t transfer_four_bytes(ltc_device *dev, uint8_t ram_read_or_write, uint16_t start_address, uint32_t input_data) {
   uint32_t output_data;
   uint8_t ttx[7], rrx[7];
 
@@ -219,7 +278,7 @@ uint32_t transfer_four_bytes(uint8_t ram_read_or_write, uint16_t start_address,
   ttx[1] = (uint8_t)(input_data >> 8);
   ttx[0] = (uint8_t) input_data;
 
-  spi_transfer_block(ttx, rrx, 7);
+  spi_transfer_block(&dev->spi, ttx, rrx, 7);
 
   output_data = (uint32_t) rrx[3] << 24 |
                 (uint32_t) rrx[2] << 16 |
@@ -230,14 +289,14 @@ uint32_t transfer_four_bytes(uint8_t ram_read_or_write, uint16_t start_address,
 }
 
 
-uint8_t transfer_byte(uint8_t ram_read_or_write, uint16_t start_address, uint8_t input_data) {
+uint8_t transfer_byte(ltc_device *dev, uint8_t ram_read_or_write, uint16_t start_address, uint8_t input_data) {
   uint8_t ttx[4], rrx[4];
 
   ttx[3] = ram_read_or_write;
   ttx[2] = (uint8_t)(start_address >> 8);
   ttx[1] = (uint8_t)start_address;
   ttx[0] = input_data;
-  spi_transfer_block(ttx, rrx, 4);
+  spi_transfer_block(&dev->spi, ttx, rrx, 4);
   return rrx[0];
 }
 
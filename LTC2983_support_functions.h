@@ -13,21 +13,46 @@ All rights reserved.
 
 */
 
-void assign_channel(uint8_t channel_number, uint32_t channel_assignment_data);
-void write_custom_steinhart_hart(uint32_t steinhart_hart_coeffs[6], uint16_t start_address);
-
-float measure_channel(uint8_t channel_number, uint8_t channel_output);
-void convert_channel(uint8_t channel_number);
-void wait_for_process_to_finish();
-void wait_for_interrupt();
-
-float get_result(uint8_t channel_number, uint8_t channel_output);
+#ifndef LTC2983_SUPPORT_FUNCTIONS_H
+#define LTC2983_SUPPORT_FUNCTIONS_H
+
+#include "LT_SPI.h"
+
+// One LTC2983 on the SPI bus. Every function takes the device, so several
+// parts can share the bus and convert at the same time, each is started
+// with convert_channel() and polled through its own INT pin.
+typedef struct {
+  spi_device spi;              // chip select
+  volatile uint8_t *int_port;  // port the INT pin is read from
+  uint8_t int_mask;
+  uint8_t mask_valid;          // scan_mask is what the part holds
+  uint32_t scan_mask;          // multiple channel mask, 0xF4..0xF7
+} ltc_device;
+
+void ltc_init(ltc_device *dev, volatile uint8_t *cs_port, uint8_t cs_mask,
+              volatile uint8_t *int_port, uint8_t int_mask);
+uint8_t ltc_idle(ltc_device *dev);
+void ltc_set_scan_mask(ltc_device *dev, uint32_t mask);
+
+void assign_channel(ltc_device *dev, uint8_t channel_number, uint32_t channel_assignment_data);
+void write_custom_steinhart_hart(ltc_device *dev, uint32_t steinhart_hart_coeffs[6], uint16_t start_address);
+
+float measure_channel(ltc_device *dev, uint8_t channel_number, uint8_t channel_output);
+void convert_channel(ltc_device *dev, uint8_t channel_number);
+void wait_for_process_to_finish(ltc_device *dev);
+void wait_for_interrupt(ltc_device *dev);
+
+float get_result(ltc_device *dev, uint8_t channel_number, uint8_t channel_output);
+void read_results_block(ltc_device *dev, uint8_t first_channel, uint8_t count, uint8_t *buffer);
+int32_t get_raw_from_buffer(uint8_t *result);
 float print_conversion_result(uint32_t raw_conversion_result, uint8_t channel_output);
 //void read_voltage_or_resistance_results(uint8_t channel_number);
 void print_fault_data(uint8_t fault_byte);
 
-uint32_t transfer_four_bytes(uint8_t read_or_write, uint16_t start_address, uint32_t input_data);
-uint8_t transfer_byte(uint8_t read_or_write, uint16_t start_address, uint8_t input_data);
+uint32_t transfer_four_bytes(ltc_device *dev, uint8_t read_or_write, uint16_t start_address, uint32_t input_data);
+uint8_t transfer_byte(ltc_device *dev, uint8_t read_or_write, uint16_t start_address, uint8_t input_data);
 
 uint16_t get_start_address(uint16_t base_address, uint8_t channel_number);
-bool is_number_in_array(uint8_t number, uint8_t *array, uint8_t array_length);
\ No newline at end of file
+bool is_number_in_array(uint8_t number, uint8_t *array, uint8_t array_length);
+
+#endif  // LTC2983_SUPPORT_FUNCTIONS_H
@@ -1,19 +1,34 @@
 #include <stdint.h>
 #include "LT_SPI.h"
 
+// Drives the chip select of a device. Other pins of the latch are written
+// by the low priority interrupt, the read-modify-write is done with it off.
+// GIEL is put back as it was, so this nests inside a caller's critical
+// section and leaves PEIE alone when called before IPEN is set.
+void spi_select(spi_device *dev, uint8_t level) {
+  uint8_t giel = GIEL_bit;
+
+  GIEL_bit = 0;
+  if (level)
+    *dev->cs_port |= dev->cs_mask;
+  else
+    *dev->cs_port &= ~dev->cs_mask;
+  GIEL_bit = giel;
+}
+
 // Reads and sends a byte
 // Return 0 if successful, 1 if failed
-void spi_transfer_byte(uint8_t ttx, uint8_t *rrx) {
-  Chip_Select = 0;                         //! 1) Pull CS low
+void spi_transfer_byte(spi_device *dev, uint8_t ttx, uint8_t *rrx) {
+  spi_select(dev, 0);                      //! 1) Pull CS low
 
-  *rrx = SPI1_Read(tx); //             //! 2) Read byte and send byte
+  *rrx = SPI1_Read(ttx); //             //! 2) Read byte and send byte
 
-  Chip_Select = 1;                //! 3) Pull CS high
+  spi_select(dev, 1);             //! 3) Pull CS high
 }
 
 // Reads and sends a word
 // Return 0 if successful, 1 if failed
-void spi_transfer_word(uint16_t ttx, uint16_t *rrx) {
+void spi_transfer_word(spi_device *dev, uint16_t ttx, uint16_t *rrx) {
   union  {
     uint8_t b[2];
     uint16_t w;
@@ -24,25 +39,25 @@ void spi_transfer_word(uint16_t ttx, uint16_t *rrx) {
     uint16_t w;
   } data_rx;
 
-  data_tx.w = tx;
+  data_tx.w = ttx;
 
-  Chip_Select = 0;                              //! 1) Pull CS low
+  spi_select(dev, 0);                           //! 1) Pull CS low
 
   data_rx.b[1] = SPI1_Read(data_tx.b[1]);  //! 2) Read MSB and send MSB
   data_rx.b[0] = SPI1_Read(data_tx.b[0]);  //! 3) Read LSB and send LSB
 
   *rrx = data_rx.w;
 
-  Chip_Select = 1;                              //! 4) Pull CS high
+  spi_select(dev, 1);                           //! 4) Pull CS high
 }
 
 // Reads and sends a byte array
-void spi_transfer_block(uint8_t *ttx, uint8_t *rrx, uint8_t length) {
+void spi_transfer_block(spi_device *dev, uint8_t *ttx, uint8_t *rrx, uint8_t length) {
   int8_t i=0;
-  Chip_Select = 0;                       //! 1) Pull CS low
+  spi_select(dev, 0);                    //! 1) Pull CS low
 
   for (i=(length-1);  i >= 0; i--)
     rrx[i] = SPI1_Read(ttx[i]);       //! 2) Read and send byte array
 
-  Chip_Select = 1;                       //! 3) Pull CS high
-}
\ No newline at end of file
+  spi_select(dev, 1);                    //! 3) Pull CS high
+}
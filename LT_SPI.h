@@ -15,17 +15,35 @@ All rights reserved.
 
 #include <stdint.h>
 
-void spi_transfer_byte(uint8_t ttx, uint8_t *rrx);
+//! A device on the SPI bus, its chip select is the cs_mask bit of the
+//! cs_port latch, active low
+typedef struct {
+  volatile uint8_t *cs_port;
+  uint8_t cs_mask;
+} spi_device;
+
+//! Drives the chip select of a device, 0 selects it
+//! @return void
+void spi_select(spi_device *dev, uint8_t level);
+
+//! Reads and sends a byte
+//! @return void
+void spi_transfer_byte(spi_device *dev,      //!< Device to select
+                       uint8_t ttx,          //!< Byte to be transmitted
+                       uint8_t *rrx          //!< Byte to be received
+                      );
 
 //! Reads and sends a word
 //! @return void
-void spi_transfer_word(uint16_t ttx,         //!< Byte to be transmitted
+void spi_transfer_word(spi_device *dev,      //!< Device to select
+                       uint16_t ttx,         //!< Byte to be transmitted
                        uint16_t *rrx         //!< Byte to be received
                       );
 
 //! Reads and sends a byte array
 //! @return void
-void spi_transfer_block(uint8_t *ttx,        //!< Byte array to be transmitted
+void spi_transfer_block(spi_device *dev,     //!< Device to select
+                        uint8_t *ttx,        //!< Byte array to be transmitted
                         uint8_t *rrx,        //!< Byte array to be received
                         uint8_t length      //!< Length of array
                        );
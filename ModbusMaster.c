@@ -0,0 +1,467 @@
+/**
+ * File:
+ *  modbusMaster.c
+ *
+ * Notes:
+ *  This file contains the master engine used by the gateway build.  Downstream
+ * slaves are polled on a schedule and their data is cached in local arrays
+ * which the application registers as normal modbus blocks, so the upstream
+ * master can read everything from one node in a few large requests.
+ *
+ *  The engine does not own a serial port, the application provides one
+ * that transfers in the background, from interrupts or hardware:
+ *   mbMasterPortInit   Initialise the downstream port
+ *   mbMasterPortWrite  Start sending a request
+ *   mbMasterPortRead   Start receiving a fixed number of bytes
+ *   mbMasterPortStatus PORT_BUSY until the transfer is done, PORT_DONE or
+ *                      PORT_ERROR for a framing error
+ *   mbMasterPortStop   Abandon the transfer in progress
+ *  A transaction is a state machine advanced by serviceModbusMaster, the
+ * timeouts are counted in master ticks, so nothing waits on the port.
+ *
+ * Functions:
+ *  addModbusPoll       Adds a downstream slave poll to the schedule
+ *  modbusMasterInit    Sets the downstream baud rate and response timeout
+ *  masterDone          Ends an attempt, repeats the request or stores the
+ *                      result
+ *  masterFlush         Waits for the rest of a bad response to go by
+ *  masterHeader        Checks the start of a response
+ *  masterRead          Starts receiving with a timeout
+ *  masterRequest       Builds and starts sending a request
+ *  masterResponse      Checks a whole response and refreshes the cache
+ *  modbusMasterTick    Ages the polls and the timeout, call every
+ *                      MASTER_TICK_MS
+ *  pollDue             Checks if a poll's countdown has run out
+ *  serviceModbusMaster Advances the transaction in progress or starts the
+ *                      next poll that is due
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Non-blocking, the port transfers in the background
+ *  18/10/2026 The countdown is read with the tick masked
+ */
+#include "modbus.h"
+
+#if defined MODBUS_MASTER || defined MODBUS_GATEWAY
+// Transaction states
+#define MASTER_IDLE     0
+#define MASTER_SEND     1   // request going out
+#define MASTER_HEADER   2   // waiting for address, function and count
+#define MASTER_DATA     3   // waiting for the data and CRC
+#define MASTER_FLUSH    4   // bad response, waiting for the line to go quiet
+// The downstream poll list
+modbusPollDef* pPolls = NULL;
+// Downstream response timeout in milliseconds
+uint uintMbMasterTimeout;
+// The next poll to check, gives each poll a fair share of the port
+static modbusPollDef* pNextPoll = NULL;
+// Request and response buffer
+static byte arybytMbMasterBuffer[MAX_MASTER_PACKET_LENGTH];
+// Transaction in progress, its state, attempts so far and the data bytes
+// expected after the header
+static modbusPollDef* pActivePoll = NULL;
+static byte bytMasterState = MASTER_IDLE;
+static byte bytMasterRetry;
+static byte bytMasterCount;
+// Master ticks left to wait for the port, counted down by modbusMasterTick
+static volatile byte bytMasterWait = 0;
+/**
+ * Function:
+ *  addModbusPoll
+ *
+ * Parameters:
+ *  pPoll, the poll to set-up
+ *  bytSlaveAddress, the downstream slave address 1 to 247
+ *  eFunction, READ_COILS, READ_STATUS_INPUTS, READ_HOLDING_REGISTERS or
+ *             READ_INPUT_REGISTERS
+ *  uintAddress, the first address to read, base 1
+ *  uintTotal, the number of items to read
+ *  paryData, a pointer to the cache area,
+ *              for discretes this must be an array of bytes
+ *              for registers this must be an array of uints
+ *  uintPeriod, the poll period in master ticks
+ *
+ * Returns:
+ *  TRUE if poll added, FALSE if not
+ */
+boolean addModbusPoll(modbusPollDef* pPoll,
+                      byte bytSlaveAddress,
+                      mbFunction eFunction,
+                      uint uintAddress,
+                      uint uintTotal,
+                      void* paryData,
+                      uint uintPeriod) {
+  modbusPollDef* pNode;
+
+  if ( bytSlaveAddress < 1 || bytSlaveAddress > 247 ) {
+    return FALSE;
+  }
+// Validate parameters
+  if ( pPoll == NULL
+    || uintAddress == 0
+    || uintTotal == 0
+    || paryData == NULL
+    || uintPeriod == 0 ) {
+    return FALSE;
+  }
+  if ( eFunction == READ_COILS || eFunction == READ_STATUS_INPUTS ) {
+    if ( uintTotal > MAX_REGISTERS_IN_POLL * 16 ) {
+      return FALSE;
+    }
+  } else if ( eFunction == READ_HOLDING_REGISTERS
+           || eFunction == READ_INPUT_REGISTERS ) {
+    if ( uintTotal > MAX_REGISTERS_IN_POLL ) {
+      return FALSE;
+    }
+  } else {
+    return FALSE;
+  }
+// Populate the poll, it is due straight away and has never been refreshed
+  pPoll->bytSlaveAddress = bytSlaveAddress;
+  pPoll->eFunction       = eFunction;
+  pPoll->uintAddress     = uintAddress;
+  pPoll->uintTotal       = uintTotal;
+  pPoll->paryData        = paryData;
+  pPoll->uintPeriod      = uintPeriod;
+  pPoll->uintCountdown   = 0;
+  pPoll->uintAge         = 0xffff;
+  pPoll->bytStatus       = POLL_TIMEOUT;
+  pPoll->pNext           = NULL;
+// Append this poll to the linked list
+  if ( pPolls == NULL ) {
+    pPolls = pPoll;
+  } else {
+    for( pNode=pPolls; pNode->pNext!=NULL; pNode=pNode->pNext ) ;
+    pNode->pNext = pPoll;
+  }
+  return TRUE;
+}
+/**
+ * Function:
+ *  modbusMasterInit
+ *
+ * Parameters:
+ *  eBaud, see modbus.h for options
+ *
+ * Returns:
+ *  0 if ok, -1 if error
+ */
+int modbusMasterInit(baudRate eBaud) {
+  switch( eBaud ) {
+  case BAUD_1200:
+    uintMbMasterTimeout = PACKET_TIMEOUT_1200;
+    break;
+  case BAUD_2400:
+    uintMbMasterTimeout = PACKET_TIMEOUT_2400;
+    break;
+  case BAUD_4800:
+    uintMbMasterTimeout = PACKET_TIMEOUT_4800;
+    break;
+  case BAUD_9600:
+    uintMbMasterTimeout = PACKET_TIMEOUT_9600;
+    break;
+  case BAUD_19200:
+    uintMbMasterTimeout = PACKET_TIMEOUT_19200;
+    break;
+  case BAUD_38400:
+    uintMbMasterTimeout = PACKET_TIMEOUT_38400;
+    break;
+  case BAUD_57600:
+    uintMbMasterTimeout = PACKET_TIMEOUT_57600;
+    break;
+  case BAUD_115200:
+    uintMbMasterTimeout = PACKET_TIMEOUT_115200;
+    break;
+  default:
+    return -1;
+  }
+  mbMasterPortInit((ulong)eBaud * 100);
+  return 0;
+}
+/**
+ * Function:
+ *  modbusMasterTick
+ *
+ * Parameters:
+ *  none
+ *
+ * Returns:
+ *  none
+ *
+ * Remarks: called from the interrupt every MASTER_TICK_MS
+ */
+void modbusMasterTick(void) {
+  modbusPollDef* pNode;
+
+  if ( bytMasterWait > 0 ) {
+    bytMasterWait--;
+  }
+  for( pNode=pPolls; pNode!=NULL; pNode=pNode->pNext ) {
+    if ( pNode->uintCountdown > 0 ) {
+      pNode->uintCountdown--;
+    }
+    if ( pNode->uintAge < 0xffff ) {
+      pNode->uintAge++;
+    }
+  }
+}
+/**
+ * Function:
+ *  masterRead
+ *
+ * Parameters:
+ *  pBuffer, where the bytes go
+ *  bytLength, the number of bytes expected
+ *  uintTimeout, how long to wait for them in milliseconds
+ */
+static void masterRead(byte* pBuffer, byte bytLength, uint uintTimeout) {
+  mbMasterPortRead(pBuffer, bytLength);
+  bytMasterWait = (uintTimeout / MASTER_TICK_MS) + 2;
+}
+/**
+ * Function:
+ *  masterFlush
+ *
+ * Remarks: a bad response, lets the rest of the frame go by before the
+ *          request is repeated
+ */
+static void masterFlush(void) {
+  masterRead(arybytMbMasterBuffer, 1, MASTER_TICK_MS);
+  bytMasterState = MASTER_FLUSH;
+}
+/**
+ * Function:
+ *  masterRequest
+ *
+ * Parameters:
+ *  pPoll, the poll to perform
+ *
+ * Remarks: starts sending the request, returns straight away
+ */
+static void masterRequest(modbusPollDef* pPoll) {
+  uint uintTemp;
+// Build the request, addresses are base 0 on the wire
+  arybytMbMasterBuffer[0] = pPoll->bytSlaveAddress;
+  arybytMbMasterBuffer[1] = pPoll->eFunction;
+  uintTemp = pPoll->uintAddress - 1;
+  arybytMbMasterBuffer[2] = Hi(uintTemp);
+  arybytMbMasterBuffer[3] = Lo(uintTemp);
+  uintTemp = pPoll->uintTotal;
+  arybytMbMasterBuffer[4] = Hi(uintTemp);
+  arybytMbMasterBuffer[5] = Lo(uintTemp);
+  uintTemp = calcBufferCRC(arybytMbMasterBuffer, 6);
+  arybytMbMasterBuffer[6] = Lo(uintTemp);
+  arybytMbMasterBuffer[7] = Hi(uintTemp);
+  mbMasterPortWrite(arybytMbMasterBuffer, 8);
+  bytMasterState = MASTER_SEND;
+}
+/**
+ * Function:
+ *  masterHeader
+ *
+ * Parameters:
+ *  pPoll, the poll in progress
+ *
+ * Returns:
+ *  TRUE if the address, function and byte count or exception code are as
+ *  expected, bytMasterCount is set to the data bytes that follow
+ */
+static boolean masterHeader(modbusPollDef* pPoll) {
+  if ( arybytMbMasterBuffer[0] != pPoll->bytSlaveAddress
+    || (arybytMbMasterBuffer[1] & ~EXCEPTION_FLAG) != pPoll->eFunction ) {
+    return FALSE;
+  }
+  if ( arybytMbMasterBuffer[1] & EXCEPTION_FLAG ) {
+    bytMasterCount = 0;
+  } else {
+    if ( pPoll->eFunction == READ_COILS
+      || pPoll->eFunction == READ_STATUS_INPUTS ) {
+      bytMasterCount = (pPoll->uintTotal + 7) / 8;
+    } else {
+      bytMasterCount = pPoll->uintTotal * 2;
+    }
+    if ( arybytMbMasterBuffer[2] != bytMasterCount ) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+/**
+ * Function:
+ *  masterResponse
+ *
+ * Parameters:
+ *  pPoll, the poll in progress
+ *
+ * Returns:
+ *  NO_EXCEPTION if the cache was refreshed, otherwise the slave's exception
+ *  code or POLL_BAD_RESPONSE
+ */
+static byte masterResponse(modbusPollDef* pPoll) {
+  uint uintTemp, uintIndex;
+  byte bytCount = bytMasterCount;
+
+  uintTemp = calcBufferCRC(arybytMbMasterBuffer, bytCount + 3);
+  if ( Lo(uintTemp) != arybytMbMasterBuffer[bytCount + 3]
+    || Hi(uintTemp) != arybytMbMasterBuffer[bytCount + 4] ) {
+    return POLL_BAD_RESPONSE;
+  }
+  if ( arybytMbMasterBuffer[1] & EXCEPTION_FLAG ) {
+    return arybytMbMasterBuffer[2];
+  }
+// Refresh the cache as a whole, the upstream side never sees registers from
+// two different responses, such as the halves of a float
+  MB_DISABLE_INTERRUPTS();
+  if ( pPoll->eFunction == READ_HOLDING_REGISTERS
+    || pPoll->eFunction == READ_INPUT_REGISTERS ) {
+    for( uintIndex=0; uintIndex<pPoll->uintTotal; uintIndex++ ) {
+      Hi(uintTemp) = arybytMbMasterBuffer[3 + 2 * uintIndex];
+      Lo(uintTemp) = arybytMbMasterBuffer[4 + 2 * uintIndex];
+      ((uint*)pPoll->paryData)[uintIndex] = uintTemp;
+    }
+  } else {
+    for( uintIndex=0; uintIndex<bytCount; uintIndex++ ) {
+      ((byte*)pPoll->paryData)[uintIndex] = arybytMbMasterBuffer[3 + uintIndex];
+    }
+  }
+  MB_ENABLE_INTERRUPTS();
+  return NO_EXCEPTION;
+}
+/**
+ * Function:
+ *  masterDone
+ *
+ * Parameters:
+ *  bytStatus, the result of the attempt
+ *
+ * Remarks: repeats the request after a lost or corrupted response, an
+ *          exception is a valid answer
+ */
+static void masterDone(byte bytStatus) {
+  if ( (bytStatus == POLL_TIMEOUT || bytStatus == POLL_BAD_RESPONSE)
+    && ++bytMasterRetry < MAX_RETRIES ) {
+    masterRequest(pActivePoll);
+    return;
+  }
+  pActivePoll->bytStatus = bytStatus;
+  if ( bytStatus == NO_EXCEPTION ) {
+    MB_DISABLE_INTERRUPTS();
+    pActivePoll->uintAge = 0;
+    MB_ENABLE_INTERRUPTS();
+  }
+  bytMasterState = MASTER_IDLE;
+}
+/**
+ * Function:
+ *  pollDue
+ *
+ * Parameters:
+ *  pPoll, the poll to check
+ *
+ * Returns:
+ *  TRUE if the countdown has reached 0
+ *
+ * Remarks: modbusMasterTick changes the countdown, it is read with the
+ *          interrupt masked so a borrow between the bytes is never seen
+ */
+static boolean pollDue(modbusPollDef* pPoll) {
+  uint uintCountdown;
+
+  MB_DISABLE_INTERRUPTS();
+  uintCountdown = pPoll->uintCountdown;
+  MB_ENABLE_INTERRUPTS();
+  return uintCountdown == 0;
+}
+/**
+ * Function:
+ *  serviceModbusMaster
+ *
+ * Parameters:
+ *  none
+ *
+ * Returns:
+ *  none
+ *
+ * Remarks: never blocks, call every ms or so.  Advances the transaction in
+ *          progress by one step when the port has finished its transfer or
+ *          timed out, otherwise starts the next poll that is due.
+ */
+void serviceModbusMaster(void) {
+  modbusPollDef* pPoll;
+  byte bytPort, bytStatus;
+
+  if ( bytMasterState == MASTER_IDLE ) {
+    if ( pPolls == NULL ) {
+      return;
+    }
+    if ( pNextPoll == NULL ) {
+      pNextPoll = pPolls;
+    }
+// Find the next poll that is due
+    pPoll = pNextPoll;
+    while( !pollDue(pPoll) ) {
+      pPoll = pPoll->pNext;
+      if ( pPoll == NULL ) {
+        pPoll = pPolls;
+      }
+      if ( pPoll == pNextPoll ) {
+// Nothing due
+        return;
+      }
+    }
+    pNextPoll = pPoll->pNext;
+    MB_DISABLE_INTERRUPTS();
+    pPoll->uintCountdown = pPoll->uintPeriod;
+    MB_ENABLE_INTERRUPTS();
+    pActivePoll = pPoll;
+    bytMasterRetry = 0;
+    masterRequest(pPoll);
+    return;
+  }
+  bytPort = mbMasterPortStatus();
+
+  if ( bytPort == PORT_BUSY ) {
+    if ( bytMasterState == MASTER_SEND || bytMasterWait > 0 ) {
+      return;
+    }
+// Timed out, after a bad response the line has gone quiet
+    mbMasterPortStop();
+    masterDone(bytMasterState == MASTER_FLUSH ? POLL_BAD_RESPONSE
+                                              : POLL_TIMEOUT);
+    return;
+  }
+  switch( bytMasterState ) {
+  case MASTER_SEND:
+// Address, function and byte count or exception code
+    masterRead(arybytMbMasterBuffer, 3, uintMbMasterTimeout);
+    bytMasterState = MASTER_HEADER;
+    break;
+  case MASTER_HEADER:
+    if ( bytPort == PORT_ERROR || !masterHeader(pActivePoll) ) {
+      masterFlush();
+      break;
+    }
+// Data and CRC
+    masterRead(&arybytMbMasterBuffer[3], bytMasterCount + 2,
+               uintMbMasterTimeout);
+    bytMasterState = MASTER_DATA;
+    break;
+  case MASTER_DATA:
+    if ( bytPort == PORT_ERROR ) {
+      masterFlush();
+      break;
+    }
+    bytStatus = masterResponse(pActivePoll);
+    if ( bytStatus == POLL_BAD_RESPONSE ) {
+      masterFlush();
+    } else {
+      masterDone(bytStatus);
+    }
+    break;
+  case MASTER_FLUSH:
+// Something went by, wait for the line to go quiet
+    masterRead(arybytMbMasterBuffer, 1, MASTER_TICK_MS);
+    break;
+  }
+}
+#endif
@@ -7,9 +7,21 @@
  *
  * Functions:
  *  coilState         Sets the state of a coil
- *  decodePacket      Decodes a packet received from modbus master
+ *  decodePacket      Both halves of the interrupt, for a single vector
+ *  diagnostics       Performs an FC08 diagnostics sub-function
+ *  addressException  Sets ILLEGAL_DATA_ADDRESS unless a block was busy
+ *  awaitFrame        Returns to reception when no response is sent
+ *  cacheBlock        Notes a block the read being answered uses
+ *  cachedResponse    Finds the cached response to a repeated read
+ *  cacheResponse     Keeps the response to a read in the cache
+ *  findBlock         Finds the block that contains an address
+ *  modbusBlockChanged Announces a change to the data of a block
+ *  modbusFrameIsr    Decodes a received frame, low priority interrupt
+ *  modbusRxIsr       Receives, times and transmits, high priority interrupt
  *  packBits          Packs bits into a message buffer
  *  packRegisters     Packs registers into a message buffer
+ *  recordLatency     Adds the request turnaround time to the histogram
+ *  sendResponse      Starts the transmission of a response
  *  setRegister       Sets the value of a holding register
  *
  * History:
@@ -53,13 +65,269 @@
  *              startTimeout
  *              restartRx
  *  21/07/2012 Implementing packet timeouts
+ *  18/10/2026 Accept broadcast (address 0) write requests, these are executed
+ *             but never answered, broadcast reads are ignored
+ *  18/10/2026 Hardware access through modbusHal.h
+ *             FC05/FC06 responses were one byte too long, FC05 with a value
+ *             other than 0xFF00 or 0x0000 now answers ILLEGAL_DATA_VALUE
+ *  18/10/2026 Implemented FC08 diagnostics counters and the turnaround
+ *             histogram
+ *  18/10/2026 Reads may span adjacent blocks, packBits and packRegisters
+ *             look up the block holding each address instead of the first
+ *             block starting below the request.  Read counts are checked.
+ *  18/10/2026 Blocks flagged blnBusy answer SLAVE_DEVICE_BUSY
+ *  18/10/2026 Read responses are cached, a repeated read of blocks whose
+ *             generation has not changed is answered without packing the
+ *             registers or calculating the CRC.  The response is sent from
+ *             pTxFrame, the buffer or a cache entry.
+ *  18/10/2026 decodePacket split into modbusRxIsr, for the high priority
+ *             vector, and modbusFrameIsr, for the low priority vector
+ *  18/10/2026 FC08 checks the request length, return query data echoes
+ *             the data as received
  */
-#include <built_in.h>
-
 #include "modbus.h"
+// bytReadBlocks when the response to the request will not be cached
+#define READ_NOT_CACHED   0xff
 
 // Pointer to the last block that was addressed
 static modbusBlockDef* pCurrBlock;
+// Diagnostic counters
+modbusDiagDef mbDiag;
+// Turnaround histogram, end of request to first response byte
+uint aryuintMbLatency[MB_LATENCY_BINS];
+// Response cache, the entry replaced next and the hit count
+static modbusCacheDef aryMbCache[MB_CACHE_ENTRIES];
+static byte bytMbCacheNext = 0;
+uint uintMbCacheHits = 0;
+// The read being answered, its start and count and the blocks it uses
+static byte arybytReadRequest[4];
+static modbusBlockDef* aryReadBlocks[MB_CACHE_BLOCKS];
+static byte arybytReadGeneration[MB_CACHE_BLOCKS];
+static byte bytReadBlocks = READ_NOT_CACHED;
+// The frame being transmitted
+static byte* pTxFrame = arybytMbBuffer;
+/**
+ * Function:
+ *  modbusBlockChanged
+ *
+ * Parameters:
+ *  pBlock, the block whose data or blnBusy flag has been changed
+ *
+ * Returns:
+ *  none
+ *
+ * Remarks: call after the change.  The first call makes reads of the block
+ *          cacheable, from then on every change must be announced.  When
+ *          the generation wraps the cache is emptied before the block can
+ *          reach the generation an old entry recorded.
+ */
+void modbusBlockChanged(modbusBlockDef* pBlock) {
+  byte i;
+
+  if ( pBlock->bytGeneration == 0xff ) {
+    for( i=0; i<MB_CACHE_ENTRIES; i++ ) {
+      aryMbCache[i].bytLength = 0;
+    }
+    pBlock->bytGeneration = 1;
+  } else {
+    pBlock->bytGeneration++;
+  }
+}
+/**
+ * Function:
+ *  cacheBlock
+ *
+ * Parameters:
+ *  pNode, a block the read being answered takes data from
+ *
+ * Returns:
+ *  none
+ */
+static void cacheBlock(modbusBlockDef* pNode) {
+  if ( bytReadBlocks >= MB_CACHE_BLOCKS || pNode->bytGeneration == 0 ) {
+// Not a cached read, too many blocks or changes that are not announced
+    bytReadBlocks = READ_NOT_CACHED;
+    return;
+  }
+  aryReadBlocks[bytReadBlocks] = pNode;
+  arybytReadGeneration[bytReadBlocks++] = pNode->bytGeneration;
+}
+/**
+ * Function:
+ *  cachedResponse
+ *
+ * Parameters:
+ *  none, the request is in the buffer
+ *
+ * Returns:
+ *  The cache entry holding the response, NULL if there isn't one
+ *
+ * Remarks: an entry for the request whose blocks have changed is freed
+ */
+static modbusCacheDef* cachedResponse(void) {
+  modbusCacheDef* pEntry;
+  byte i, j;
+
+  for( i=0; i<MB_CACHE_ENTRIES; i++ ) {
+    pEntry = &aryMbCache[i];
+
+    if ( pEntry->bytLength == 0
+      || pEntry->arybytFrame[0] != arybytMbBuffer[0]
+      || pEntry->arybytFrame[1] != arybytMbBuffer[1]
+      || memcmp(pEntry->arybytRequest, &arybytMbBuffer[2], 4) != 0 ) {
+      continue;
+    }
+    for( j=0; j<pEntry->bytBlocks; j++ ) {
+      if ( pEntry->aryBlocks[j]->bytGeneration
+        != pEntry->arybytGeneration[j] ) {
+        pEntry->bytLength = 0;
+        return NULL;
+      }
+    }
+    return pEntry;
+  }
+  return NULL;
+}
+/**
+ * Function:
+ *  cacheResponse
+ *
+ * Parameters:
+ *  none, the response and its CRC are in the buffer
+ *
+ * Returns:
+ *  none
+ *
+ * Remarks: only whole read responses from announced blocks are kept, an
+ *          unused entry is taken first, then the oldest
+ */
+static void cacheResponse(void) {
+  modbusCacheDef* pEntry;
+  byte i;
+
+  if ( bytReadBlocks == 0 || bytReadBlocks > MB_CACHE_BLOCKS
+    || bytMbIndex > MB_CACHE_LENGTH
+    || (arybytMbBuffer[1] & EXCEPTION_FLAG) ) {
+    return;
+  }
+  pEntry = &aryMbCache[bytMbCacheNext];
+
+  for( i=0; i<MB_CACHE_ENTRIES; i++ ) {
+    if ( aryMbCache[i].bytLength == 0 ) {
+      pEntry = &aryMbCache[i];
+      break;
+    }
+  }
+  if ( pEntry == &aryMbCache[bytMbCacheNext]
+    && ++bytMbCacheNext >= MB_CACHE_ENTRIES ) {
+    bytMbCacheNext = 0;
+  }
+  memcpy(pEntry->arybytRequest, arybytReadRequest, 4);
+  memcpy(pEntry->aryBlocks, aryReadBlocks, sizeof(aryReadBlocks));
+  memcpy(pEntry->arybytGeneration, arybytReadGeneration,
+         sizeof(arybytReadGeneration));
+  pEntry->bytBlocks = bytReadBlocks;
+  memcpy(pEntry->arybytFrame, arybytMbBuffer, bytMbIndex);
+  pEntry->bytLength = bytMbIndex;
+}
+/**
+ * Function:
+ *  diagnostics
+ *
+ * Parameters:
+ *  bytLength, the request length without the CRC, the sub-function and
+ *  data are in the buffer
+ *
+ * Returns:
+ *  NO_EXCEPTION if the response data is in the buffer, or the exception
+ *
+ * Remarks: the response echoes the sub-function, the data is replaced by the
+ *          counter value where there is one.  The response is as long as
+ *          the request.
+ */
+static mbException diagnostics(byte bytLength) {
+  uint uintValue;
+
+  if ( bytLength < 4 ) {
+    return ILLEGAL_DATA_VALUE;
+  }
+  if ( arybytMbBuffer[2] != 0 ) {
+    return ILLEGAL_FUNCTION;
+  }
+// Return query data echoes whatever data came with it
+  if ( arybytMbBuffer[3] == DIAG_RETURN_QUERY_DATA ) {
+    return NO_EXCEPTION;
+  }
+// All other sub-functions take exactly 0x0000 as data
+  if ( bytLength != 6 ) {
+    return ILLEGAL_DATA_VALUE;
+  }
+  if ( arybytMbBuffer[4] != 0 || arybytMbBuffer[5] != 0 ) {
+    return ILLEGAL_DATA_VALUE;
+  }
+  switch( arybytMbBuffer[3] ) {
+  case DIAG_CLEAR_COUNTERS:
+    memset(&mbDiag, 0, sizeof(mbDiag));
+    memset(aryuintMbLatency, 0, sizeof(aryuintMbLatency));
+    return NO_EXCEPTION;
+  case DIAG_BUS_MESSAGE_COUNT:
+    uintValue = mbDiag.uintBusMessages;
+    break;
+  case DIAG_BUS_ERROR_COUNT:
+    uintValue = mbDiag.uintCommErrors;
+    break;
+  case DIAG_EXCEPTION_COUNT:
+    uintValue = mbDiag.uintExceptions;
+    break;
+  case DIAG_SLAVE_MESSAGE_COUNT:
+    uintValue = mbDiag.uintSlaveMessages;
+    break;
+  case DIAG_NO_RESPONSE_COUNT:
+    uintValue = mbDiag.uintNoResponses;
+    break;
+  case DIAG_OVERRUN_COUNT:
+    uintValue = mbDiag.uintOverruns;
+    break;
+  default:
+    return ILLEGAL_FUNCTION;
+  }
+  arybytMbBuffer[4] = Hi(uintValue);
+  arybytMbBuffer[5] = Lo(uintValue);
+  return NO_EXCEPTION;
+}
+/**
+ * Function:
+ *  recordLatency
+ *
+ * Parameters:
+ *  none
+ *
+ * Returns:
+ *  none
+ *
+ * Remarks: called with Timer0 stopped, it has been counting since the end
+ *          of the request was detected.  Bin 0 is below 64 instruction
+ *          cycles, each bin after that doubles, the last bin takes the rest.
+ */
+static void recordLatency(void) {
+  uint uintTicks;
+  byte bytBin;
+
+  MB_TIMER_READ(uintTicks);
+// Each prescaler step doubles the length of a tick
+  bytBin = bytMbTimerShift;
+  uintTicks >>= 6;
+  while( uintTicks > 0 ) {
+    uintTicks >>= 1;
+    bytBin++;
+  }
+  if ( bytBin >= MB_LATENCY_BINS ) {
+    bytBin = MB_LATENCY_BINS - 1;
+  }
+  if ( aryuintMbLatency[bytBin] < 0xffff ) {
+    aryuintMbLatency[bytBin]++;
+  }
+}
 /**
  * Function:
  *  coilState
@@ -72,6 +340,10 @@ static modbusBlockDef* pCurrBlock;
  *  TRUE if block modified, FALSE if not
  */
 static boolean coilState(uint uintAddress, boolean blnState) {
+  if ( pCurrBlock != NULL && pCurrBlock->blnBusy ) {
+    eMbExceptionCode = SLAVE_DEVICE_BUSY;
+    return FALSE;
+  }
   if ( pCurrBlock != NULL ) {
 // Get byte and bit from address
     byte bytIndex, bytBit;
@@ -88,10 +360,47 @@ static boolean coilState(uint uintAddress, boolean blnState) {
       ((byte*)pCurrBlock->paryData)[bytIndex] &= (0xff ^ bytBit);
     }
     pCurrBlock->blnUpdate = TRUE;
+
+    if ( pCurrBlock->bytGeneration != 0 ) {
+      modbusBlockChanged(pCurrBlock);
+    }
     return TRUE;
   }
   return FALSE;
 }
+/**
+ * Function:
+ *  addressException
+ *
+ * Remarks: called when a block could not be read or written, a busy block
+ *          has already set SLAVE_DEVICE_BUSY
+ */
+static void addressException(void) {
+  if ( eMbExceptionCode == NO_EXCEPTION ) {
+    eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
+  }
+}
+/**
+ * Function:
+ *  findBlock
+ *
+ * Parameters:
+ *  pNode, the first block of the list to search
+ *  uintAddress, the address to look for
+ *
+ * Returns:
+ *  The block containing the address or NULL if there isn't one
+ */
+static modbusBlockDef* findBlock(modbusBlockDef* pNode, uint uintAddress) {
+  while( pNode != NULL ) {
+    if ( uintAddress >= pNode->uintAddress
+      && uintAddress <= (pNode->uintAddress + pNode->uintTotal - 1) ) {
+      break;
+    }
+    pNode = pNode->pNext;
+  }
+  return pNode;
+}
 /**
  * Function:
  *  packBits
@@ -103,63 +412,75 @@ static boolean coilState(uint uintAddress, boolean blnState) {
  *  uintEnd, the end address
  *
  * Returns:
- *  The number of bytes the bits were packed into
+ *  The number of bytes the bits were packed into, 0 if any address in the
+ *  range does not exist or its block is busy
+ *
+ * Remarks: the range may span several adjacent blocks
  */
 static uint packBits(mbType eType, byte* pBuffer,
                      uint uintStart, uint uintEnd) {
-// Find the first I/O point
+  modbusBlockDef* pList;
   modbusBlockDef* pNode;
-  uint uintBytes = 0;
+  uint uintBytes = 0, uintOffset, uintLast;
+  byte bytIndex, bytBit, bytOutBit;
 
   if ( eType == COILS ) {
-    pNode = pCoils;
+    pList = pCoils;
   } else if( eType == STATUS_INPUTS ) {
-    pNode = pStatusBits;
+    pList = pStatusBits;
   } else {
     return 0;
   }
-  while( pNode != NULL ) {
-    if ( uintStart >= pNode->uintAddress ) {
-      break;
+// The bit of response bit field
+  bytOutBit = 1;
+// Clear first byte of response bit field
+  *pBuffer = 0;
+  while( uintStart <= uintEnd ) {
+// Find the block holding the next address, a gap is an exception
+    pNode = findBlock(pList, uintStart);
+    if ( pNode == NULL ) {
+      return 0;
+    }
+    if ( pNode->blnBusy ) {
+      eMbExceptionCode = SLAVE_DEVICE_BUSY;
+      return 0;
+    }
+    cacheBlock(pNode);
+    uintLast = pNode->uintAddress + pNode->uintTotal - 1;
+    if ( uintLast > uintEnd ) {
+      uintLast = uintEnd;
     }
-    pNode = pNode->pNext;
-  }
-  if ( pNode != NULL && uintEnd < pNode->uintAddress + pNode->uintTotal ) {
-    uint uintOffset;
-    byte bytIndex;
 // Work out the address offset
     uintOffset = uintStart - pNode->uintAddress;
 // The index into the data array
     bytIndex = uintOffset / 8;
 // The bit in the data
-    Hi(uintOffset) = 1 << (Lo(uintOffset) & 7);
-// The bit of response bit field
-    Lo(uintOffset) = 1;
-// Clear first byte of response bit field
-    *pBuffer = 0;
-    while( uintStart <= uintEnd ) {
-      if ( Lo(uintOffset).B0 ) {
+    bytBit = 1 << (Lo(uintOffset) & 7);
+    while( uintStart <= uintLast ) {
+      if ( bytOutBit & 0x01 ) {
         uintBytes++;
       }
 // State
-      if ( (((byte*)pNode->paryData)[bytIndex] & Hi(uintOffset)) ) {
-        *pBuffer |= Lo(uintOffset);
+      if ( (((byte*)pNode->paryData)[bytIndex] & bytBit) ) {
+        *pBuffer |= bytOutBit;
       }
-      Hi(uintOffset) <<= 1;
-      
-      if ( Hi(uintOffset) == 0 ) {
-        Hi(uintOffset) = 1;
+      bytBit <<= 1;
+
+      if ( bytBit == 0 ) {
+        bytBit = 1;
         bytIndex++;
       }
-      Lo(uintOffset) <<= 1;
-      
-      if ( Lo(uintOffset) == 0 ) {
-        Lo(uintOffset) = 1;
+      bytOutBit <<= 1;
+
+      if ( bytOutBit == 0 ) {
+        bytOutBit = 1;
         pBuffer++;
         *pBuffer = 0;
       }
-// Next address
-      uintStart++;
+// Next address, stop if it wrapped past 0xffff
+      if ( ++uintStart == 0 ) {
+        return uintBytes;
+      }
     }
   }
   return uintBytes;
@@ -175,37 +496,49 @@ static uint packBits(mbType eType, byte* pBuffer,
  *  uintEnd, the end address
  *
  * Returns:
- *  The number of bytes the registers were packed into
+ *  The number of bytes the registers were packed into, 0 if any address in
+ *  the range does not exist or its block is busy
+ *
+ * Remarks: the range may span several adjacent blocks
  */
 static uint packRegisters(mbType eType, byte* pBuffer,
                           uint uintStart, uint uintEnd) {
-// Find the first I/O point
+  modbusBlockDef* pList;
   modbusBlockDef* pNode;
-  uint uintBytes = 0;
+  uint uintBytes = 0, uintOffset, uintLast;
 
   if ( eType == HOLDING_REGISTERS ) {
-    pNode = pHoldingRegs;
+    pList = pHoldingRegs;
   } else if( eType == INPUT_REGISTERS ) {
-    pNode = pInputRegs;
+    pList = pInputRegs;
   } else {
     return 0;
   }
-  while( pNode != NULL ) {
-    if ( uintStart >= pNode->uintAddress ) {
-      break;
+  while( uintStart <= uintEnd ) {
+// Find the block holding the next address, a gap is an exception
+    pNode = findBlock(pList, uintStart);
+    if ( pNode == NULL ) {
+      return 0;
+    }
+    if ( pNode->blnBusy ) {
+      eMbExceptionCode = SLAVE_DEVICE_BUSY;
+      return 0;
+    }
+    cacheBlock(pNode);
+    uintLast = pNode->uintAddress + pNode->uintTotal - 1;
+    if ( uintLast > uintEnd ) {
+      uintLast = uintEnd;
     }
-    pNode = pNode->pNext;
-  }
-  if ( pNode != NULL && uintEnd < (pNode->uintAddress + pNode->uintTotal) ) {
-    uint uintOffset;
     uintOffset = uintStart - pNode->uintAddress;
-    while( uintStart <= uintEnd ) {
+    while( uintStart <= uintLast ) {
       pBuffer[uintBytes++] = Hi(((uint*)pNode->paryData)[uintOffset]);
       pBuffer[uintBytes++] = Lo(((uint*)pNode->paryData)[uintOffset]);
-// Next address
-      uintStart++;
+// Next address, stop if it wrapped past 0xffff
       uintOffset++;
-     }
+      if ( ++uintStart == 0 ) {
+        return uintBytes;
+      }
+    }
   }
   return uintBytes;
 }
@@ -222,6 +555,10 @@ static uint packRegisters(mbType eType, byte* pBuffer,
  *  TRUE if block modified, FALSE if not
  */
 static boolean setRegister(uint uintAddress, byte bytDataHi, byte bytDataLo) {
+  if ( pCurrBlock != NULL && pCurrBlock->blnBusy ) {
+    eMbExceptionCode = SLAVE_DEVICE_BUSY;
+    return FALSE;
+  }
   if ( pCurrBlock != NULL ) {
     uint uintTemp, uintOffset;
     Lo(uintTemp) = bytDataLo;
@@ -229,48 +566,124 @@ static boolean setRegister(uint uintAddress, byte bytDataHi, byte bytDataLo) {
     uintOffset = uintAddress - pCurrBlock->uintAddress;
     ((uint*)pCurrBlock->paryData)[uintOffset] = uintTemp;
     pCurrBlock->blnUpdate = TRUE;
+
+    if ( pCurrBlock->bytGeneration != 0 ) {
+      modbusBlockChanged(pCurrBlock);
+    }
     return TRUE;
   }
   return FALSE;
 }
 /**
  * Function:
- *  decodePacket
+ *  awaitFrame
  *
  * Parameters:
  *  none
  *
  * Returns:
  *  none
+ *
+ * Remarks: a decoded frame needs no response, reception carries on with
+ *          the bytes waiting in the FIFO
  */
-#pragma funcall decodePacket dummy
-
-void decodePacket(void) {
-  if ( TMR0IF_bit ) {
-    bytMbRxphase.B0 = 1;
-    TMR0ON_bit = 0;
+static void awaitFrame(void) {
+  MB_TIMER_RUN(0);
+  bytMbIndex = 0;
+  bytMbRxphase = 1;
+  MB_RX_INT_ENABLE(1);
+}
+/**
+ * Function:
+ *  sendResponse
+ *
+ * Parameters:
+ *  pFrame, the response, the buffer or a cached frame
+ *  bytLength, the length of the response including the CRC
+ *
+ * Returns:
+ *  none
+ *
+ * Remarks: sends the address and function code, the transmit interrupt
+ *          sends the rest from pTxFrame
+ */
+static void sendResponse(byte* pFrame, byte bytLength) {
+// Wait for end of last trasmission or silent interval
+  while( (bytMbRxphase & RXPHASE_TIMEOUT) == 0 ) ;
+// Stop receiving
+  MB_RX_ENABLE(0);
+  MB_RX_INT_ENABLE(0);
+// Enable transmission, set direction
+  MB_TX_ENABLE(1);
+  //Tx_dir = 1;
+// Stop the turnaround timer before the phase tells modbusRxIsr a timeout
+// ends the transmission
+  MB_TIMER_RUN(0);
+  recordLatency();
+// Mark start of transmission
+  bytMbRxphase = RXPHASE_TX;
+  pTxFrame = pFrame;
+// Send address
+  MB_TX_WRITE(pFrame[0]);
+// Store length and set index
+  arybytMbBuffer[0] = bytLength;
+// Send function code to fill Tx buffer and avoid instant return to ISR
+  while( !MB_TX_READY ){}
+  MB_TX_WRITE(pFrame[1]);
+// Enable Tx interrupts for remainder of response to follow
+  bytMbIndex = 2;
+  MB_TX_INT_ENABLE(1);
+}
+/**
+ * Function:
+ *  modbusRxIsr
+ *
+ * Parameters:
+ *  none
+ *
+ * Returns:
+ *  none
+ *
+ * Remarks: the high priority half, stores received bytes, times the gaps and
+ *          feeds the transmitter.  A frame for this slave is handed to
+ *          modbusFrameIsr, frames for other slaves are dropped here so bus
+ *          traffic never waits for the low priority vector.
+ */
+void modbusRxIsr(void) {
+  if ( MB_TIMER_EXPIRED ) {
+    bytMbRxphase |= RXPHASE_TIMEOUT;
+    MB_TIMER_RUN(0);
 // Clear the interrupt mask
-    TMR0IF_bit = 0;
+    MB_TIMER_CLEAR();
 
-    if ( bytMbRxphase.B7 ) {
+    if ( bytMbRxphase & RXPHASE_TX ) {
 // Last byte sent, restart reception & set silent interval
       restartRx();
       return;
     }
   }
-  if( RCIF_bit ) {
+  if ( bytMbRxphase & RXPHASE_DECODE ) {
+// Nothing to receive or send until modbusFrameIsr has finished
+    return;
+  }
+  if( MB_RX_READY ) {
     byte bytTemp;
 // Overrun or framing error?
-    if ( OERR_bit || FERR_bit ) {
+    if ( MB_RX_ERROR ) {
+      if ( MB_RX_OVERRUN ) {
+        mbDiag.uintOverruns++;
+      } else {
+        mbDiag.uintCommErrors++;
+      }
       restartRx();
       return;
     }
 // May need to store RX9D_bit here for parity check!
 // Read received byte
-    bytTemp = RCREG;
+    bytTemp = MB_RX_READ();
 // Silent interval or inter-char interval passed?
 // If passed, is there enough space in buffer?
-    if ( bytMbRxphase == 0 || bytMbRxphase.B2 == 1 ||
+    if ( bytMbRxphase == 0 || (bytMbRxphase & RXPHASE_FRAME) ||
          bytMbIndex >= MAX_PACKET_LENGTH ) {
 // No, wait for end of current message
       bytMbIndex = 0;
@@ -286,15 +699,15 @@ void decodePacket(void) {
     arybytMbBuffer[bytMbIndex++] = bytTemp;
 // Set inter-char interval
     startTimeout();  // 2.5 chars
-  } else if ( bytMbRxphase.B7 ) {
-    if ( TXIF_bit ) {
+  } else if ( bytMbRxphase & RXPHASE_TX ) {
+    if ( MB_TX_READY ) {
       if ( bytMbIndex < arybytMbBuffer[0] ) {
-        TXREG = arybytMbBuffer[bytMbIndex++];
+        MB_TX_WRITE(pTxFrame[bytMbIndex++]);
       } else {
 // Wait for last byte to be transmitted
         startTimeout();  // 1 char
 // Disable Tx interrupts
-        TXIE_bit = 0;
+        MB_TX_INT_ENABLE(0);
       }
       return;
     }
@@ -308,235 +721,333 @@ void decodePacket(void) {
 // Nothing more to do
     return;
   }
-  if ( bytMbSlaveAddress == arybytMbBuffer[0] && bytMbIndex > 3 ) {
+// End of frame, time the turnaround with Timer0
+  MB_TIMER_ZERO();
+  MB_TIMER_RUN(1);
+  mbDiag.uintBusMessages++;
+  if ( ( bytMbSlaveAddress == arybytMbBuffer[0]
+      || MODBUS_BROADCAST == arybytMbBuffer[0] ) && bytMbIndex > 3 ) {
+// For this slave, the rest waits in the FIFO until it has been decoded
+    MB_RX_INT_ENABLE(0);
+    bytMbRxphase |= RXPHASE_DECODE;
+    MB_FRAME_REQUEST();
+    return;
+  }
+// No need to answer (not our address or too short, await next one)
+  MB_TIMER_RUN(0);
+  bytMbIndex = 0;
+  bytMbRxphase = 1;
+}
+/**
+ * Function:
+ *  modbusFrameIsr
+ *
+ * Parameters:
+ *  none
+ *
+ * Returns:
+ *  none
+ *
+ * Remarks: the low priority half, checks the CRC of a frame handed over by
+ *          modbusRxIsr, carries out the request and starts the response
+ */
+void modbusFrameIsr(void) {
+  if ( (bytMbRxphase & RXPHASE_DECODE) == 0 ) {
+    return;
+  }
+  MB_FRAME_CLEAR();
 // Make sure write block is not set
-    pCurrBlock = NULL;
+  pCurrBlock = NULL;
 // Calculate the packet CRC
-    bytMbIndex -= 2;
-    uintCRC = calcCRC();
+  bytMbIndex -= 2;
+  uintCRC = calcCRC();
 // Compare the calculate checksum with the received checksum
-    if ( Lo(uintCRC) == arybytMbBuffer[bytMbIndex] &&
-         Hi(uintCRC) == arybytMbBuffer[bytMbIndex + 1] ) {
+  if ( Lo(uintCRC) == arybytMbBuffer[bytMbIndex] &&
+       Hi(uintCRC) == arybytMbBuffer[bytMbIndex + 1] ) {
+    modbusCacheDef* pEntry;
+    byte bytRequestLength = bytMbIndex;
+    mbDiag.uintSlaveMessages++;
+// A repeated read of blocks that have not changed is answered from the cache
+    bytReadBlocks = READ_NOT_CACHED;
+
+    if ( bytMbIndex == 6 && arybytMbBuffer[0] != MODBUS_BROADCAST
+      && arybytMbBuffer[1] >= READ_COILS
+      && arybytMbBuffer[1] <= READ_INPUT_REGISTERS ) {
+      pEntry = cachedResponse();
+
+      if ( pEntry != NULL ) {
+        uintMbCacheHits++;
+        sendResponse(pEntry->arybytFrame, pEntry->bytLength);
+        return;
+      }
+// The response overwrites the request, keep what the entry is found by
+      memcpy(arybytReadRequest, &arybytMbBuffer[2], 4);
+      bytReadBlocks = 0;
+    }
 // Set the default placement of the CRC
-      bytMbIndex = 3;
-// Is the function supported?
+    bytMbIndex = 3;
+// Only write functions may be broadcast
+    if ( arybytMbBuffer[0] == MODBUS_BROADCAST ) {
       switch( arybytMbBuffer[1] ) {
-      case READ_COILS:
       case FORCE_SINGLE_COIL:
+      case PRESET_SINGLE_REGISTER:
       case FORCE_MULTIPLE_COILS:
-        if ( pCoils == NULL ) {
-// No coils defined!
-          eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
-        } else {
-          pCurrBlock = pCoils;
-        }
+      case PRESET_MULTIPLE_REGISTERS:
         break;
-      case READ_STATUS_INPUTS:
-        if ( pStatusBits == NULL ) {
+      default:
+// Broadcast read, drop it
+        mbDiag.uintNoResponses++;
+        awaitFrame();
+        return;
+      }
+    }
+// Is the function supported?
+    switch( arybytMbBuffer[1] ) {
+    case READ_COILS:
+    case FORCE_SINGLE_COIL:
+    case FORCE_MULTIPLE_COILS:
+      if ( pCoils == NULL ) {
+// No coils defined!
+        eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
+      } else {
+        pCurrBlock = pCoils;
+      }
+      break;
+    case READ_STATUS_INPUTS:
+      if ( pStatusBits == NULL ) {
 // No status inputs defined!
-          eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
-        } else {
-          pCurrBlock = pStatusBits;
-        }
-        break;
-      case READ_HOLDING_REGISTERS:
-      case PRESET_SINGLE_REGISTER:
-      case PRESET_MULTIPLE_REGISTERS:
-        if ( pHoldingRegs == NULL ) {
+        eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
+      } else {
+        pCurrBlock = pStatusBits;
+      }
+      break;
+    case READ_HOLDING_REGISTERS:
+    case PRESET_SINGLE_REGISTER:
+    case PRESET_MULTIPLE_REGISTERS:
+      if ( pHoldingRegs == NULL ) {
 // No holding registers defined!
-          eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
-        } else {
-          pCurrBlock = pHoldingRegs;
-        }
-        break;
-      case READ_INPUT_REGISTERS:
-        if ( pInputRegs == NULL ) {
+        eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
+      } else {
+        pCurrBlock = pHoldingRegs;
+      }
+      break;
+    case READ_INPUT_REGISTERS:
+      if ( pInputRegs == NULL ) {
 // No input registers defined!
-          eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
-        } else {
-          pCurrBlock = pInputRegs;
-        }
-        break;
-      default:
-// No, function not supported!
-        eMbExceptionCode = ILLEGAL_FUNCTION;
-        break;
+        eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
+      } else {
+        pCurrBlock = pInputRegs;
       }
-      if( eMbExceptionCode == NO_EXCEPTION ) {
-        uint uintSAddr, uintEAddr, uintItemCount;
-        uint uintOffset, uintAddr;
-        boolean blnState;
-        mbType eType;
-        byte bytBit;
+      break;
+    case DIAGNOSTICS:
+      break;
+    default:
+// No, function not supported!
+      eMbExceptionCode = ILLEGAL_FUNCTION;
+      break;
+    }
+    if( eMbExceptionCode == NO_EXCEPTION ) {
+      uint uintSAddr, uintEAddr, uintItemCount;
+      uint uintOffset, uintAddr;
+      boolean blnState;
+      mbType eType;
+      byte bytBit;
 // Get the start address
-        Lo(uintSAddr) = arybytMbBuffer[3];
-        Hi(uintSAddr) = arybytMbBuffer[2];
+      Lo(uintSAddr) = arybytMbBuffer[3];
+      Hi(uintSAddr) = arybytMbBuffer[2];
 
-        if ( arybytMbBuffer[1] == FORCE_SINGLE_COIL
-          || arybytMbBuffer[1] == PRESET_SINGLE_REGISTER ) {
-          uintItemCount = 1;
-        } else {
+      if ( arybytMbBuffer[1] == FORCE_SINGLE_COIL
+        || arybytMbBuffer[1] == PRESET_SINGLE_REGISTER ) {
+        uintItemCount = 1;
+      } else {
 // How many items have been requested?
-          Lo(uintItemCount) = arybytMbBuffer[5];
-          Hi(uintItemCount) = arybytMbBuffer[4];
-        }
+        Lo(uintItemCount) = arybytMbBuffer[5];
+        Hi(uintItemCount) = arybytMbBuffer[4];
+      }
 // Whats the last address?
-        uintEAddr = uintSAddr + uintItemCount;
-        uintSAddr++;
- // Find the I/O block that contains the address
-        while( pCurrBlock != NULL ) {
-          if ( uintSAddr >= pCurrBlock->uintAddress
-            && uintEAddr <= (pCurrBlock->uintAddress +
-                               pCurrBlock->uintTotal - 1)  ) {
-            break;
-          }
-          pCurrBlock = pCurrBlock->pNext;
-        }
+      uintEAddr = uintSAddr + uintItemCount;
+      uintSAddr++;
+// Find the I/O block that contains the address, writes must not span blocks
+      pCurrBlock = findBlock(pCurrBlock, uintSAddr);
+      if ( pCurrBlock != NULL
+        && uintEAddr > (pCurrBlock->uintAddress +
+                          pCurrBlock->uintTotal - 1) ) {
+        pCurrBlock = NULL;
+      }
 // What was the requested function code?
-        switch( arybytMbBuffer[1] ) {
-        case READ_COILS:
-        case READ_STATUS_INPUTS:
-          if ( arybytMbBuffer[1] == READ_COILS ) {
-            eType = COILS;
-          } else {
-            eType = STATUS_INPUTS;
-          }
-          arybytMbBuffer[2] = packBits(eType, &arybytMbBuffer[3], 
-                                       uintSAddr, uintEAddr);
+      switch( arybytMbBuffer[1] ) {
+      case READ_COILS:
+      case READ_STATUS_INPUTS:
+        if ( arybytMbBuffer[1] == READ_COILS ) {
+          eType = COILS;
+        } else {
+          eType = STATUS_INPUTS;
+        }
+        if ( uintItemCount == 0
+          || uintItemCount > MAX_DISCRETES_IN_1_AND_2 ) {
+// Exception, the response would not fit
+          eMbExceptionCode = ILLEGAL_DATA_VALUE;
+          break;
+        }
+        arybytMbBuffer[2] = packBits(eType, &arybytMbBuffer[3], 
+                                     uintSAddr, uintEAddr);
 
-          if ( arybytMbBuffer[2] == 0 ) {
+        if ( arybytMbBuffer[2] == 0 ) {
 // Exception, address does not exist
-            eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
-          } else {
-            bytMbIndex += arybytMbBuffer[2];
-          }
+          addressException();
+        } else {
+          bytMbIndex += arybytMbBuffer[2];
+        }
+        break;
+      case READ_HOLDING_REGISTERS:
+      case READ_INPUT_REGISTERS:
+        if ( arybytMbBuffer[1] == READ_INPUT_REGISTERS ) {
+          eType = INPUT_REGISTERS;
+        } else {
+          eType = HOLDING_REGISTERS;
+        }
+        if ( uintItemCount == 0
+          || uintItemCount > MAX_REGISTERS_IN_3_AND_4 ) {
+// Exception, the response would not fit
+          eMbExceptionCode = ILLEGAL_DATA_VALUE;
           break;
-        case READ_HOLDING_REGISTERS:
-        case READ_INPUT_REGISTERS:
-          if ( arybytMbBuffer[1] == READ_INPUT_REGISTERS ) {
-            eType = INPUT_REGISTERS;
-          } else {
-            eType = HOLDING_REGISTERS;
-          }
-          arybytMbBuffer[2] = packRegisters(eType, &arybytMbBuffer[3],
-                                            uintSAddr, uintEAddr);
-          if ( arybytMbBuffer[2] == 0 ) {
+        }
+        arybytMbBuffer[2] = packRegisters(eType, &arybytMbBuffer[3],
+                                          uintSAddr, uintEAddr);
+        if ( arybytMbBuffer[2] == 0 ) {
 // Exception, address does not exist
-            eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
-          } else {
-            bytMbIndex += arybytMbBuffer[2];
-          }
-          break;
-        case FORCE_SINGLE_COIL:
-          if ( arybytMbBuffer[4] == 0xff && arybytMbBuffer[5] == 0x0 ) {
+          addressException();
+        } else {
+          bytMbIndex += arybytMbBuffer[2];
+        }
+        break;
+      case FORCE_SINGLE_COIL:
+        if ( arybytMbBuffer[4] == 0xff && arybytMbBuffer[5] == 0x0 ) {
 // Force coil on
-            blnState = coilState(uintSAddr, TRUE);
-          } else if ( arybytMbBuffer[4] == 0x0 && arybytMbBuffer[5] == 0x0 ) {
+          blnState = coilState(uintSAddr, TRUE);
+        } else if ( arybytMbBuffer[4] == 0x0 && arybytMbBuffer[5] == 0x0 ) {
 // Force coil off
-            blnState = coilState(uintSAddr, FALSE);
-          }
-          if ( blnState == FALSE ) {
-// Exception, address does not exist
-            eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
-          } else {
-            bytMbIndex += 4;
-          }
+          blnState = coilState(uintSAddr, FALSE);
+        } else {
+// Exception, only 0xFF00 and 0x0000 are valid
+          eMbExceptionCode = ILLEGAL_DATA_VALUE;
           break;
-        case PRESET_SINGLE_REGISTER:
-          if ( setRegister(uintSAddr, arybytMbBuffer[4], 
-                                      arybytMbBuffer[5]) == FALSE ) {
+        }
+        if ( blnState == FALSE ) {
 // Exception, address does not exist
-            eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
-          } else {
-            bytMbIndex += 4;
-          }
-          break;
-        case FORCE_MULTIPLE_COILS:
-          if ( uintItemCount > MAX_DISCRETES_IN_FC15 ||
-               uintItemCount > (arybytMbBuffer[6] * 8) ) {
+          addressException();
+        } else {
+          bytMbIndex += 3;
+        }
+        break;
+      case PRESET_SINGLE_REGISTER:
+        if ( setRegister(uintSAddr, arybytMbBuffer[4], 
+                                    arybytMbBuffer[5]) == FALSE ) {
+// Exception, address does not exist
+          addressException();
+        } else {
+          bytMbIndex += 3;
+        }
+        break;
+      case FORCE_MULTIPLE_COILS:
+        if ( uintItemCount > MAX_DISCRETES_IN_FC15 ||
+             uintItemCount > (arybytMbBuffer[6] * 8) ) {
 // Exception, either to many items or the coil count doesn't match byte count
-            eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
-            break;
-          }
-        case PRESET_MULTIPLE_REGISTERS:
-          if ( (arybytMbBuffer[1] == PRESET_MULTIPLE_REGISTERS &&
-               uintItemCount > MAX_REGISTERS_IN_FC16) ) {
+          eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
+          break;
+        }
+      case PRESET_MULTIPLE_REGISTERS:
+        if ( (arybytMbBuffer[1] == PRESET_MULTIPLE_REGISTERS &&
+             uintItemCount > MAX_REGISTERS_IN_FC16) ) {
 // Exception, either to many items or the coil count doesn't match byte count
-            eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
-          } else {
-            bytBit = 1;
-            uintOffset = 0;
-            uintAddr = uintSAddr;
+          eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
+        } else {
+          bytBit = 1;
+          uintOffset = 0;
+          uintAddr = uintSAddr;
 
-            while( uintAddr <= uintEAddr ) {
-              if ( arybytMbBuffer[1] == PRESET_MULTIPLE_REGISTERS ) {
-                if ( setRegister(uintAddr,
-                                 arybytMbBuffer[7 + uintOffset],
-                                 arybytMbBuffer[8 + uintOffset]) == FALSE ) {
-                  eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
-                  break;
-                }
-                uintOffset += 2;
-                uintAddr++;
-              } else {
-                blnState = FALSE;
-                if ( (arybytMbBuffer[7 + uintOffset] & bytBit) > 0 ) {
-                  blnState = TRUE;
-                }
-                if ( coilState(uintAddr, blnState) == FALSE ) {
-                  eMbExceptionCode = ILLEGAL_DATA_ADDRESS;
-                  break;
-                }
-                bytBit <<= 1;
-                if ( bytBit == 0 ) {
-                  bytBit = 1;
-                  uintOffset++;
-                }
-                uintAddr++;
+          while( uintAddr <= uintEAddr ) {
+            if ( arybytMbBuffer[1] == PRESET_MULTIPLE_REGISTERS ) {
+              if ( setRegister(uintAddr,
+                               arybytMbBuffer[7 + uintOffset],
+                               arybytMbBuffer[8 + uintOffset]) == FALSE ) {
+                addressException();
+                break;
               }
-            }
-            if ( eMbExceptionCode == NO_EXCEPTION ) {
-              bytMbIndex += 3;
+              uintOffset += 2;
+              uintAddr++;
+            } else {
+              blnState = FALSE;
+              if ( (arybytMbBuffer[7 + uintOffset] & bytBit) > 0 ) {
+                blnState = TRUE;
+              }
+              if ( coilState(uintAddr, blnState) == FALSE ) {
+                addressException();
+                break;
+              }
+              bytBit <<= 1;
+              if ( bytBit == 0 ) {
+                bytBit = 1;
+                uintOffset++;
+              }
+              uintAddr++;
             }
           }
-          break;
+          if ( eMbExceptionCode == NO_EXCEPTION ) {
+            bytMbIndex += 3;
+          }
         }
+        break;
+      case DIAGNOSTICS:
+        eMbExceptionCode = diagnostics(bytRequestLength);
+        if ( eMbExceptionCode == NO_EXCEPTION ) {
+          bytMbIndex = bytRequestLength;
+        }
+        break;
       }
-      if( eMbExceptionCode != NO_EXCEPTION ) {
-        arybytMbBuffer[1] |= EXCEPTION_FLAG;
-        arybytMbBuffer[2] = (byte)eMbExceptionCode;
-        eMbExceptionCode = NO_EXCEPTION;
-      }
-      if ( bytMbIndex > 0 ) {
+    }
+    if ( arybytMbBuffer[0] == MODBUS_BROADCAST ) {
+// Broadcasts are never answered, not even with an exception
+      eMbExceptionCode = NO_EXCEPTION;
+      bytMbIndex = 0;
+      mbDiag.uintNoResponses++;
+    }
+    if( eMbExceptionCode != NO_EXCEPTION ) {
+      mbDiag.uintExceptions++;
+      arybytMbBuffer[1] |= EXCEPTION_FLAG;
+      arybytMbBuffer[2] = (byte)eMbExceptionCode;
+      eMbExceptionCode = NO_EXCEPTION;
+    }
+    if ( bytMbIndex > 0 ) {
 // Calculate CRC for response
-        uintCRC = calcCRC();
-        arybytMbBuffer[bytMbIndex++] = Lo(uintCRC);
-        arybytMbBuffer[bytMbIndex++] = Hi(uintCRC);
-// Wait for end of last trasmission or silent interval
-        while( bytMbRxphase.B0 == 0 ) ;
-// Stop receiving
-        CREN_bit = 0;
-        RCIE_bit = 0;
-// Enable transmission, set direction
-        TXEN_bit = 1;
-        //Tx_dir = 1;
-// Mark start of transmission
-        bytMbRxphase = 128;
-// Send address
-        TXREG = arybytMbBuffer[0];
-// Store length and set index
-        arybytMbBuffer[0] = bytMbIndex;
-// Send function code to fill Tx buffer and avoid instant return to ISR
-        while( !TXIF_bit ){}
-        TXREG = arybytMbBuffer[1];
-// Enable Tx interrupts for remainder of response to follow
-        bytMbIndex = 2;
-        TXIE_bit = 1;
-        return;
-      }
+      uintCRC = calcCRC();
+      arybytMbBuffer[bytMbIndex++] = Lo(uintCRC);
+      arybytMbBuffer[bytMbIndex++] = Hi(uintCRC);
+      cacheResponse();
+      sendResponse(arybytMbBuffer, bytMbIndex);
+      return;
     }
+  } else {
+    mbDiag.uintCommErrors++;
   }
-// No need to answer (not our address or message frame error, await next one)
-  bytMbIndex = 0;
-  bytMbRxphase = 1;
-}
\ No newline at end of file
+// No need to answer (message frame error or broadcast, await next one)
+  awaitFrame();
+}
+/**
+ * Function:
+ *  decodePacket
+ *
+ * Parameters:
+ *  none
+ *
+ * Returns:
+ *  none
+ *
+ * Remarks: both halves, for a single interrupt vector and the host build
+ */
+#pragma funcall decodePacket dummy
+
+void decodePacket(void) {
+  modbusRxIsr();
+  modbusFrameIsr();
+}
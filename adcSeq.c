@@ -0,0 +1,263 @@
+/**
+ * File:
+ *  adcSeq.c
+ *
+ * Notes:
+ *  This file contains an interrupt driven sequencer for the PIC internal ADC.
+ * Each call to adcSeqTick starts a pass that converts AN2, AN1 and, when it
+ * is due, AN0.  Every channel is converted 2^n times back to back from ADIF,
+ * the sum is published as the plain 10 bit average and as a decimated value
+ * that keeps n/2 extra bits, left justified to 16 bits.  Nothing waits on the
+ * converter, the main loop only picks up finished results using bytAdcReady.
+ *
+ *  A conversion takes 17 Tad (6 Tad acquisition, 11 Tad conversion) at
+ * Fosc/8, 34us at 4MHz.  A pass with the default oversampling is 96
+ * conversions, well inside the 100ms between passes.
+ *
+ *  adcScale converts a decimated value to engineering units with a Q16 gain
+ * and an offset.  The multiply is made of four 8x8 hardware multiplies, so
+ * the float library is not needed in the periodic path.
+ *
+ * Functions:
+ *  adcLoadCal    Reads the calibration from EEPROM, or sets the defaults
+ *  adcSaveCal    Writes the calibration to EEPROM
+ *  adcScale      Converts a decimated value to engineering units
+ *  adcSeqInit    Configures the ADC and enables its interrupt
+ *  adcSeqIsr     Called from interrupt(), accumulates a finished conversion
+ *  adcSeqTick    Called from interrupt() on the tick, starts a pass
+ *  mulQ16        Multiplies two uints, returns the high 16 bits
+ *  nextChannel   Starts the next channel of the pass
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Fixed point calibration, coefficients in EEPROM
+ *  18/10/2026 Runs from the low priority interrupt
+ *  18/10/2026 The oversampling of a channel is latched when it starts, so
+ *             arybytAdcOversample can be changed at any time
+ */
+#include "adcSeq.h"
+// Published results
+volatile uint aryuintAdcAverage[ADC_CHANNELS];
+volatile uint aryuintAdcDecimated[ADC_CHANNELS];
+byte arybytAdcOversample[ADC_CHANNELS];
+volatile byte bytAdcReady = 0;
+uint aryuintAdcCal[2 * ADC_CHANNELS];
+// Channels still to convert in this pass, a bit per channel
+static volatile byte bytAdcPass = 0;
+// The channel being converted, samples left and their sum
+static byte bytAdcChannel;
+static byte bytAdcSamples;
+static byte bytAdcShift;
+static uint uintAdcSum;
+// Passes since the battery was last read
+static byte bytBattTicks = 0;
+/**
+ * Function:
+ *  nextChannel
+ *
+ * Returns:
+ *  TRUE if a conversion was started, FALSE if the pass is complete
+ *
+ * Remarks: channels are converted highest first
+ */
+static boolean nextChannel(void) {
+  while( bytAdcChannel > 0 ) {
+    bytAdcChannel--;
+
+    if ( bytAdcPass & (1 << bytAdcChannel) ) {
+// CHS, ADON. The acquisition time is added by the ADC so GO can be set now
+      ADCON0 = (bytAdcChannel << 2) | 0x01;
+      uintAdcSum = 0;
+      bytAdcShift = arybytAdcOversample[bytAdcChannel];
+      bytAdcSamples = 1 << bytAdcShift;
+      GO_DONE_bit = 1;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+/**
+ * Function:
+ *  mulQ16
+ *
+ * Parameters:
+ *  uintA, uintB, the values to multiply
+ *
+ * Returns:
+ *  The high 16 bits of the 32 bit product
+ */
+static uint mulQ16(uint uintA, uint uintB) {
+  byte bytAL = uintA, bytAH = uintA >> 8;
+  byte bytBL = uintB, bytBH = uintB >> 8;
+  uint uintHigh, uintMid, uintCross;
+
+  uintHigh = (uint)bytAH * bytBH;
+  uintMid = ((uint)bytAL * bytBL) >> 8;
+// The two cross products can carry into the high word
+  uintCross = (uint)bytAL * bytBH;
+  uintMid += uintCross;
+
+  if ( uintMid < uintCross ) {
+    uintHigh += 0x100;
+  }
+  uintCross = (uint)bytAH * bytBL;
+  uintMid += uintCross;
+
+  if ( uintMid < uintCross ) {
+    uintHigh += 0x100;
+  }
+  return uintHigh + (uintMid >> 8);
+}
+/**
+ * Function:
+ *  adcScale
+ *
+ * Parameters:
+ *  bytChannel, the channel the value was read from
+ *  uintCode, the decimated value, left justified to 16 bits
+ *
+ * Returns:
+ *  gain * uintCode / 65536 + offset, limited to 0..65535
+ */
+uint adcScale(byte bytChannel, uint uintCode) {
+  long lngOut;
+
+  bytChannel <<= 1;
+  lngOut = (long)mulQ16(uintCode, aryuintAdcCal[bytChannel])
+         + (int)aryuintAdcCal[bytChannel + 1];
+
+  if ( lngOut < 0 ) {
+    return 0;
+  }
+  if ( lngOut > 0xFFFF ) {
+    return 0xFFFF;
+  }
+  return (uint)lngOut;
+}
+/**
+ * Function:
+ *  adcLoadCal
+ *
+ * Remarks: an EEPROM without the marker gets the ADC_GAIN_ANx and
+ *          ADC_OFFSET_ANx defaults
+ */
+void adcLoadCal(void) {
+  byte i;
+
+  if ( EEPROM_Read(ADC_EE_CAL) != ADC_EE_MARKER ) {
+    aryuintAdcCal[0] = ADC_GAIN_AN0;
+    aryuintAdcCal[1] = ADC_OFFSET_AN0;
+    aryuintAdcCal[2] = ADC_GAIN_AN1;
+    aryuintAdcCal[3] = ADC_OFFSET_AN1;
+    aryuintAdcCal[4] = ADC_GAIN_AN2;
+    aryuintAdcCal[5] = ADC_OFFSET_AN2;
+    return;
+  }
+  for( i=0; i<2 * ADC_CHANNELS; i++ ) {
+    aryuintAdcCal[i] = ((uint)EEPROM_Read(ADC_EE_CAL + 1 + 2 * i) << 8)
+                     | EEPROM_Read(ADC_EE_CAL + 2 + 2 * i);
+  }
+}
+/**
+ * Function:
+ *  adcSaveCal
+ *
+ * Remarks: each byte takes about 4ms to write, call from the main loop only.
+ *          The marker is written last so a partial write is not used.
+ */
+void adcSaveCal(void) {
+  byte i;
+
+  EEPROM_Write(ADC_EE_CAL, 0xFF);
+
+  for( i=0; i<2 * ADC_CHANNELS; i++ ) {
+    EEPROM_Write(ADC_EE_CAL + 1 + 2 * i, aryuintAdcCal[i] >> 8);
+    EEPROM_Write(ADC_EE_CAL + 2 + 2 * i, aryuintAdcCal[i]);
+  }
+  EEPROM_Write(ADC_EE_CAL, ADC_EE_MARKER);
+}
+/**
+ * Function:
+ *  adcSeqInit
+ *
+ * Remarks: ADCON1 must already select AN0 to AN2 as analogue inputs, the
+ *          interrupt is low priority, delivered once GIEH and GIEL are set
+ */
+void adcSeqInit(void) {
+  arybytAdcOversample[0] = ADC_OS_AN0;
+  arybytAdcOversample[1] = ADC_OS_AN1;
+  arybytAdcOversample[2] = ADC_OS_AN2;
+  adcLoadCal();
+  memset(aryuintAdcAverage, 0, sizeof(aryuintAdcAverage));
+  memset(aryuintAdcDecimated, 0, sizeof(aryuintAdcDecimated));
+  bytAdcReady = 0;
+  bytAdcPass = 0;
+  bytBattTicks = 0;
+  ADC_BATT_CHECK = 0;
+// Right justified, 6 Tad acquisition, Fosc/8
+  ADCON2 = 0x99;
+  ADCON0 = 0x01;
+  ADIF_bit = 0;
+  ADIE_bit = 1;
+}
+/**
+ * Function:
+ *  adcSeqTick
+ *
+ * Remarks: a pass that is still running is left to finish, the tick is lost
+ */
+void adcSeqTick(void) {
+  byte i;
+
+  if ( bytAdcPass != 0 ) {
+    return;
+  }
+  for( i=0; i<ADC_CHANNELS; i++ ) {
+    if ( arybytAdcOversample[i] > ADC_OS_MAX ) {
+      arybytAdcOversample[i] = ADC_OS_MAX;
+    }
+  }
+  bytAdcPass = (1 << 2) | (1 << 1);
+
+  if ( ++bytBattTicks >= ADC_BATT_EVERY ) {
+// The divider has been on for ADC_BATT_SETTLE ticks
+    bytBattTicks = 0;
+    bytAdcPass |= (1 << 0);
+  } else if ( bytBattTicks == ADC_BATT_EVERY - ADC_BATT_SETTLE ) {
+    ADC_BATT_CHECK = 1;
+  }
+  bytAdcChannel = ADC_CHANNELS;
+  nextChannel();
+}
+/**
+ * Function:
+ *  adcSeqIsr
+ *
+ * Remarks: does nothing unless ADIF is set
+ */
+void adcSeqIsr(void) {
+  byte bytShift;
+
+  if ( !ADIF_bit ) {
+    return;
+  }
+  ADIF_bit = 0;
+  uintAdcSum += ((uint)ADRESH << 8) | ADRESL;
+
+  if ( --bytAdcSamples != 0 ) {
+    GO_DONE_bit = 1;
+    return;
+  }
+  bytShift = bytAdcShift;
+  aryuintAdcAverage[bytAdcChannel] = uintAdcSum >> bytShift;
+// Keep half of the added bits, the rest only reduce noise
+  aryuintAdcDecimated[bytAdcChannel] =
+      (uintAdcSum >> (bytShift - (bytShift >> 1))) << (6 - (bytShift >> 1));
+  bytAdcReady |= (1 << bytAdcChannel);
+
+  if ( bytAdcChannel == 0 ) {
+    ADC_BATT_CHECK = 0;
+  }
+  bytAdcPass &= ~(1 << bytAdcChannel);
+  nextChannel();
+}
@@ -0,0 +1,89 @@
+/**
+ * File:
+ *  adcSeq.h
+ *
+ * Notes:
+ *  This file contains the prototypes for the interrupt driven sequencer that
+ * oversamples the PIC internal ADC channels AN0 to AN2.
+ *
+ *  The oversampling of each channel starts at ADC_OS_ANx and can be changed
+ * at run time in arybytAdcOversample, it takes effect from the next pass.
+ * DAQ12 publishes it as holding registers 107..109.
+ *
+ * Usage:
+ *  adcSeqInit();                   // after ADCON1, before interrupts are on
+ *  void interrupt_low() {          // low priority, see modbusHal.h
+ *    adcSeqIsr();                  // ADIF
+ *    if ( CCP1IF_bit ) {           // the 1ms scheduler tick
+ *      CCP1IF_bit = 0;
+ *      schedTick();
+ *      if ( ++bytTicks100 >= 100 ) {
+ *        bytTicks100 = 0;
+ *        adcSeqTick();             // starts a pass every 100ms
+ *      }
+ *    }
+ *  }
+ *  if ( bytAdcReady ) {            // main loop, pick up the averages
+ *    uintMv = adcScale(0, aryuintAdcDecimated[0]);
+ *  }
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Fixed point calibration, coefficients in EEPROM
+ *  18/10/2026 Runs from the low priority interrupt
+ *  18/10/2026 Oversampling set at run time
+ */
+#ifndef ADCSEQ_H
+  #define ADCSEQ_H
+
+  #include "types.h"
+// Number of channels, AN0 up to and including AN2
+  #define ADC_CHANNELS      3
+// Oversampling per channel as log2 of the number of samples, 0 to 6. 4^n
+// samples add n bits, the sum of 64 samples still fits in a uint. These are
+// the values at start up, see arybytAdcOversample.
+  #define ADC_OS_MAX        6
+  #define ADC_OS_AN0        4   // battery, 16 samples
+  #define ADC_OS_AN1        6   // pressure, 64 samples, 13 bits
+  #define ADC_OS_AN2        4   // internal temperature, 16 samples
+// AN0 is read through a divider that is switched on by this output
+  #define ADC_BATT_CHECK    RB6_bit
+// AN0 is included in every ADC_BATT_EVERY passes. The divider is switched
+// on ADC_BATT_SETTLE passes before, replacing the 100ms delay.
+  #define ADC_BATT_EVERY    10
+  #define ADC_BATT_SETTLE   1
+// Calibration, a gain and offset per channel. The gain is Q16 and applies
+// to the 16 bit decimated value, so it is the output for a full scale input.
+// The defaults give the units of funcoes_aux.c at 3.3V full scale:
+//  AN0 battery, divider 1.36, mV
+//  AN1 pressure, 0.1 mbar (1V = 1000 mbar)
+//  AN2 internal temperature, 10mV/C, 0.01 C
+  #define ADC_GAIN_AN0      4488
+  #define ADC_OFFSET_AN0    0
+  #define ADC_GAIN_AN1      33000
+  #define ADC_OFFSET_AN1    0
+  #define ADC_GAIN_AN2      33000
+  #define ADC_OFFSET_AN2    0
+// EEPROM address of the coefficients, a marker byte then gain and offset
+// for each channel, high byte first
+  #define ADC_EE_CAL        0x00
+  #define ADC_EE_MARKER     0xA5
+// Averages, 10 bits like ADC_Read, indexed by channel
+  extern volatile uint aryuintAdcAverage[ADC_CHANNELS];
+// Decimated sums, left justified to 16 bits, indexed by channel
+  extern volatile uint aryuintAdcDecimated[ADC_CHANNELS];
+// Oversampling as log2, initialised from ADC_OS_ANx, may be changed at any
+// time, values above ADC_OS_MAX are limited when the next pass starts
+  extern byte arybytAdcOversample[ADC_CHANNELS];
+// Gain then offset (signed) for each channel, indexed by channel
+  extern uint aryuintAdcCal[2 * ADC_CHANNELS];
+// A bit per channel, set when its average is updated
+  extern volatile byte bytAdcReady;
+
+  void adcLoadCal(void);
+  void adcSaveCal(void);
+  uint adcScale(byte bytChannel, uint uintCode);
+  void adcSeqInit(void);
+  void adcSeqIsr(void);
+  void adcSeqTick(void);
+#endif
@@ -0,0 +1,44 @@
+/**
+ * File:
+ *  arena.h
+ *
+ * Notes:
+ *  This file contains the shared scratch arena.  Tasks are run to completion
+ * one at a time by schedRun, so scratch that only lives for one task run can
+ * share RAM with the scratch of every other task.  Each member of arenaDef
+ * belongs to one task and is only valid during that task's run, nothing is
+ * kept from one run to the next.  The arena is never used from interrupt().
+ *
+ *  Add a member to the struct of the task that needs it, a new task gets a
+ * new struct.  The arena is as large as its largest struct, memmap (host/)
+ * reports it as _arena.
+ *
+ * Usage:
+ *  lngRaw = get_raw_from_buffer(&arena.acq.arybytBurst[4 * i]);
+ *
+ * History:
+ *  18/10/2026 Written
+ */
+#ifndef ARENA_H
+  #define ARENA_H
+
+  #include "types.h"
+  #include "ltcFilter.h"
+  #include "nodeConfig.h"
+// Conversion results read in one SPI burst, 4 bytes per channel
+  #define ARENA_BURST       (4 * FILTER_CHANNELS)
+
+  typedef union _arena {
+// taskAcquisition: the result burst and the median sort in filterApply
+    struct {
+      byte  arybytBurst[ARENA_BURST];
+      long  arylngSort[FILTER_HISTORY + 1];
+    } acq;
+// taskModbus: the candidate words in channelCfgWritten
+    struct {
+      ulong arylngWords[CFG_CHANNELS];
+    } cfg;
+  } arenaDef;
+
+  extern arenaDef arena;
+#endif
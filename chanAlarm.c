@@ -0,0 +1,169 @@
+/**
+ * File:
+ *  chanAlarm.c
+ *
+ * Notes:
+ *  This file contains the per channel alarm limits, see chanAlarm.h.  Values
+ * are checked from the tasks as results arrive, the state is only read by
+ * the tasks, which copy it to the status inputs.
+ *
+ *  An acknowledge clears the latch of an alarm that is no longer active, an
+ * alarm still active stays latched and needs another acknowledge once it has
+ * cleared.
+ *
+ * Functions:
+ *  alarmAck      Clears the latches of alarms that are no longer active
+ *  alarmCheck    Checks a new value of a channel against its limits
+ *  alarmClear    Clears the active state of some channels, not the latch
+ *  alarmLoad     Reads the limits from EEPROM, or sets the defaults
+ *  alarmSave     Writes the limits that changed to EEPROM
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 alarmSave writes a bounded number of bytes per call
+ */
+#include "modbus.h"
+#include "chanAlarm.h"
+// Limits and acknowledge, read and written as holding registers
+int aryintAlarmCfg[ALARM_REGS];
+// A bit per channel
+uint uintAlarmLatched = 0;
+uint uintAlarmHigh = 0;
+uint uintAlarmLow = 0;
+// Next byte of the limits to save, and the CRC of the limits being saved
+static byte bytAlarmSaveAt = 0;
+static uint uintAlarmSaveCRC = 0;
+/**
+ * Function:
+ *  alarmLoad
+ *
+ * Remarks: an EEPROM without the marker gets limits that never trip
+ */
+void alarmLoad(void) {
+  byte i;
+
+  aryintAlarmCfg[ALARM_ACK] = 0;
+
+  if ( EEPROM_Read(ALARM_EE) != ALARM_EE_MARKER ) {
+    for( i=0; i<ALARM_CHANNELS; i++ ) {
+      aryintAlarmCfg[ALARM_HIGH + i] = 32767;
+      aryintAlarmCfg[ALARM_LOW + i] = -32768;
+      aryintAlarmCfg[ALARM_HYST + i] = 0;
+    }
+    return;
+  }
+  for( i=0; i<ALARM_ACK; i++ ) {
+    aryintAlarmCfg[i] = ((uint)EEPROM_Read(ALARM_EE + 1 + 2 * i) << 8)
+                      | EEPROM_Read(ALARM_EE + 2 + 2 * i);
+  }
+}
+/**
+ * Function:
+ *  alarmSave
+ *
+ * Parameters:
+ *  bytWrites, the most bytes to write in this call, at least 2
+ *
+ * Returns:
+ *  TRUE once the save is complete, call again until it is
+ *
+ * Remarks: only bytes that differ are written, each takes about 4ms, call
+ *          from the main loop only.  The marker is cleared before the first
+ *          change and written last so a partial write is not used.  A call
+ *          after the limits changed starts them over.
+ */
+boolean alarmSave(byte bytWrites) {
+  byte bytAddress, bytValue;
+  uint uintCRC;
+
+  uintCRC = calcBufferCRC((byte*)aryintAlarmCfg, 2 * ALARM_ACK);
+  if ( uintCRC != uintAlarmSaveCRC ) {
+    uintAlarmSaveCRC = uintCRC;
+    bytAlarmSaveAt = 0;
+  }
+  for( ; bytAlarmSaveAt<2 * ALARM_ACK; bytAlarmSaveAt++ ) {
+    bytAddress = ALARM_EE + 1 + bytAlarmSaveAt;
+    bytValue = (bytAlarmSaveAt & 1) ? Lo(aryintAlarmCfg[bytAlarmSaveAt >> 1])
+                                    : Hi(aryintAlarmCfg[bytAlarmSaveAt >> 1]);
+
+    if ( EEPROM_Read(bytAddress) != bytValue ) {
+// Room for this byte and the marker
+      if ( bytWrites < 2 ) {
+        return FALSE;
+      }
+      if ( EEPROM_Read(ALARM_EE) != 0xFF ) {
+        bytWrites--;
+        EEPROM_Write(ALARM_EE, 0xFF);
+      }
+      bytWrites--;
+      EEPROM_Write(bytAddress, bytValue);
+    }
+  }
+  if ( EEPROM_Read(ALARM_EE) != ALARM_EE_MARKER ) {
+    if ( bytWrites == 0 ) {
+      return FALSE;
+    }
+    EEPROM_Write(ALARM_EE, ALARM_EE_MARKER);
+  }
+  bytAlarmSaveAt = 0;
+  return TRUE;
+}
+/**
+ * Function:
+ *  alarmCheck
+ *
+ * Parameters:
+ *  bytChannel, the channel index, 0 for LTC2983 channel 3
+ *  intValue, the new value
+ */
+void alarmCheck(byte bytChannel, int intValue) {
+  uint uintMask = 1 << bytChannel;
+  long lngClear;
+
+  if ( uintAlarmHigh & uintMask ) {
+    lngClear = (long)aryintAlarmCfg[ALARM_HIGH + bytChannel]
+             - (uint)aryintAlarmCfg[ALARM_HYST + bytChannel];
+
+    if ( intValue < lngClear ) {
+      uintAlarmHigh &= ~uintMask;
+    }
+  } else if ( intValue > aryintAlarmCfg[ALARM_HIGH + bytChannel] ) {
+    uintAlarmHigh |= uintMask;
+    uintAlarmLatched |= uintMask;
+  }
+  if ( uintAlarmLow & uintMask ) {
+    lngClear = (long)aryintAlarmCfg[ALARM_LOW + bytChannel]
+             + (uint)aryintAlarmCfg[ALARM_HYST + bytChannel];
+
+    if ( intValue > lngClear ) {
+      uintAlarmLow &= ~uintMask;
+    }
+  } else if ( intValue < aryintAlarmCfg[ALARM_LOW + bytChannel] ) {
+    uintAlarmLow |= uintMask;
+    uintAlarmLatched |= uintMask;
+  }
+}
+/**
+ * Function:
+ *  alarmClear
+ *
+ * Parameters:
+ *  uintMask, a bit per channel, bit 0 for LTC2983 channel 3
+ *
+ * Remarks: call when a channel is reconfigured, its next value is checked
+ *          afresh
+ */
+void alarmClear(uint uintMask) {
+  uintAlarmHigh &= ~uintMask;
+  uintAlarmLow &= ~uintMask;
+}
+/**
+ * Function:
+ *  alarmAck
+ *
+ * Parameters:
+ *  uintMask, a bit per channel to acknowledge
+ */
+void alarmAck(uint uintMask) {
+  uintAlarmLatched &= ~(uintMask & ~(uintAlarmHigh | uintAlarmLow));
+}
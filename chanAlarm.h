@@ -0,0 +1,63 @@
+/**
+ * File:
+ *  chanAlarm.h
+ *
+ * Notes:
+ *  This file contains the prototypes for the per channel alarm limits.  Each
+ * channel has a high and a low limit and a hysteresis, the channels are
+ * those of chanStats.h, LTC2983 channels 3 to 14 in 0.01 C then the internal
+ * temperature, pressure and battery in the units of their engineering
+ * registers.  A value above the high limit, or below the low limit, makes
+ * the alarm active, it clears once the value is back inside the limit by
+ * the hysteresis.  An alarm that becomes active is latched until the master
+ * acknowledges it after it has cleared.
+ *
+ *  aryintAlarmCfg, holding registers:
+ *   [ALARM_HIGH + n]  high limit of channel n, 32767 never trips
+ *   [ALARM_LOW + n]   low limit of channel n, -32768 never trips
+ *   [ALARM_HYST + n]  hysteresis of channel n
+ *   [ALARM_ACK]       a bit per channel to acknowledge, reads back 0
+ *  The limits are kept in EEPROM after the node configuration.
+ *
+ *  The state is a bit per channel, bit 0 is channel 0, in uintAlarmLatched,
+ * uintAlarmHigh and uintAlarmLow.
+ *
+ * Usage:
+ *  alarmLoad();
+ *  alarmCheck(2, intCenti);          // LTC2983 channel 5
+ *  alarmAck(uintMask);               // written to ALARM_ACK
+ *  while ( !alarmSave(16) );         // the limits were written
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 alarmSave resumes over several calls
+ */
+#ifndef CHANALARM_H
+  #define CHANALARM_H
+
+  #include "types.h"
+  #include "chanStats.h"
+// Channels, the same as the statistics
+  #define ALARM_CHANNELS    STATS_CHANNELS
+// aryintAlarmCfg indexes
+  #define ALARM_HIGH        0
+  #define ALARM_LOW         ALARM_CHANNELS
+  #define ALARM_HYST        (2 * ALARM_CHANNELS)
+  #define ALARM_ACK         (3 * ALARM_CHANNELS)
+  #define ALARM_REGS        (ALARM_ACK + 1)
+// EEPROM address of the limits, after the node configuration image, a
+// marker byte then the limits high byte first
+  #define ALARM_EE          0x60
+  #define ALARM_EE_MARKER   0xA5
+
+  extern int aryintAlarmCfg[ALARM_REGS];
+  extern uint uintAlarmLatched;
+  extern uint uintAlarmHigh;
+  extern uint uintAlarmLow;
+
+  void alarmAck(uint uintMask);
+  void alarmCheck(byte bytChannel, int intValue);
+  void alarmClear(uint uintMask);
+  void alarmLoad(void);
+  boolean alarmSave(byte bytWrites);
+#endif
@@ -0,0 +1,273 @@
+/**
+ * File:
+ *  chanStats.c
+ *
+ * Notes:
+ *  This file contains the windowed channel statistics, see chanStats.h.
+ * Samples are added from the tasks and the registers are read from the low
+ * priority modbus interrupt, so each published channel is written with that
+ * masked.
+ *
+ *  Each channel keeps the first sample of the window and the minimum,
+ * maximum, sum and sum of squares of the deviations from it, so the sums
+ * stay in 32 bits and the variance does not lose the small deviations of a
+ * quiet channel.  RAM is 18 bytes per channel plus the published registers.
+ *
+ * Functions:
+ *  statsAdd        Adds a sample to a channel
+ *  statsInit       Empties every channel, starts the default window
+ *  statsPublish    Publishes a channel and empties it
+ *  statsReset      Discards the samples of some LTC2983 channels
+ *  statsSetWindow  Sets the window length and starts a new window
+ *  statsSqrt       Integer square root
+ *  statsWindow     Closes the window once its time is up
+ *
+ * History:
+ *  18/10/2026 Written
+ */
+#include "chanStats.h"
+#include "scheduler.h"
+// Published statistics, see chanStats.h
+volatile uint aryuintStats[STATS_REGS];
+// The window in progress, deviations are from the first sample
+static long arylngStatsFirst[STATS_CHANNELS];
+static int aryintStatsMin[STATS_CHANNELS];
+static int aryintStatsMax[STATS_CHANNELS];
+static long arylngStatsSum[STATS_CHANNELS];
+static ulong arylngStatsSquares[STATS_CHANNELS];
+static uint aryuintStatsSamples[STATS_CHANNELS];
+// Uptime the window started at and its length, ms
+static ulong ulngStatsStart;
+static ulong ulngStatsLength;
+// Next channel to publish while a window is closing
+static byte bytStatsClosing = STATS_CHANNELS;
+// Sum of squares once a deviation has been limited
+#define STATS_OVERFLOW  0xFFFFFFFF
+/**
+ * Function:
+ *  statsSqrt
+ *
+ * Parameters:
+ *  ulngValue, the value
+ *
+ * Returns:
+ *  The square root, rounded down
+ */
+static uint statsSqrt(ulong ulngValue) {
+  ulong ulngRoot = 0, ulngBit = 0x40000000;
+
+  while( ulngBit > ulngValue ) {
+    ulngBit >>= 2;
+  }
+  while( ulngBit != 0 ) {
+    if ( ulngValue >= ulngRoot + ulngBit ) {
+      ulngValue -= ulngRoot + ulngBit;
+      ulngRoot = (ulngRoot >> 1) + ulngBit;
+    } else {
+      ulngRoot >>= 1;
+    }
+    ulngBit >>= 2;
+  }
+  return ulngRoot;
+}
+/**
+ * Function:
+ *  statsPublish
+ *
+ * Parameters:
+ *  bytChannel, the channel index
+ *
+ * Remarks: takes a few ms, two long divisions and a square root
+ */
+static void statsPublish(byte bytChannel) {
+  uint uintSamples = aryuintStatsSamples[bytChannel];
+  uint uintStddev = 0xFFFF;
+  long lngSum = arylngStatsSum[bytChannel];
+  long lngMean = 0x80000000, lngMin = -32768, lngMax = -32768;
+  ulong ulngVariance, ulngSquare;
+  int intMean;
+  byte bytReg = STATS_DATA + STATS_PER_CHANNEL * bytChannel;
+
+  if ( uintSamples > 0 ) {
+// Mean deviation rounded, no larger than STATS_DEV_MAX
+    if ( lngSum < 0 ) {
+      intMean = -((-lngSum + (uintSamples >> 1)) / uintSamples);
+    } else {
+      intMean = (lngSum + (uintSamples >> 1)) / uintSamples;
+    }
+    lngMean = arylngStatsFirst[bytChannel] + intMean;
+    lngMin = (long)aryintStatsMin[bytChannel] - intMean;
+    lngMax = (long)aryintStatsMax[bytChannel] - intMean;
+
+    if ( lngMin < -32768 ) {
+      lngMin = -32768;
+    }
+    if ( lngMax > 32767 ) {
+      lngMax = 32767;
+    }
+    if ( arylngStatsSquares[bytChannel] != STATS_OVERFLOW ) {
+// E(d^2) - E(d)^2, the rounded mean is close enough next to the variance
+      ulngVariance = arylngStatsSquares[bytChannel] / uintSamples;
+      ulngSquare = (long)intMean * intMean;
+      ulngVariance = ulngVariance > ulngSquare ? ulngVariance - ulngSquare : 0;
+      uintStddev = statsSqrt(ulngVariance);
+
+      if ( uintStddev == 0xFFFF ) {
+        uintStddev = 0xFFFE;
+      }
+    }
+  }
+  GIEL_bit = 0;
+  aryuintStats[bytReg + STATS_SAMPLES] = uintSamples;
+  aryuintStats[bytReg + STATS_MEAN] = HiWord(lngMean);
+  aryuintStats[bytReg + STATS_MEAN + 1] = LoWord(lngMean);
+  aryuintStats[bytReg + STATS_MIN] = (int)lngMin;
+  aryuintStats[bytReg + STATS_MAX] = (int)lngMax;
+  aryuintStats[bytReg + STATS_STDDEV] = uintStddev;
+  GIEL_bit = 1;
+  aryuintStatsSamples[bytChannel] = 0;
+}
+/**
+ * Function:
+ *  statsInit
+ */
+void statsInit(void) {
+  byte i;
+
+  memset(aryuintStats, 0, sizeof(aryuintStats));
+
+  for( i=0; i<STATS_CHANNELS; i++ ) {
+    aryuintStatsSamples[i] = 0;
+    statsPublish(i);
+  }
+  statsSetWindow(STATS_WINDOW);
+}
+/**
+ * Function:
+ *  statsSetWindow
+ *
+ * Parameters:
+ *  uintSeconds, the window length, 0 for STATS_WINDOW
+ *
+ * Returns:
+ *  The length in use, limited to STATS_WINDOW_MAX
+ *
+ * Remarks: the samples of the window in progress are discarded
+ */
+uint statsSetWindow(uint uintSeconds) {
+  byte i;
+
+  if ( uintSeconds == 0 ) {
+    uintSeconds = STATS_WINDOW;
+  } else if ( uintSeconds > STATS_WINDOW_MAX ) {
+    uintSeconds = STATS_WINDOW_MAX;
+  }
+  for( i=0; i<STATS_CHANNELS; i++ ) {
+    aryuintStatsSamples[i] = 0;
+  }
+  ulngStatsLength = (ulong)uintSeconds * 1000;
+  ulngStatsStart = schedUptime();
+  bytStatsClosing = STATS_CHANNELS;
+  return uintSeconds;
+}
+/**
+ * Function:
+ *  statsReset
+ *
+ * Parameters:
+ *  uintMask, a bit per channel to empty, bit 0 for LTC2983 channel 3
+ *
+ * Remarks: call when a channel is reconfigured, its window starts again
+ *          from the next result
+ */
+void statsReset(uint uintMask) {
+  byte i;
+
+  for( i=0; i<FILTER_CHANNELS; i++ ) {
+    if ( uintMask & (1 << i) ) {
+      aryuintStatsSamples[i] = 0;
+    }
+  }
+}
+/**
+ * Function:
+ *  statsAdd
+ *
+ * Parameters:
+ *  bytChannel, the channel index, 0 for LTC2983 channel 3, STATS_ADC for
+ *  the first internal ADC channel
+ *  lngValue, the sample in raw codes
+ */
+void statsAdd(byte bytChannel, long lngValue) {
+  long lngDev;
+  int intDev;
+  ulong ulngSquare;
+
+  if ( aryuintStatsSamples[bytChannel] == 0 ) {
+    arylngStatsFirst[bytChannel] = lngValue;
+    aryintStatsMin[bytChannel] = 0;
+    aryintStatsMax[bytChannel] = 0;
+    arylngStatsSum[bytChannel] = 0;
+    arylngStatsSquares[bytChannel] = 0;
+  } else if ( aryuintStatsSamples[bytChannel] == 0xFFFF ) {
+    return;
+  }
+  lngDev = lngValue - arylngStatsFirst[bytChannel];
+
+  if ( lngDev > STATS_DEV_MAX ) {
+    lngDev = STATS_DEV_MAX;
+    arylngStatsSquares[bytChannel] = STATS_OVERFLOW;
+  } else if ( lngDev < -STATS_DEV_MAX ) {
+    lngDev = -STATS_DEV_MAX;
+    arylngStatsSquares[bytChannel] = STATS_OVERFLOW;
+  }
+  intDev = lngDev;
+
+  if ( intDev < aryintStatsMin[bytChannel] ) {
+    aryintStatsMin[bytChannel] = intDev;
+  } else if ( intDev > aryintStatsMax[bytChannel] ) {
+    aryintStatsMax[bytChannel] = intDev;
+  }
+// 16 bit deviations, the sum fits for all 0xFFFF samples
+  arylngStatsSum[bytChannel] += intDev;
+
+  if ( arylngStatsSquares[bytChannel] != STATS_OVERFLOW ) {
+    ulngSquare = (long)intDev * intDev;
+    arylngStatsSquares[bytChannel] += ulngSquare;
+
+    if ( arylngStatsSquares[bytChannel] < ulngSquare ) {
+      arylngStatsSquares[bytChannel] = STATS_OVERFLOW;
+    }
+  }
+  aryuintStatsSamples[bytChannel]++;
+}
+/**
+ * Function:
+ *  statsWindow
+ *
+ * Returns:
+ *  STATS_OPEN while the window runs, STATS_CLOSING while its channels are
+ *  published, STATS_CLOSED when the last one has been
+ *
+ * Remarks: call every ms or so, one channel is published per call.  Samples
+ *          of a channel not yet published still go to the window closing.
+ */
+byte statsWindow(void) {
+  if ( bytStatsClosing >= STATS_CHANNELS ) {
+    if ( schedUptime() - ulngStatsStart < ulngStatsLength ) {
+      return STATS_OPEN;
+    }
+    ulngStatsStart += ulngStatsLength;
+    bytStatsClosing = 0;
+  }
+  statsPublish(bytStatsClosing);
+
+  if ( ++bytStatsClosing < STATS_CHANNELS ) {
+    return STATS_CLOSING;
+  }
+  GIEL_bit = 0;
+  aryuintStats[STATS_WINDOWS]++;
+  aryuintStats[STATS_LENGTH] = ulngStatsLength / 1000;
+  GIEL_bit = 1;
+  return STATS_CLOSED;
+}
@@ -0,0 +1,80 @@
+/**
+ * File:
+ *  chanStats.h
+ *
+ * Notes:
+ *  This file contains the prototypes for the windowed channel statistics.
+ * Every result of the LTC2983 channels 3 to 14 and every pass of the internal
+ * ADC is added to its channel as it arrives, in raw codes (1/1024 C for the
+ * LTC2983, the oversampled left justified codes for the ADC).  At the end of
+ * each tumbling window the samples, mean, minimum, maximum and standard
+ * deviation of every channel are published, so a master polls once a window
+ * instead of once a conversion.
+ *
+ *  A window is closed one channel per call so no call runs long, the block
+ * should read busy while statsWindow returns STATS_CLOSING.
+ *
+ *  aryuintStats:
+ *   [STATS_WINDOWS]   windows published, wraps
+ *   [STATS_LENGTH]    length of the published windows, s
+ *   [STATS_DATA + STATS_PER_CHANNEL * n] channel n, [0] is LTC2983 channel 3,
+ *                     [STATS_ADC] internal temperature, pressure, battery:
+ *    [STATS_SAMPLES]  samples in the window, 0 when none
+ *    [STATS_MEAN]     mean, int32 hi word first
+ *    [STATS_MIN]      minimum - mean, int16
+ *    [STATS_MAX]      maximum - mean, int16
+ *    [STATS_STDDEV]   population standard deviation
+ *  Deviations are kept from the first sample of the window in 16 bits.  A
+ * channel that moves further than STATS_DEV_MAX from it reads STATS_STDDEV
+ * 0xFFFF and its mean, minimum and maximum are limited.  A channel without
+ * samples reads 0x80000000, -32768, -32768 and 0xFFFF.
+ *
+ * Usage:
+ *  statsInit();
+ *  statsAdd(2, lngRaw);              // LTC2983 channel 5
+ *  statsAdd(STATS_ADC + 1, uintAdc); // pressure
+ *  if ( statsWindow() == STATS_CLOSED ) {
+ *    modbusBlockChanged(&statsBlock);
+ *  }
+ *
+ * History:
+ *  18/10/2026 Written
+ */
+#ifndef CHANSTATS_H
+  #define CHANSTATS_H
+
+  #include "types.h"
+  #include "adcSeq.h"
+  #include "ltcFilter.h"
+// LTC2983 channels 3 to 14, then the internal ADC channels
+  #define STATS_ADC           FILTER_CHANNELS
+  #define STATS_CHANNELS      (FILTER_CHANNELS + ADC_CHANNELS)
+// aryuintStats indexes
+  #define STATS_WINDOWS       0
+  #define STATS_LENGTH        1
+  #define STATS_DATA          2
+  #define STATS_SAMPLES       0
+  #define STATS_MEAN          1
+  #define STATS_MIN           3
+  #define STATS_MAX           4
+  #define STATS_STDDEV        5
+  #define STATS_PER_CHANNEL   6
+  #define STATS_REGS          (STATS_DATA + STATS_PER_CHANNEL * STATS_CHANNELS)
+// Default and longest window, s
+  #define STATS_WINDOW        60
+  #define STATS_WINDOW_MAX    3600
+// Largest deviation from the first sample of a window, codes
+  #define STATS_DEV_MAX       32767
+// statsWindow
+  #define STATS_OPEN          0
+  #define STATS_CLOSING       1
+  #define STATS_CLOSED        2
+
+  extern volatile uint aryuintStats[STATS_REGS];
+
+  void statsAdd(byte bytChannel, long lngValue);
+  void statsInit(void);
+  void statsReset(uint uintMask);
+  uint statsSetWindow(uint uintSeconds);
+  byte statsWindow(void);
+#endif
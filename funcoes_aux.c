@@ -89,21 +89,3 @@ void spSend(unsigned short header, unsigned length, char *msg){
   }
   UART1_Write(Checksum(header,length,msg));
 }
-
-struct meuPacote {
-       char d1;
-       char d2;
-       char d3;
-       char d4;
-} pacote;
-
-
-union {
-   float float_variable;
-   char temp_array[4];
-} u;
-
-float floatvar;
-unsigned short spi_rx;
-
-  uint16_t dataTemp;
\ No newline at end of file
@@ -1,6 +1,43 @@
+#include "modbus.h"
+
 void setup();
 void MchpToIEEE754(float data_in, char data_out[4]);
 void configure_channels();
 void configure_global_parameters();
 void updateInputRegisters();
-void InitTimer1();
\ No newline at end of file
+void InitTimer1();
+void taskAcquisition();
+void taskInternal();
+void taskModbus();
+void taskHeartbeat();
+void taskPersist();
+void startScan();
+void startStream();
+void triggerCoilWritten(modbusBlockDef* pBlock);
+void triggerSeqWritten(modbusBlockDef* pBlock);
+void acqModeWritten(modbusBlockDef* pBlock);
+void adcCalWritten(modbusBlockDef* pBlock);
+void adcOsWritten(modbusBlockDef* pBlock);
+void updateAdcRegisters();
+void filterCfgWritten(modbusBlockDef* pBlock);
+void epochWritten(modbusBlockDef* pBlock);
+void commCfgWritten(modbusBlockDef* pBlock);
+void channelCfgWritten(modbusBlockDef* pBlock);
+void profileWritten(modbusBlockDef* pBlock);
+void streamCfgWritten(modbusBlockDef* pBlock);
+void streamFreeWritten(modbusBlockDef* pBlock);
+void statsWindowWritten(modbusBlockDef* pBlock);
+void alarmCfgWritten(modbusBlockDef* pBlock);
+void retryCfgWritten(modbusBlockDef* pBlock);
+void pruneCfgWritten(modbusBlockDef* pBlock);
+void updateStatusBits();
+void applyChannelCfg();
+boolean retryFaulted();
+void updateScanList();
+void invalidateChannels(uint uintMask);
+void resultsChanged();
+#ifdef MODBUS_GATEWAY
+void setupGateway();
+void updateGatewayStatus();
+void gwPortIsr();
+#endif
\ No newline at end of file
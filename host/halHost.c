@@ -0,0 +1,303 @@
+/**
+ * File:
+ *  halHost.c
+ *
+ * Notes:
+ *  This file contains the simulated UART/timer pair behind host/halHost.h.
+ * Received bytes are taken from the attached file descriptor one at a time,
+ * transmitted bytes are written back to it.  Timer0 counts in real time using
+ * the PIC instruction clock, so the inter-character and inter-frame intervals
+ * are the same as on the target for the configured baud rate.
+ *
+ * Functions:
+ *  halHostAttach     Attaches the serial file descriptor and interrupt routine
+ *  halHostNow        Monotonic time in nanoseconds
+ *  halHostRxRead     Reads the received byte, clears the receive flag
+ *  halHostStep       Waits for the next event and runs the interrupt routine
+ *  halHostTimerInit  Resets Timer0
+ *  halHostTimerRead  Reads Timer0
+ *  halHostTimerRun   Starts or stops Timer0
+ *  halHostTxWrite    Transmits a byte
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Added halHostTimerRead
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "halHost.h"
+
+#define HOST_QUEUE_LENGTH 512
+
+halHostState halHost;
+halHostStats halHostStat;
+// PIC oscillator, Timer0 is clocked at a quarter of this
+ulong ulngHalHostClockKHz = 4000;
+// The serial port and the routine called as the interrupt
+static int intHostFd = -1;
+static void (*pHostIsr)(void) = NULL;
+// Bytes read from the port but not yet seen by the receiver
+static byte arybytRxQueue[HOST_QUEUE_LENGTH];
+static int intRxHead = 0, intRxTail = 0;
+// Bytes transmitted but not yet written to the port
+static byte arybytTxQueue[HOST_QUEUE_LENGTH];
+static int intTxLength = 0;
+/**
+ * Function:
+ *  cpuNow
+ *
+ * Returns:
+ *  CPU time used by the calling thread in nanoseconds
+ */
+static uint64_t cpuNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+/**
+ * Function:
+ *  halHostNow
+ *
+ * Returns:
+ *  Monotonic time in nanoseconds
+ */
+uint64_t halHostNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+/**
+ * Function:
+ *  halHostAttach
+ *
+ * Parameters:
+ *  intFd, the serial port, non-blocking
+ *  pIsr, the interrupt routine
+ */
+void halHostAttach(int intFd, void (*pIsr)(void)) {
+  memset(&halHost, 0, sizeof(halHost));
+  memset(&halHostStat, 0, sizeof(halHostStat));
+  halHost.bytTimerPrescale = 0xff;
+  intHostFd = intFd;
+  pHostIsr = pIsr;
+  intRxHead = intRxTail = intTxLength = 0;
+}
+/**
+ * Function:
+ *  flushTx
+ */
+static void flushTx(void) {
+  int intOffset = 0;
+  while( intOffset < intTxLength ) {
+    ssize_t n = write(intHostFd, &arybytTxQueue[intOffset],
+                      intTxLength - intOffset);
+    if ( n < 0 ) {
+      if ( errno == EAGAIN || errno == EINTR ) {
+        struct pollfd pfd = { intHostFd, POLLOUT, 0 };
+        poll(&pfd, 1, 10);
+        continue;
+      }
+      break;
+    }
+    intOffset += n;
+  }
+  intTxLength = 0;
+}
+/**
+ * Function:
+ *  halHostTxWrite
+ *
+ * Parameters:
+ *  bytData, the byte to send
+ */
+void halHostTxWrite(byte bytData) {
+  if ( intTxLength == HOST_QUEUE_LENGTH ) {
+    flushTx();
+  }
+  arybytTxQueue[intTxLength++] = bytData;
+  halHostStat.u64TxBytes++;
+}
+/**
+ * Function:
+ *  halHostRxRead
+ *
+ * Returns:
+ *  The last received byte
+ */
+byte halHostRxRead(void) {
+  halHost.bytRxReady = 0;
+  return halHost.bytRxByte;
+}
+/**
+ * Function:
+ *  halHostTimerInit
+ */
+void halHostTimerInit(void) {
+  halHost.bytTimerRun = 0;
+  halHost.bytTimerExpired = 0;
+  halHost.bytTimerPrescale = 0xff;
+}
+/**
+ * Function:
+ *  timerValue
+ *
+ * Returns:
+ *  The count of the running timer
+ */
+static uint timerValue(void) {
+  uint64_t u64Ticks = (halHostNow() - halHost.u64TimerStart)
+                    * ulngHalHostClockKHz / 4000000ull;
+  if ( halHost.bytTimerPrescale != 0xff ) {
+    u64Ticks >>= halHost.bytTimerPrescale + 1;
+  }
+  return (uint)(halHost.uintTimerPreset + u64Ticks);
+}
+/**
+ * Function:
+ *  halHostTimerRead
+ *
+ * Returns:
+ *  The Timer0 count
+ */
+uint halHostTimerRead(void) {
+  if ( halHost.bytTimerRun ) {
+    return timerValue();
+  }
+  return halHost.uintTimerPreset;
+}
+/**
+ * Function:
+ *  halHostTimerRun
+ *
+ * Parameters:
+ *  bytOn, 1 to start counting from the loaded preset, 0 to stop
+ */
+void halHostTimerRun(byte bytOn) {
+  if ( !bytOn && halHost.bytTimerRun ) {
+// Keep the count, it can be read back
+    halHost.uintTimerPreset = timerValue();
+  }
+  if ( bytOn ) {
+    halHost.u64TimerStart = halHostNow();
+    uint64_t u64Ticks = 0x10000 - halHost.uintTimerPreset;
+    if ( halHost.bytTimerPrescale != 0xff ) {
+      u64Ticks <<= halHost.bytTimerPrescale + 1;
+    }
+// One tick is four oscillator periods
+    halHost.u64TimerDeadline = halHostNow()
+                             + u64Ticks * 4000000ull / ulngHalHostClockKHz;
+  }
+  halHost.bytTimerRun = bytOn;
+}
+/**
+ * Function:
+ *  pending
+ *
+ * Returns:
+ *  Non zero if an enabled interrupt flag is set
+ */
+static int pending(void) {
+  if ( !halHost.bytGIE ) {
+    return 0;
+  }
+  return (halHost.bytRxReady && halHost.bytRxIntEnable)
+      || (halHost.bytTimerExpired && halHost.bytTimerIntEnable)
+      || (halHost.bytTxIntEnable && halHost.bytTxEnable);
+}
+/**
+ * Function:
+ *  dispatch
+ *
+ * Remarks: delivers queued bytes and expired timers, running the interrupt
+ *          routine until nothing is pending
+ */
+static void dispatch(void) {
+  for(;;) {
+    if ( halHost.bytTimerRun && !halHost.bytTimerExpired
+      && halHostNow() >= halHost.u64TimerDeadline ) {
+      halHost.bytTimerExpired = 1;
+    }
+    if ( !halHost.bytRxReady && halHost.bytRxEnable
+      && intRxHead != intRxTail ) {
+      halHost.bytRxByte = arybytRxQueue[intRxTail];
+      intRxTail = (intRxTail + 1) % HOST_QUEUE_LENGTH;
+      halHost.bytRxReady = 1;
+      halHostStat.u64RxBytes++;
+    }
+    if ( !pending() ) {
+      break;
+    }
+    {
+      uint64_t u64Start = cpuNow(), u64Ns;
+      (*pHostIsr)();
+      u64Ns = cpuNow() - u64Start;
+      halHostStat.u64IsrCalls++;
+      halHostStat.u64IsrNs += u64Ns;
+      if ( u64Ns > halHostStat.u64IsrMaxNs ) {
+        halHostStat.u64IsrMaxNs = u64Ns;
+      }
+    }
+  }
+  flushTx();
+}
+/**
+ * Function:
+ *  halHostStep
+ *
+ * Parameters:
+ *  intMaxWaitMs, the longest time to wait for an event
+ *
+ * Returns:
+ *  0 if ok, -1 if the port was closed
+ */
+int halHostStep(int intMaxWaitMs) {
+  struct pollfd pfd;
+  struct timespec ts;
+  uint64_t u64WaitNs = (uint64_t)intMaxWaitMs * 1000000ull;
+  int intFree;
+
+  dispatch();
+  if ( halHost.bytTimerRun && !halHost.bytTimerExpired ) {
+    uint64_t u64Now = halHostNow();
+    uint64_t u64TimerNs = 0;
+    if ( halHost.u64TimerDeadline > u64Now ) {
+      u64TimerNs = halHost.u64TimerDeadline - u64Now;
+    }
+    if ( u64TimerNs < u64WaitNs ) {
+      u64WaitNs = u64TimerNs;
+    }
+  }
+// Only read while there is room in the queue
+  intFree = (intRxTail - intRxHead - 1 + HOST_QUEUE_LENGTH)
+          % HOST_QUEUE_LENGTH;
+  pfd.fd = intHostFd;
+  pfd.events = intFree > 0 ? POLLIN : 0;
+  pfd.revents = 0;
+  if ( intRxHead != intRxTail && halHost.bytRxEnable ) {
+    u64WaitNs = 0;
+  }
+  ts.tv_sec = u64WaitNs / 1000000000ull;
+  ts.tv_nsec = u64WaitNs % 1000000000ull;
+  if ( ppoll(&pfd, 1, &ts, NULL) > 0 ) {
+    if ( pfd.revents & POLLIN ) {
+      byte arybytChunk[HOST_QUEUE_LENGTH];
+      ssize_t n = read(intHostFd, arybytChunk, intFree);
+      ssize_t i;
+      if ( n == 0 ) {
+        return -1;
+      }
+      for( i=0; i<n; i++ ) {
+        arybytRxQueue[intRxHead] = arybytChunk[i];
+        intRxHead = (intRxHead + 1) % HOST_QUEUE_LENGTH;
+      }
+    } else if ( pfd.revents & (POLLHUP | POLLERR) ) {
+      return -1;
+    }
+  }
+  dispatch();
+  return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * File:
+ *  halHost.h
+ *
+ * Notes:
+ *  This file contains the host (Linux) backend of modbusHal.h.  The EUSART and
+ * Timer0 are replaced by a simulated UART/timer pair attached to a file
+ * descriptor, normally one side of a pseudo-terminal.  The simulation is single
+ * threaded, halHostStep() plays the part of the interrupt controller and calls
+ * the installed interrupt routine whenever a flag and its enable are both set.
+ *
+ *  The PIC integer widths are kept (uint is 16 bit, ushort is 8 bit) so the
+ * stack wraps the same way it does on the target.  Include system headers
+ * before modbus.h, the width macros below would upset them otherwise.
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Timer0 can be read back
+ *  18/10/2026 MB_FRAME_REQUEST and MB_FRAME_CLEAR, decodePacket calls both
+ *             interrupt halves so there is no request to deliver
+ */
+#ifndef HAL_HOST_H
+  #define HAL_HOST_H
+
+  #include <stdarg.h>
+  #include <stdint.h>
+  #include <string.h>
+
+// PIC widths, see types.h
+  #define ulong                       uint32_t
+  #define uint                        uint16_t
+  #define ushort                      uint8_t
+  #define byte                        uint8_t
+
+// mikroC built-ins
+  #define Hi(param)                   ((byte *)&(param))[1]
+  #define Lo(param)                   ((byte *)&(param))[0]
+  #define Clock_kHz()                 ulngHalHostClockKHz
+
+// Simulated peripheral state
+  typedef struct _halHostState {
+// Receiver
+    byte     bytRxReady;
+    byte     bytRxByte;
+    byte     bytRxEnable;
+    byte     bytRxIntEnable;
+// Transmitter
+    byte     bytTxEnable;
+    byte     bytTxIntEnable;
+    byte     bytTwoStopBits;
+    ulong    ulngBaud;
+// Timer0
+    byte     bytTimerRun;
+    byte     bytTimerExpired;
+    byte     bytTimerIntEnable;
+    byte     bytTimerPrescale;      // T0PS2:T0PS0, 0xff if not assigned
+    uint     uintTimerPreset;
+    uint64_t u64TimerStart;         // ns, valid while running
+    uint64_t u64TimerDeadline;      // ns, valid while running
+// Interrupts
+    byte     bytGIE;
+  } halHostState;
+
+  extern halHostState halHost;
+  extern ulong ulngHalHostClockKHz;
+
+// Receiver
+  #define MB_RX_READY                 (halHost.bytRxReady)
+  #define MB_RX_ERROR                 0
+  #define MB_RX_OVERRUN               0
+  #define MB_RX_READ()                halHostRxRead()
+  #define MB_RX_ENABLE(x)             halHost.bytRxEnable = (x)
+  #define MB_RX_INT_ENABLE(x)         halHost.bytRxIntEnable = (x)
+// Transmitter, the simulated shift register is always empty
+  #define MB_TX_READY                 (halHost.bytTxEnable)
+  #define MB_TX_WRITE(x)              halHostTxWrite(x)
+  #define MB_TX_ENABLE(x)             halHost.bytTxEnable = (x)
+  #define MB_TX_INT_ENABLE(x)         halHost.bytTxIntEnable = (x)
+  #define MB_TX_TWO_STOP_BITS()       halHost.bytTwoStopBits = 1
+  #define MB_UART_INIT(x)             halHost.ulngBaud = (x)
+// Timer0
+  #define MB_TIMER_INIT()             halHostTimerInit()
+  #define MB_TIMER_PRESCALE(x)        halHost.bytTimerPrescale = (x) & 0x07
+  #define MB_TIMER_LOAD(x)            halHost.uintTimerPreset = (x)
+  #define MB_TIMER_ZERO()             halHost.uintTimerPreset = 0
+  #define MB_TIMER_READ(x)            (x) = halHostTimerRead()
+  #define MB_TIMER_RUN(x)             halHostTimerRun(x)
+  #define MB_TIMER_EXPIRED            (halHost.bytTimerExpired)
+  #define MB_TIMER_CLEAR()            halHost.bytTimerExpired = 0
+  #define MB_TIMER_INT_ENABLE()       halHost.bytTimerIntEnable = 1
+// Interrupts
+  #define MB_INTERRUPTS_INIT()        halHost.bytGIE = 1
+  #define MB_DISABLE_INTERRUPTS()     halHost.bytGIE = 0
+  #define MB_ENABLE_INTERRUPTS()      halHost.bytGIE = 1
+  #define MB_FRAME_REQUEST()
+  #define MB_FRAME_CLEAR()
+// Misc
+  #define MB_DELAY_MS(x)
+  #define MB_VA_BYTE                  int
+
+// Statistics gathered around every interrupt call
+  typedef struct _halHostStats {
+    uint64_t u64IsrCalls;
+    uint64_t u64IsrNs;
+    uint64_t u64IsrMaxNs;
+    uint64_t u64RxBytes;
+    uint64_t u64TxBytes;
+  } halHostStats;
+
+  extern halHostStats halHostStat;
+
+  void     halHostAttach(int intFd, void (*pIsr)(void));
+  uint64_t halHostNow(void);
+  byte     halHostRxRead(void);
+  int      halHostStep(int intMaxWaitMs);
+  void     halHostTimerInit(void);
+  uint     halHostTimerRead(void);
+  void     halHostTimerRun(byte bytOn);
+  void     halHostTxWrite(byte bytData);
+#endif
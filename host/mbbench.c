@@ -0,0 +1,501 @@
+/**
+ * File:
+ *  mbbench.c
+ *
+ * Notes:
+ *  Throughput benchmark for the modbus RTU slave stack built natively.  The
+ * unmodified decodePacket() state machine runs in one thread on the simulated
+ * UART/timer (halHost.c) attached to the slave side of a pseudo-terminal, the
+ * main thread acts as the master on the other side.
+ *
+ * Usage:
+ *  mbbench [-b baud] [-n requests] [-m mix] [-s seed] [-c clock_khz]
+ *          [-g gap_chars]
+ *
+ *  mix is a comma separated list of request kinds and weights, for example
+ *  fc04:70,fc03:10,fc06:10,bad:5,badfn:5 (the default).  Kinds are
+ *   fc01 fc02 fc03 fc04 fc05 fc06 fc15 fc16  valid requests, random ranges
+ *   fc08   a diagnostics counter read or query echo
+ *   bad    a read past the end of the input registers (ILLEGAL_DATA_ADDRESS)
+ *   badfn  an unsupported function code (ILLEGAL_FUNCTION)
+ *   bcast  a broadcast FC06, no response expected
+ *   poll   the same FC04 of registers 1..27 every time, as a master polling
+ *          a node each cycle does, answered from the response cache
+ *
+ *  gap_chars is the silent interval the master leaves after each response,
+ *  default 8, the slave needs 1 + 4.5 characters plus the host scheduling
+ *  latency.
+ *
+ *  Reported: requests per second, turnaround latency (end of request to first
+ *  response byte) percentiles, exception and failure rates, and the CPU time
+ *  spent in the interrupt routine.
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Added fc08 requests and the slave diagnostics report
+ *  18/10/2026 Input registers split over three blocks, FC04 data checked
+ *  18/10/2026 Added poll requests and the response cache hit count, the
+ *             input register blocks are announced
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "modbus.h"
+
+#define SLAVE_ADDRESS   1
+#define COILS_TOTAL     16
+#define STATUS_TOTAL    16
+#define HOLDING_TOTAL   32
+#define INPUTS_TOTAL    125
+#define RESPONSE_WAIT   100   // ms, on top of the frame time
+
+// Request kinds
+enum { K_FC01, K_FC02, K_FC03, K_FC04, K_FC05, K_FC06, K_FC08, K_FC15, K_FC16,
+       K_BAD, K_BADFN, K_BCAST, K_POLL, K_COUNT };
+static const char* arystrKinds[K_COUNT] = {
+  "fc01", "fc02", "fc03", "fc04", "fc05", "fc06", "fc08", "fc15", "fc16",
+  "bad", "badfn", "bcast", "poll"
+};
+static int aryintWeights[K_COUNT];
+
+// Device side data
+static modbusBlockDef coilsBlock, statusBlock, holdingBlock;
+// Input registers are split so reads span blocks
+static modbusBlockDef inputBlocks[3];
+static byte arybytCoils[(COILS_TOTAL + 7) / 8];
+static byte arybytStatus[(STATUS_TOTAL + 7) / 8];
+static uint aryuintHolding[HOLDING_TOTAL];
+static uint aryuintInputs[INPUTS_TOTAL];
+static volatile int intStop = 0;
+
+static void* deviceThread(void* pArg) {
+  (void)pArg;
+  while( !intStop ) {
+    if ( halHostStep(10) < 0 ) {
+      break;
+    }
+    serviceIOBlocks();
+  }
+  return NULL;
+}
+
+static uint64_t now(void) {
+  return halHostNow();
+}
+
+static void sleepUntil(uint64_t u64Ns) {
+  struct timespec ts;
+  ts.tv_sec = u64Ns / 1000000000ull;
+  ts.tv_nsec = u64Ns % 1000000000ull;
+  while( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR ) ;
+}
+
+static baudRate toBaudRate(long lngBaud) {
+  switch( lngBaud ) {
+  case 1200:   return BAUD_1200;
+  case 2400:   return BAUD_2400;
+  case 4800:   return BAUD_4800;
+  case 9600:   return BAUD_9600;
+  case 19200:  return BAUD_19200;
+  case 38400:  return BAUD_38400;
+  case 57600:  return BAUD_57600;
+  case 115200: return BAUD_115200;
+  }
+  return (baudRate)0;
+}
+
+static int parseMix(const char* strMix) {
+  char* strCopy = strdup(strMix);
+  char* strSave = NULL;
+  char* strItem;
+  int i, intTotal = 0;
+
+  memset(aryintWeights, 0, sizeof(aryintWeights));
+  for( strItem=strtok_r(strCopy, ",", &strSave); strItem!=NULL;
+       strItem=strtok_r(NULL, ",", &strSave) ) {
+    char* strColon = strchr(strItem, ':');
+    int intWeight = 1;
+    if ( strColon != NULL ) {
+      *strColon = 0;
+      intWeight = atoi(strColon + 1);
+    }
+    for( i=0; i<K_COUNT; i++ ) {
+      if ( strcmp(strItem, arystrKinds[i]) == 0 ) {
+        aryintWeights[i] += intWeight;
+        intTotal += intWeight;
+        break;
+      }
+    }
+    if ( i == K_COUNT ) {
+      fprintf(stderr, "unknown request kind '%s'\n", strItem);
+      free(strCopy);
+      return -1;
+    }
+  }
+  free(strCopy);
+  return intTotal;
+}
+
+static int pickKind(int intTotal) {
+  int intPick = rand() % intTotal, i;
+  for( i=0; i<K_COUNT; i++ ) {
+    if ( intPick < aryintWeights[i] ) {
+      return i;
+    }
+    intPick -= aryintWeights[i];
+  }
+  return K_FC04;
+}
+
+// Picks a random start (base 1) and count inside a block of uintTotal items
+static void pickRange(uint uintTotal, uint uintMaxCount,
+                      uint* pStart, uint* pCount) {
+  uint uintCount = 1 + rand() % (uintTotal < uintMaxCount
+                                 ? uintTotal : uintMaxCount);
+  *pStart = 1 + rand() % (uintTotal - uintCount + 1);
+  *pCount = uintCount;
+}
+
+static int putHeader(byte* pFrame, byte bytAddress, byte bytFunction,
+                     uint uintStart, uint uintValue) {
+  uintStart--;
+  pFrame[0] = bytAddress;
+  pFrame[1] = bytFunction;
+  pFrame[2] = Hi(uintStart);
+  pFrame[3] = Lo(uintStart);
+  pFrame[4] = Hi(uintValue);
+  pFrame[5] = Lo(uintValue);
+  return 6;
+}
+
+// Builds a request, returns its length including the CRC
+static int buildRequest(int intKind, byte* pFrame) {
+  uint uintStart, uintCount, uintCRCValue;
+  int intLength, i;
+
+  switch( intKind ) {
+  case K_FC01:
+    pickRange(COILS_TOTAL, COILS_TOTAL, &uintStart, &uintCount);
+    intLength = putHeader(pFrame, SLAVE_ADDRESS, READ_COILS,
+                          uintStart, uintCount);
+    break;
+  case K_FC02:
+    pickRange(STATUS_TOTAL, STATUS_TOTAL, &uintStart, &uintCount);
+    intLength = putHeader(pFrame, SLAVE_ADDRESS, READ_STATUS_INPUTS,
+                          uintStart, uintCount);
+    break;
+  case K_FC03:
+    pickRange(HOLDING_TOTAL, MAX_REGISTERS_IN_3_AND_4, &uintStart, &uintCount);
+    intLength = putHeader(pFrame, SLAVE_ADDRESS, READ_HOLDING_REGISTERS,
+                          uintStart, uintCount);
+    break;
+  case K_FC04:
+    pickRange(INPUTS_TOTAL, MAX_REGISTERS_IN_3_AND_4, &uintStart, &uintCount);
+    intLength = putHeader(pFrame, SLAVE_ADDRESS, READ_INPUT_REGISTERS,
+                          uintStart, uintCount);
+    break;
+  case K_FC05:
+    pickRange(COILS_TOTAL, 1, &uintStart, &uintCount);
+    intLength = putHeader(pFrame, SLAVE_ADDRESS, FORCE_SINGLE_COIL,
+                          uintStart, (rand() & 1) ? 0xff00 : 0x0000);
+    break;
+  case K_FC06:
+  case K_BCAST:
+    pickRange(HOLDING_TOTAL, 1, &uintStart, &uintCount);
+    intLength = putHeader(pFrame,
+                          intKind == K_BCAST ? MODBUS_BROADCAST : SLAVE_ADDRESS,
+                          PRESET_SINGLE_REGISTER, uintStart, rand() & 0xffff);
+    break;
+  case K_FC15:
+    pickRange(COILS_TOTAL, COILS_TOTAL, &uintStart, &uintCount);
+    intLength = putHeader(pFrame, SLAVE_ADDRESS, FORCE_MULTIPLE_COILS,
+                          uintStart, uintCount);
+    pFrame[intLength++] = (uintCount + 7) / 8;
+    for( i=0; i<(uintCount + 7) / 8; i++ ) {
+      pFrame[intLength++] = rand() & 0xff;
+    }
+    break;
+  case K_FC16:
+    pickRange(HOLDING_TOTAL, MAX_REGISTERS_IN_FC16, &uintStart, &uintCount);
+    intLength = putHeader(pFrame, SLAVE_ADDRESS, PRESET_MULTIPLE_REGISTERS,
+                          uintStart, uintCount);
+    pFrame[intLength++] = uintCount * 2;
+    for( i=0; i<uintCount * 2; i++ ) {
+      pFrame[intLength++] = rand() & 0xff;
+    }
+    break;
+  case K_FC08: {
+    static const byte arybytSubFunctions[] = {
+      DIAG_RETURN_QUERY_DATA, DIAG_BUS_MESSAGE_COUNT, DIAG_BUS_ERROR_COUNT,
+      DIAG_EXCEPTION_COUNT, DIAG_SLAVE_MESSAGE_COUNT, DIAG_NO_RESPONSE_COUNT,
+      DIAG_OVERRUN_COUNT
+    };
+    byte bytSub = arybytSubFunctions[rand() % sizeof(arybytSubFunctions)];
+// putHeader takes a base 1 address
+    intLength = putHeader(pFrame, SLAVE_ADDRESS, DIAGNOSTICS, bytSub + 1,
+                          bytSub == DIAG_RETURN_QUERY_DATA ? rand() & 0xffff
+                                                           : 0);
+    break;
+  }
+  case K_POLL:
+    intLength = putHeader(pFrame, SLAVE_ADDRESS, READ_INPUT_REGISTERS, 1, 27);
+    break;
+  case K_BAD:
+    intLength = putHeader(pFrame, SLAVE_ADDRESS, READ_INPUT_REGISTERS,
+                          INPUTS_TOTAL, 2);
+    break;
+  default:
+    intLength = putHeader(pFrame, SLAVE_ADDRESS, 0x2B, 1, 1);
+    break;
+  }
+  uintCRCValue = calcBufferCRC(pFrame, intLength);
+  pFrame[intLength++] = Lo(uintCRCValue);
+  pFrame[intLength++] = Hi(uintCRCValue);
+  return intLength;
+}
+
+// Reads exactly intLength bytes before the deadline, returns bytes read
+static int readFrame(int intFd, byte* pFrame, int intLength,
+                     uint64_t u64Deadline, uint64_t* pFirst) {
+  int intRead = 0;
+  while( intRead < intLength ) {
+    struct pollfd pfd = { intFd, POLLIN, 0 };
+    uint64_t u64Now = now();
+    ssize_t n;
+    if ( u64Now >= u64Deadline
+      || poll(&pfd, 1, (int)((u64Deadline - u64Now) / 1000000) + 1) <= 0 ) {
+      break;
+    }
+    n = read(intFd, pFrame + intRead, intLength - intRead);
+    if ( n > 0 ) {
+      if ( intRead == 0 && pFirst != NULL ) {
+        *pFirst = now();
+      }
+      intRead += n;
+    }
+  }
+  return intRead;
+}
+
+static int compareU64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static double percentile(uint64_t* pSorted, long lngCount, double dblP) {
+  long lngIndex;
+  if ( lngCount == 0 ) {
+    return 0;
+  }
+  lngIndex = (long)(dblP / 100.0 * (lngCount - 1) + 0.5);
+  return pSorted[lngIndex] / 1e6;
+}
+
+int main(int argc, char** argv) {
+  long lngBaud = 115200, lngRequests = 2000, lngSeed = 1;
+  const char* strMix = "fc04:70,fc03:10,fc06:10,bad:5,badfn:5";
+  uint64_t* pLatency;
+  uint64_t u64Start, u64Elapsed, u64CharNs;
+  long lngAnswered = 0, lngExceptions = 0, lngTimeouts = 0, lngBadFrames = 0;
+  long lngBadData = 0;
+  long lngBroadcasts = 0, lngGap = 8, i;
+  int intMaster, intSlave, intTotalWeight, intOpt;
+  struct termios tio;
+  pthread_t device;
+  baudRate eBaud;
+
+  while( (intOpt = getopt(argc, argv, "b:n:m:s:c:g:h")) != -1 ) {
+    switch( intOpt ) {
+    case 'b': lngBaud = atol(optarg); break;
+    case 'n': lngRequests = atol(optarg); break;
+    case 'm': strMix = optarg; break;
+    case 's': lngSeed = atol(optarg); break;
+    case 'c': ulngHalHostClockKHz = atol(optarg); break;
+    case 'g': lngGap = atol(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-b baud] [-n requests] [-m mix] [-s seed]"
+                      " [-c clock_khz] [-g gap_chars]\n", argv[0]);
+      return 2;
+    }
+  }
+  eBaud = toBaudRate(lngBaud);
+  intTotalWeight = parseMix(strMix);
+  if ( eBaud == 0 || intTotalWeight <= 0 || lngRequests <= 0 ) {
+    fprintf(stderr, "bad baud rate, mix or request count\n");
+    return 2;
+  }
+  srand(lngSeed);
+// 11 bits per character, start, 8 data, parity or second stop, stop
+  u64CharNs = 11 * 1000000000ull / lngBaud;
+
+// Pseudo-terminal, raw in both directions
+  intMaster = posix_openpt(O_RDWR | O_NOCTTY);
+  if ( intMaster < 0 || grantpt(intMaster) < 0 || unlockpt(intMaster) < 0 ) {
+    perror("posix_openpt");
+    return 1;
+  }
+  intSlave = open(ptsname(intMaster), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if ( intSlave < 0 ) {
+    perror("open pty");
+    return 1;
+  }
+  tcgetattr(intSlave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(intSlave, TCSANOW, &tio);
+
+// Device, same initialisation sequence as the firmware
+  halHostAttach(intSlave, decodePacket);
+  modbusSerialInit(eBaud, 1, SLAVE_ADDRESS);
+  for( i=0; i<INPUTS_TOTAL; i++ ) {
+    aryuintInputs[i] = (uint)i;
+  }
+  addModbusBlock(SLAVE_ADDRESS, COILS, &coilsBlock, 1, COILS_TOTAL,
+                 arybytCoils, NULL);
+  addModbusBlock(SLAVE_ADDRESS, STATUS_INPUTS, &statusBlock, 1, STATUS_TOTAL,
+                 arybytStatus, NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, &holdingBlock, 1,
+                 HOLDING_TOTAL, aryuintHolding, NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, &inputBlocks[0], 1, 28,
+                 aryuintInputs, NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, &inputBlocks[1], 29, 72,
+                 &aryuintInputs[28], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, &inputBlocks[2], 101,
+                 INPUTS_TOTAL - 100, &aryuintInputs[100], NULL);
+// The data never changes, announcing the blocks once makes reads cacheable
+  for( i=0; i<3; i++ ) {
+    modbusBlockChanged(&inputBlocks[i]);
+  }
+  pthread_create(&device, NULL, deviceThread, NULL);
+// Let the initial silent interval pass
+  sleepUntil(now() + 10 * u64CharNs);
+
+  pLatency = calloc(lngRequests, sizeof(uint64_t));
+  u64Start = now();
+  for( i=0; i<lngRequests; i++ ) {
+    byte arybytFrame[MAX_PACKET_LENGTH];
+    int intKind = pickKind(intTotalWeight);
+    int intLength = buildRequest(intKind, arybytFrame);
+    int intExpected;
+    uint64_t u64Sent, u64First = 0, u64Deadline;
+    uint uintCRCValue, uintStart;
+
+    Hi(uintStart) = arybytFrame[2];
+    Lo(uintStart) = arybytFrame[3];
+
+    if ( write(intMaster, arybytFrame, intLength) != intLength ) {
+      perror("write");
+      break;
+    }
+    u64Sent = now();
+    if ( intKind == K_BCAST ) {
+// No answer, wait for the slave to see the end of frame and act on it
+      lngBroadcasts++;
+      sleepUntil(u64Sent + (intLength + 8) * u64CharNs);
+      continue;
+    }
+    u64Deadline = u64Sent + intLength * u64CharNs
+                + RESPONSE_WAIT * 1000000ull;
+// Address and function code decide the rest of the length
+    if ( readFrame(intMaster, arybytFrame, 2, u64Deadline, &u64First) < 2 ) {
+      lngTimeouts++;
+      sleepUntil(now() + 10 * u64CharNs);
+      continue;
+    }
+    if ( arybytFrame[1] & EXCEPTION_FLAG ) {
+      intExpected = 5;
+    } else if ( arybytFrame[1] <= READ_INPUT_REGISTERS ) {
+      if ( readFrame(intMaster, &arybytFrame[2], 1, u64Deadline, NULL) < 1 ) {
+        lngTimeouts++;
+        continue;
+      }
+      intExpected = 5 + arybytFrame[2];
+    } else {
+      intExpected = 8;
+    }
+    if ( intExpected > 3 ) {
+      int intHave = arybytFrame[1] <= READ_INPUT_REGISTERS
+                 && !(arybytFrame[1] & EXCEPTION_FLAG) ? 3 : 2;
+      if ( readFrame(intMaster, &arybytFrame[intHave], intExpected - intHave,
+                     u64Deadline, NULL) < intExpected - intHave ) {
+        lngTimeouts++;
+        continue;
+      }
+    }
+    uintCRCValue = calcBufferCRC(arybytFrame, intExpected - 2);
+    if ( arybytFrame[intExpected - 2] != Lo(uintCRCValue)
+      || arybytFrame[intExpected - 1] != Hi(uintCRCValue) ) {
+      lngBadFrames++;
+    } else if ( arybytFrame[1] & EXCEPTION_FLAG ) {
+      lngExceptions++;
+    } else if ( arybytFrame[1] == READ_INPUT_REGISTERS ) {
+// Input register n holds n - 1
+      int k;
+      for( k=0; k<arybytFrame[2] / 2; k++ ) {
+        if ( arybytFrame[3 + 2 * k] != Hi(uintStart)
+          || arybytFrame[4 + 2 * k] != Lo(uintStart) ) {
+          lngBadData++;
+          break;
+        }
+        uintStart++;
+      }
+    }
+    pLatency[lngAnswered++] = u64First - u64Sent;
+// Silent interval before the next request
+    sleepUntil(now() + lngGap * u64CharNs);
+  }
+  u64Elapsed = now() - u64Start;
+  intStop = 1;
+  pthread_join(device, NULL);
+
+  qsort(pLatency, lngAnswered, sizeof(uint64_t), compareU64);
+  printf("baud          %ld\n", lngBaud);
+  printf("mix           %s\n", strMix);
+  printf("gap           %ld chars\n", lngGap);
+  printf("requests      %ld (%ld answered, %ld broadcast)\n",
+         i, lngAnswered, lngBroadcasts);
+  printf("elapsed       %.3f s\n", u64Elapsed / 1e9);
+  printf("throughput    %.1f req/s\n", i / (u64Elapsed / 1e9));
+  printf("turnaround    p50 %.3f ms  p90 %.3f ms  p99 %.3f ms  max %.3f ms\n",
+         percentile(pLatency, lngAnswered, 50),
+         percentile(pLatency, lngAnswered, 90),
+         percentile(pLatency, lngAnswered, 99),
+         percentile(pLatency, lngAnswered, 100));
+  printf("exceptions    %.2f %% (%ld)\n",
+         lngAnswered ? 100.0 * lngExceptions / lngAnswered : 0.0,
+         lngExceptions);
+  printf("failures      %ld timeouts, %ld bad frames, %ld bad data\n",
+         lngTimeouts, lngBadFrames, lngBadData);
+  printf("isr           %llu calls, %.3f us avg, %.3f us max, %.3f us/request\n",
+         (unsigned long long)halHostStat.u64IsrCalls,
+         halHostStat.u64IsrCalls
+           ? halHostStat.u64IsrNs / 1e3 / halHostStat.u64IsrCalls : 0.0,
+         halHostStat.u64IsrMaxNs / 1e3,
+         i ? halHostStat.u64IsrNs / 1e3 / i : 0.0);
+  printf("slave diag    bus %u, errors %u, exceptions %u, slave %u,"
+         " no response %u, overruns %u\n",
+         mbDiag.uintBusMessages, mbDiag.uintCommErrors, mbDiag.uintExceptions,
+         mbDiag.uintSlaveMessages, mbDiag.uintNoResponses,
+         mbDiag.uintOverruns);
+  printf("slave cache   %u hits\n", uintMbCacheHits);
+  printf("slave latency");
+  for( i=0; i<MB_LATENCY_BINS; i++ ) {
+    printf(" %s%u:%u", i == MB_LATENCY_BINS - 1 ? ">=" : "<",
+           i == MB_LATENCY_BINS - 1 ? 32u << i : 64u << i,
+           aryuintMbLatency[i]);
+  }
+  printf(" (cycles:count)\n");
+  free(pLatency);
+  close(intSlave);
+  close(intMaster);
+// The odd timeout at high baud rates is the host scheduler splitting a frame
+  return (lngBadFrames || lngBadData || lngTimeouts * 100 > i) ? 1 : 0;
+}
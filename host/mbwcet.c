@@ -0,0 +1,553 @@
+/**
+ * File:
+ *  mbwcet.c
+ *
+ * Notes:
+ *  Worst case execution search for the modbus interrupt routine.  The stack is
+ * compiled with -fsanitize-coverage=trace-pc so every basic block it executes
+ * calls __sanitizer_cov_trace_pc() below, the number of calls made during one
+ * interrupt is its cost in operations and the set of blocks reached
+ * is the coverage that guides the search.  Frames are fed to the slave one
+ * byte per interrupt, followed by the gap timer and transmit interrupts, in
+ * the same order the PIC sees them, without any real time waiting.
+ *
+ *  The search starts from structured edge cases (maximum length reads and
+ * writes, misaligned coil writes, CRC failing full buffers, broadcasts, frames
+ * past the end of the buffer) and mutates the corpus, keeping frames that
+ * reach new blocks or cost more.  The most expensive frames are reported with
+ * their bytes so they can be replayed with -r.
+ *
+ *  Operation counts are a relative measure, they do not include the PIC
+ * assembler calcCRC (the host build uses the C version) and are not cycles.
+ *
+ * Usage:
+ *  mbwcet [-p map] [-i iterations] [-s seed] [-t top] [-l limit]
+ *  mbwcet [-p map] -r "01 10 00 00 ..."
+ *
+ *  map is the register map the slave is set up with:
+ *   daq12    the DAQ12.c map (the default), keep in step with setup()
+ *   gateway  daq12 plus the gateway cache and status blocks
+ *   wide     large blocks of every type, exercises maximum length frames
+ *  limit makes the exit status 1 if the worst call costs more operations.
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 FC08 seeds
+ *  18/10/2026 daq12 map has the diagnostics blocks
+ *  18/10/2026 daq12 map has the int16 and int32 banks
+ *  18/10/2026 daq12 map has the oversampled ADC block
+ *  18/10/2026 daq12 map has the ADC calibration and engineering units
+ *  18/10/2026 daq12 map has the filter configuration and filtered bank
+ *  18/10/2026 daq12 map has the scheduler statistics
+ *  18/10/2026 daq12 map has the scan timestamp, wall clock and uptime
+ *  18/10/2026 daq12 map has the node, channel and scan timing registers
+ *  18/10/2026 daq12 map has the streaming ring
+ *  18/10/2026 daq12 map announces the result banks, their reads are cached
+ *  18/10/2026 Worst high priority half, modbusRxIsr, reported on its own
+ *  18/10/2026 daq12 map has the window statistics
+ *  18/10/2026 daq12 map has 64 status inputs and the alarm limits
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "modbus.h"
+
+#define SLAVE_ADDRESS   1
+#define MAX_FRAME       300   // longer than the buffer on purpose
+#define MAX_CORPUS      512
+#define MAX_CALLS       4096
+#define COVERAGE_SIZE   65536
+
+typedef struct {
+  int      intLength;
+  byte     arybytData[MAX_FRAME];
+// Results
+  uint64_t u64MaxOps;         // most expensive single interrupt call
+  uint64_t u64TotalOps;       // all interrupt calls for the frame
+  int      intCalls;
+  int      intMaxCall;        // which call, intLength or more is after the frame
+  int      intReply;          // -1 none, 0 normal, else exception code
+} frameDef;
+
+// Operation counter and coverage map, updated by the instrumented stack
+static uint64_t u64Ops = 0;
+static byte arybytCoverage[COVERAGE_SIZE];
+static int intCovered = 0;
+// Worst modbusRxIsr call, the high priority half of an interrupt
+static uint64_t u64HighOps = 0;
+static int intNewCoverage = 0;
+
+static frameDef aryCorpus[MAX_CORPUS];
+static int intCorpus = 0;
+static frameDef* aryTop;
+static int intTop = 10, intTopUsed = 0;
+
+// Data areas, sized for the largest map
+static modbusBlockDef arySlaveBlocks[32];
+static byte arybytCoils[256];
+static byte arybytStatus[256];
+static uint aryuintHolding[256];
+static uint aryuintInputs[416];
+static uint aryuintHolding2[1];
+
+void __sanitizer_cov_trace_pc(void) {
+  uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+  unsigned intSlot = (unsigned)((pc ^ (pc >> 16)) & (COVERAGE_SIZE - 1));
+  u64Ops++;
+  if ( arybytCoverage[intSlot] == 0 ) {
+    arybytCoverage[intSlot] = 1;
+    intCovered++;
+    intNewCoverage = 1;
+  }
+}
+
+static void setup(const char* strMap) {
+  modbusBlockDef* pBlock = arySlaveBlocks;
+
+  if ( strcmp(strMap, "wide") == 0 ) {
+    addModbusBlock(SLAVE_ADDRESS, COILS, pBlock++, 1, 2000,
+                   arybytCoils, NULL);
+    addModbusBlock(SLAVE_ADDRESS, STATUS_INPUTS, pBlock++, 1, 2000,
+                   arybytStatus, NULL);
+    addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 1, 125,
+                   aryuintHolding, NULL);
+    addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 1, 125,
+                   aryuintInputs, NULL);
+    return;
+  }
+// DAQ12.c
+  addModbusBlock(SLAVE_ADDRESS, COILS, pBlock++, 1, 1, arybytCoils, NULL);
+  addModbusBlock(SLAVE_ADDRESS, STATUS_INPUTS, pBlock++, 1, 64,
+                 arybytStatus, NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 1, 1,
+                 aryuintHolding, NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 2, 1,
+                 aryuintHolding2, NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 1, 31,
+                 aryuintInputs, NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 101, 12,
+                 &aryuintInputs[102], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 201, 24,
+                 &aryuintInputs[114], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 301, 6,
+                 &aryuintInputs[88], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 307, 8,
+                 &aryuintInputs[94], NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 101, 6,
+                 &aryuintHolding[8], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 401, 6,
+                 &aryuintInputs[138], NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 201, 12,
+                 &aryuintHolding[16], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 501, 24,
+                 &aryuintInputs[144], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 601, 11,
+                 &aryuintInputs[168], NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 301, 2,
+                 &aryuintHolding[28], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 701, 9,
+                 &aryuintInputs[179], NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 401, 2,
+                 &aryuintHolding[30], NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 501, 28,
+                 &aryuintHolding[32], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 801, 2,
+                 &aryuintInputs[190], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 901, 5,
+                 &aryuintInputs[192], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 911, 14,
+                 &aryuintInputs[60], NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 601, 1,
+                 &aryuintHolding[60], NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 602, 2,
+                 &aryuintHolding[61], NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 604, 1,
+                 &aryuintHolding[63], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 3001, 52,
+                 &aryuintInputs[256], NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 701, 1,
+                 &aryuintHolding[64], NULL);
+  addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 4001, 92,
+                 &aryuintInputs[320], NULL);
+  addModbusBlock(SLAVE_ADDRESS, HOLDING_REGISTERS, pBlock++, 801, 46,
+                 &aryuintHolding[65], NULL);
+// The status inputs, the result banks, 1, 101, 201 and 501, and the
+// statistics at 4001 are announced so reads are cached
+  modbusBlockChanged(&arySlaveBlocks[1]);
+  modbusBlockChanged(&arySlaveBlocks[4]);
+  modbusBlockChanged(&arySlaveBlocks[5]);
+  modbusBlockChanged(&arySlaveBlocks[6]);
+  modbusBlockChanged(&arySlaveBlocks[12]);
+  modbusBlockChanged(&arySlaveBlocks[26]);
+  if ( strcmp(strMap, "gateway") == 0 ) {
+    addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 1001, 56,
+                   &aryuintInputs[200], NULL);
+    addModbusBlock(SLAVE_ADDRESS, INPUT_REGISTERS, pBlock++, 2001, 4,
+                   &aryuintInputs[84], NULL);
+  }
+}
+
+// Calls both interrupt halves once and records their cost
+static void isr(frameDef* pFrame) {
+  uint64_t u64Start = u64Ops, u64Cost;
+  modbusRxIsr();
+  if ( u64Ops - u64Start > u64HighOps ) {
+    u64HighOps = u64Ops - u64Start;
+  }
+  modbusFrameIsr();
+  u64Cost = u64Ops - u64Start;
+  pFrame->u64TotalOps += u64Cost;
+  if ( u64Cost > pFrame->u64MaxOps ) {
+    pFrame->u64MaxOps = u64Cost;
+    pFrame->intMaxCall = pFrame->intCalls;
+  }
+  pFrame->intCalls++;
+}
+
+// Runs the transmit and gap timer interrupts until the slave is idle
+static void runPending(frameDef* pFrame) {
+  int n;
+  for( n=0; n<MAX_CALLS; n++ ) {
+    if ( halHost.bytTxIntEnable && halHost.bytTxEnable ) {
+      isr(pFrame);
+    } else if ( halHost.bytTimerRun ) {
+      halHost.bytTimerExpired = 1;
+      isr(pFrame);
+    } else {
+      return;
+    }
+  }
+}
+
+static void runFrame(frameDef* pFrame) {
+  frameDef idle;
+  uint64_t u64TxBytes;
+  int i;
+// Back to the idle state, not counted
+  restartRx();
+  runPending(&idle);
+  pFrame->u64MaxOps = pFrame->u64TotalOps = 0;
+  pFrame->intCalls = pFrame->intMaxCall = 0;
+  u64TxBytes = halHostStat.u64TxBytes;
+  for( i=0; i<pFrame->intLength; i++ ) {
+    halHost.bytRxByte = pFrame->arybytData[i];
+    halHost.bytRxReady = 1;
+    isr(pFrame);
+  }
+  runPending(pFrame);
+  if ( halHostStat.u64TxBytes == u64TxBytes ) {
+    pFrame->intReply = -1;
+  } else if ( arybytMbBuffer[1] & EXCEPTION_FLAG ) {
+    pFrame->intReply = arybytMbBuffer[2];
+  } else {
+    pFrame->intReply = 0;
+  }
+}
+
+static void fixCRC(frameDef* pFrame) {
+  uint uintCRCValue;
+  if ( pFrame->intLength < 4 || pFrame->intLength > MAX_PACKET_LENGTH ) {
+    return;
+  }
+  uintCRCValue = calcBufferCRC(pFrame->arybytData, pFrame->intLength - 2);
+  pFrame->arybytData[pFrame->intLength - 2] = Lo(uintCRCValue);
+  pFrame->arybytData[pFrame->intLength - 1] = Hi(uintCRCValue);
+}
+
+// Request header, intStart is base 0 as on the wire
+static void makeFrame(frameDef* pFrame, byte bytAddress, byte bytFunction,
+                      unsigned intStart, unsigned intValue, int intData) {
+  int i;
+  pFrame->arybytData[0] = bytAddress;
+  pFrame->arybytData[1] = bytFunction;
+  pFrame->arybytData[2] = intStart >> 8;
+  pFrame->arybytData[3] = intStart & 0xff;
+  pFrame->arybytData[4] = intValue >> 8;
+  pFrame->arybytData[5] = intValue & 0xff;
+  pFrame->intLength = 6;
+  if ( intData >= 0 ) {
+    pFrame->arybytData[pFrame->intLength++] = intData;
+    for( i=0; i<intData; i++ ) {
+      pFrame->arybytData[pFrame->intLength++] = rand() & 0xff;
+    }
+  }
+  pFrame->intLength += 2;
+  fixCRC(pFrame);
+}
+
+static void keep(frameDef* pFrame);
+
+// The structured edge cases the search starts from
+static void seed(void) {
+  static const unsigned aryintCounts[] = { 1, 2, 8, 28, 123, 125, 126,
+                                           1968, 2000, 2001, 0, 0xffff };
+  frameDef frame;
+  unsigned c;
+  int i;
+
+  for( i=0; i<(int)(sizeof(aryintCounts) / sizeof(aryintCounts[0])); i++ ) {
+    c = aryintCounts[i];
+    makeFrame(&frame, SLAVE_ADDRESS, READ_COILS, 0, c, -1);
+    keep(&frame);
+    makeFrame(&frame, SLAVE_ADDRESS, READ_STATUS_INPUTS, 0, c, -1);
+    keep(&frame);
+    makeFrame(&frame, SLAVE_ADDRESS, READ_HOLDING_REGISTERS, 0, c, -1);
+    keep(&frame);
+    makeFrame(&frame, SLAVE_ADDRESS, READ_INPUT_REGISTERS, 0, c, -1);
+    keep(&frame);
+    if ( c <= MAX_REGISTERS_IN_FC16 ) {
+      makeFrame(&frame, SLAVE_ADDRESS, PRESET_MULTIPLE_REGISTERS, 0, c, 2 * c);
+      keep(&frame);
+    }
+    if ( c <= MAX_DISCRETES_IN_FC15 ) {
+// Aligned and misaligned coil writes
+      makeFrame(&frame, SLAVE_ADDRESS, FORCE_MULTIPLE_COILS, 0, c,
+                (c + 7) / 8);
+      keep(&frame);
+      makeFrame(&frame, SLAVE_ADDRESS, FORCE_MULTIPLE_COILS, 3, c,
+                (c + 7) / 8);
+      keep(&frame);
+    }
+  }
+  makeFrame(&frame, SLAVE_ADDRESS, FORCE_SINGLE_COIL, 0, 0xff00, -1);
+  keep(&frame);
+  makeFrame(&frame, SLAVE_ADDRESS, FORCE_SINGLE_COIL, 0, 0x1234, -1);
+  keep(&frame);
+  makeFrame(&frame, SLAVE_ADDRESS, PRESET_SINGLE_REGISTER, 1, 0x1234, -1);
+  keep(&frame);
+  makeFrame(&frame, MODBUS_BROADCAST, PRESET_MULTIPLE_REGISTERS, 0, 1, 2);
+  keep(&frame);
+  makeFrame(&frame, MODBUS_BROADCAST, READ_INPUT_REGISTERS, 0, 28, -1);
+  keep(&frame);
+// Reads spanning adjacent blocks and running into a gap
+  makeFrame(&frame, SLAVE_ADDRESS, READ_INPUT_REGISTERS, 300, 14, -1);
+  keep(&frame);
+  makeFrame(&frame, SLAVE_ADDRESS, READ_INPUT_REGISTERS, 300, 15, -1);
+  keep(&frame);
+  makeFrame(&frame, SLAVE_ADDRESS, READ_HOLDING_REGISTERS, 0, 2, -1);
+  keep(&frame);
+  makeFrame(&frame, SLAVE_ADDRESS, DIAGNOSTICS, DIAG_BUS_MESSAGE_COUNT, 0, -1);
+  keep(&frame);
+  makeFrame(&frame, SLAVE_ADDRESS, DIAGNOSTICS, DIAG_CLEAR_COUNTERS, 0, -1);
+  keep(&frame);
+  makeFrame(&frame, SLAVE_ADDRESS, 0x2B, 0, 1, -1);
+  keep(&frame);
+// A full buffer that fails the CRC, one that passes, one addressed elsewhere
+  frame.arybytData[0] = SLAVE_ADDRESS;
+  frame.arybytData[1] = PRESET_MULTIPLE_REGISTERS;
+  for( i=2; i<MAX_PACKET_LENGTH; i++ ) {
+    frame.arybytData[i] = rand() & 0xff;
+  }
+  frame.intLength = MAX_PACKET_LENGTH - 1;
+  keep(&frame);
+  fixCRC(&frame);
+  keep(&frame);
+  frame.arybytData[0] = SLAVE_ADDRESS + 1;
+  keep(&frame);
+// Past the end of the buffer
+  frame.arybytData[0] = SLAVE_ADDRESS;
+  for( i=MAX_PACKET_LENGTH - 1; i<MAX_FRAME; i++ ) {
+    frame.arybytData[i] = rand() & 0xff;
+  }
+  frame.intLength = MAX_FRAME;
+  keep(&frame);
+}
+
+static void mutate(frameDef* pFrame) {
+  static const byte arybytInteresting[] = { 0x00, 0x01, 0x02, 0x07, 0x08,
+                                            0x7b, 0x7d, 0x7e, 0x7f, 0x80,
+                                            0xf6, 0xf7, 0xfe, 0xff };
+  int intCount = 1 + rand() % 4, i, j;
+
+  for( i=0; i<intCount; i++ ) {
+    j = rand() % (pFrame->intLength > 0 ? pFrame->intLength : 1);
+    switch( rand() % 7 ) {
+    case 0:
+      pFrame->arybytData[j] ^= 1 << (rand() % 8);
+      break;
+    case 1:
+      pFrame->arybytData[j] = arybytInteresting[rand()
+                              % sizeof(arybytInteresting)];
+      break;
+    case 2:
+// Resize, new bytes are random
+      j = 4 + rand() % (MAX_FRAME - 3);
+      while( pFrame->intLength < j ) {
+        pFrame->arybytData[pFrame->intLength++] = rand() & 0xff;
+      }
+      pFrame->intLength = j;
+      break;
+    case 3:
+// Item count
+      pFrame->arybytData[4] = arybytInteresting[rand()
+                              % sizeof(arybytInteresting)] & 0x07;
+      pFrame->arybytData[5] = arybytInteresting[rand()
+                              % sizeof(arybytInteresting)];
+      break;
+    case 4:
+// Start address
+      pFrame->arybytData[2] = rand() % 4 == 0 ? rand() & 0xff : 0;
+      pFrame->arybytData[3] = rand() & 0xff;
+      break;
+    case 5:
+// Byte count matching the item count
+      pFrame->arybytData[6] = pFrame->arybytData[1] == FORCE_MULTIPLE_COILS
+                            ? (pFrame->arybytData[5] + 7) / 8
+                            : 2 * pFrame->arybytData[5];
+      break;
+    default:
+// Splice with another corpus entry
+      if ( intCorpus > 0 ) {
+        frameDef* pOther = &aryCorpus[rand() % intCorpus];
+        for( ; j<pOther->intLength && j<pFrame->intLength; j++ ) {
+          pFrame->arybytData[j] = pOther->arybytData[j];
+        }
+      }
+      break;
+    }
+  }
+// Mostly valid frames for this slave, otherwise only the CRC is checked
+  if ( rand() % 8 != 0 ) {
+    pFrame->arybytData[0] = rand() % 8 == 0 ? MODBUS_BROADCAST : SLAVE_ADDRESS;
+    fixCRC(pFrame);
+  }
+}
+
+// Runs a frame, adds it to the corpus and the top list if it is worth it
+static void keep(frameDef* pFrame) {
+  int i, intSlot = -1;
+
+  intNewCoverage = 0;
+  runFrame(pFrame);
+  if ( intNewCoverage && intCorpus < MAX_CORPUS ) {
+    aryCorpus[intCorpus++] = *pFrame;
+  }
+// One entry per function code and reply, the most expensive
+  for( i=0; i<intTopUsed; i++ ) {
+    if ( aryTop[i].arybytData[1] == pFrame->arybytData[1]
+      && aryTop[i].intReply == pFrame->intReply ) {
+      intSlot = i;
+      break;
+    }
+  }
+  if ( intSlot < 0 ) {
+    if ( intTopUsed < intTop ) {
+      intSlot = intTopUsed++;
+    } else {
+// Replace the cheapest
+      for( i=0, intSlot=0; i<intTopUsed; i++ ) {
+        if ( aryTop[i].u64MaxOps < aryTop[intSlot].u64MaxOps ) {
+          intSlot = i;
+        }
+      }
+    }
+  }
+  if ( pFrame->u64MaxOps > aryTop[intSlot].u64MaxOps
+    || aryTop[intSlot].intLength == 0 ) {
+    aryTop[intSlot] = *pFrame;
+// More expensive frames are worth mutating further
+    if ( !intNewCoverage && intCorpus < MAX_CORPUS ) {
+      aryCorpus[intCorpus++] = *pFrame;
+    }
+  }
+}
+
+static int compareTop(const void* a, const void* b) {
+  const frameDef* x = a;
+  const frameDef* y = b;
+  return x->u64MaxOps < y->u64MaxOps ? 1 : x->u64MaxOps > y->u64MaxOps ? -1 : 0;
+}
+
+static void printFrame(int intRank, frameDef* pFrame) {
+  int i;
+  char strReply[24];
+  if ( pFrame->intReply < 0 ) {
+    strcpy(strReply, "none");
+  } else if ( pFrame->intReply == 0 ) {
+    strcpy(strReply, "normal");
+  } else {
+    sprintf(strReply, "exception %d", pFrame->intReply);
+  }
+  printf("%2d  %6llu ops at %s %d, %llu ops in %d calls, fc %d, %d bytes,"
+         " reply %s\n    ", intRank,
+         (unsigned long long)pFrame->u64MaxOps,
+         pFrame->intMaxCall < pFrame->intLength ? "rx byte" : "call",
+         pFrame->intMaxCall < pFrame->intLength
+           ? pFrame->intMaxCall + 1 : pFrame->intMaxCall,
+         (unsigned long long)pFrame->u64TotalOps, pFrame->intCalls,
+         pFrame->arybytData[1], pFrame->intLength, strReply);
+  for( i=0; i<pFrame->intLength; i++ ) {
+    printf("%02x%s", pFrame->arybytData[i],
+           i + 1 < pFrame->intLength ? " " : "\n");
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* strMap = "daq12";
+  const char* strReplay = NULL;
+  long lngIterations = 50000, lngSeed = 1, lngLimit = 0, n;
+  int intOpt, i;
+
+  while( (intOpt = getopt(argc, argv, "p:i:s:t:l:r:h")) != -1 ) {
+    switch( intOpt ) {
+    case 'p': strMap = optarg; break;
+    case 'i': lngIterations = atol(optarg); break;
+    case 's': lngSeed = atol(optarg); break;
+    case 't': intTop = atoi(optarg); break;
+    case 'l': lngLimit = atol(optarg); break;
+    case 'r': strReplay = optarg; break;
+    default:
+      fprintf(stderr, "usage: %s [-p daq12|gateway|wide] [-i iterations]"
+                      " [-s seed] [-t top] [-l limit] [-r frame]\n", argv[0]);
+      return 2;
+    }
+  }
+  if ( intTop < 1 ) {
+    intTop = 1;
+  }
+  aryTop = calloc(intTop, sizeof(frameDef));
+  srand(lngSeed);
+
+  halHostAttach(open("/dev/null", O_WRONLY), decodePacket);
+  modbusSerialInit(BAUD_9600, 1, SLAVE_ADDRESS);
+  setup(strMap);
+
+  if ( strReplay != NULL ) {
+    frameDef frame;
+    char* strEnd;
+    frame.intLength = 0;
+    while( frame.intLength < MAX_FRAME ) {
+      long lngByte = strtol(strReplay, &strEnd, 16);
+      if ( strEnd == strReplay ) {
+        break;
+      }
+      frame.arybytData[frame.intLength++] = (byte)lngByte;
+      strReplay = strEnd;
+    }
+    runFrame(&frame);
+    printFrame(1, &frame);
+    return lngLimit && frame.u64MaxOps > (uint64_t)lngLimit;
+  }
+
+  seed();
+  for( n=0; n<lngIterations && intCorpus>0; n++ ) {
+    frameDef frame = aryCorpus[rand() % intCorpus];
+    mutate(&frame);
+    keep(&frame);
+  }
+  qsort(aryTop, intTopUsed, sizeof(frameDef), compareTop);
+  printf("map          %s\n", strMap);
+  printf("iterations   %ld, seed %ld\n", n, lngSeed);
+  printf("coverage     %d blocks, corpus %d frames\n", intCovered, intCorpus);
+  printf("worst call   %llu ops\n",
+         intTopUsed ? (unsigned long long)aryTop[0].u64MaxOps : 0ull);
+  printf("worst high   %llu ops\n", (unsigned long long)u64HighOps);
+  for( i=0; i<intTopUsed; i++ ) {
+    printFrame(i + 1, &aryTop[i]);
+  }
+  return lngLimit && intTopUsed && aryTop[0].u64MaxOps > (uint64_t)lngLimit;
+}
@@ -0,0 +1,434 @@
+/**
+ * File:
+ *  memmap.c
+ *
+ * Notes:
+ *  RAM and ROM report for the PIC build.  mikroC writes the address and size
+ * of every routine, variable and constant at the end of the listing
+ * (DAQ12.lst), this tool adds them up per source module so the cost of a
+ * feature is known before the part is flashed.
+ *
+ *  Symbols are given to the module that defines them.  The sources are the
+ * [FILES] of the project and the .c files they #include, each is scanned for
+ * the functions and variables it defines at file scope.  mikroC names locals
+ * and arguments after their function (updateInputRegisters_i_L0,
+ * FARG_filterApply_lngRaw) so those go to the module of the function.
+ * Anything else (the mikroC libraries, math helpers, compiler temporaries)
+ * is reported as "libraries".  Variables at or above the RAM size are SFRs
+ * and are not counted.
+ *
+ * Usage:
+ *  memmap [-p project] [-r ram] [-f rom] [-t top] listing
+ *
+ *  project is the .mcppi, ../DAQ12.mcppi by default.  ram and rom are the
+ *  sizes of the part in bytes, 1536 and 32768 for the PIC18F2520.  top is
+ *  the number of largest RAM symbols listed.  The exit status is 1 if either
+ *  total is over the part.
+ *
+ * History:
+ *  18/10/2026 Written
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_MODULES     32
+#define MAX_DEFINED     2048
+#define MAX_SYMBOLS     4096
+#define MAX_NAME        64
+#define MAX_PATH        512
+
+typedef struct {
+  char strName[MAX_NAME];
+  long lngRam;
+  long lngRom;
+} moduleDef;
+
+typedef struct {
+  char strName[MAX_NAME];
+  int  intModule;
+  int  intFunction;          // 1 for a function, its locals share the prefix
+} definedDef;
+
+typedef struct {
+  char strName[MAX_NAME];
+  long lngAddress;
+  long lngSize;
+  int  intModule;
+} symbolDef;
+
+// Sections of the listing
+enum { SECTION_NONE, SECTION_ROUTINES, SECTION_VARIABLES, SECTION_CONSTANTS };
+
+static moduleDef aryModules[MAX_MODULES];
+static int intModules = 0;
+static definedDef aryDefined[MAX_DEFINED];
+static int intDefined = 0;
+static symbolDef aryRam[MAX_SYMBOLS];
+static int intRam = 0;
+
+// Index of a module, added if it is new
+static int addModule(const char* strName) {
+  int i;
+  for( i=0; i<intModules; i++ ) {
+    if ( strcmp(aryModules[i].strName, strName) == 0 ) {
+      return i;
+    }
+  }
+  if ( intModules == MAX_MODULES ) {
+    fprintf(stderr, "memmap: more than %d modules\n", MAX_MODULES);
+    exit(2);
+  }
+  snprintf(aryModules[intModules].strName, MAX_NAME, "%s", strName);
+  return intModules++;
+}
+
+static void addDefined(const char* strName, int intModule, int intFunction) {
+  if ( intDefined < MAX_DEFINED ) {
+    snprintf(aryDefined[intDefined].strName, MAX_NAME, "%s", strName);
+    aryDefined[intDefined].intModule = intModule;
+    aryDefined[intDefined].intFunction = intFunction;
+    intDefined++;
+  }
+}
+
+// Reads a whole file, NULL if it can not be opened
+static char* readFile(const char* strPath) {
+  FILE* pFile = fopen(strPath, "rb");
+  char* strText;
+  long lngSize;
+
+  if ( pFile == NULL ) {
+    return NULL;
+  }
+  fseek(pFile, 0, SEEK_END);
+  lngSize = ftell(pFile);
+  rewind(pFile);
+  strText = malloc(lngSize + 1);
+  lngSize = (long)fread(strText, 1, lngSize, pFile);
+  strText[lngSize] = '\0';
+  fclose(pFile);
+  return strText;
+}
+
+static void scanSource(const char* strDir, const char* strFile);
+
+// Scans the .c files a source #includes, LT_SPI.c for example
+static void scanIncludes(const char* strDir, const char* strText) {
+  const char* p = strText;
+  char strName[MAX_NAME];
+
+  while( (p = strstr(p, "#include")) != NULL ) {
+    p += 8;
+    while( *p == ' ' || *p == '\t' ) {
+      p++;
+    }
+    if ( (*p == '"' || *p == '<')
+      && sscanf(p + 1, "%63[^\">]", strName) == 1 ) {
+      size_t intLength = strlen(strName);
+      if ( intLength > 2 && strcmp(strName + intLength - 2, ".c") == 0 ) {
+        scanSource(strDir, strName);
+      }
+    }
+  }
+}
+
+// Records the functions and variables a source defines at file scope. A
+// small tokenizer is enough: comments, strings and preprocessor lines are
+// skipped, declarators are the identifiers at brace depth 0 followed by
+// [ = ; or , and functions are an identifier ( ... ) followed by a {.
+static void scanSource(const char* strDir, const char* strFile) {
+  char strPath[MAX_PATH], strLast[MAX_NAME] = "", strCall[MAX_NAME] = "";
+  char* strText;
+  const char* p;
+  int intModule, intDepth = 0, intParens = 0, blnExtern = 0, blnInit = 0;
+  int blnLineStart = 1, i;
+
+  for( i=0; i<intModules; i++ ) {
+    if ( strcmp(aryModules[i].strName, strFile) == 0 ) {
+      return;
+    }
+  }
+  snprintf(strPath, sizeof(strPath), "%s/%s", strDir, strFile);
+  strText = readFile(strPath);
+  if ( strText == NULL ) {
+    fprintf(stderr, "memmap: can not read %s\n", strPath);
+    return;
+  }
+  intModule = addModule(strFile);
+  scanIncludes(strDir, strText);
+
+  for( p=strText; *p; ) {
+    if ( *p == '\n' ) {
+      blnLineStart = 1;
+      p++;
+      continue;
+    }
+    if ( isspace((unsigned char)*p) ) {
+      p++;
+      continue;
+    }
+    if ( blnLineStart && *p == '#' ) {
+// Preprocessor line, with continuations
+      while( *p && !(*p == '\n' && p[-1] != '\\') ) {
+        p++;
+      }
+      continue;
+    }
+    blnLineStart = 0;
+
+    if ( p[0] == '/' && p[1] == '/' ) {
+      while( *p && *p != '\n' ) {
+        p++;
+      }
+      continue;
+    }
+    if ( p[0] == '/' && p[1] == '*' ) {
+      p = strstr(p + 2, "*/");
+      p = p ? p + 2 : strText + strlen(strText);
+      continue;
+    }
+    if ( *p == '"' || *p == '\'' ) {
+      char chQuote = *p++;
+      while( *p && *p != chQuote ) {
+        p += (*p == '\\' && p[1]) ? 2 : 1;
+      }
+      if ( *p ) {
+        p++;
+      }
+      continue;
+    }
+    if ( isalpha((unsigned char)*p) || *p == '_' ) {
+      int intLength = 0;
+      while( isalnum((unsigned char)*p) || *p == '_' ) {
+        if ( intLength < MAX_NAME - 1 ) {
+          strLast[intLength++] = *p;
+        }
+        p++;
+      }
+      strLast[intLength] = '\0';
+
+      if ( intDepth == 0 && intParens == 0 && strcmp(strLast, "extern") == 0 ) {
+        blnExtern = 1;
+      }
+      continue;
+    }
+    if ( isdigit((unsigned char)*p) ) {
+      while( isalnum((unsigned char)*p) || *p == '.' ) {
+        p++;
+      }
+      strLast[0] = '\0';
+      continue;
+    }
+// Punctuation
+    if ( intDepth == 0 ) {
+      switch( *p ) {
+      case '(':
+        if ( intParens++ == 0 && strLast[0] && !blnInit ) {
+          snprintf(strCall, sizeof(strCall), "%s", strLast);
+        }
+        break;
+      case ')':
+        intParens--;
+        break;
+      case '[': case '=': case ';': case ',':
+        if ( intParens == 0 && strLast[0] && !blnInit && !blnExtern ) {
+          addDefined(strLast, intModule, 0);
+        }
+        if ( intParens == 0 ) {
+          if ( *p == '=' ) {
+            blnInit = 1;
+          } else if ( *p == ',' ) {
+            blnInit = 0;
+          } else if ( *p == ';' ) {
+            blnInit = blnExtern = 0;
+            strCall[0] = '\0';
+          }
+        }
+        break;
+      case '{':
+        if ( strCall[0] && !blnInit && !blnExtern ) {
+          addDefined(strCall, intModule, 1);
+        }
+        strCall[0] = '\0';
+        intDepth++;
+        break;
+      }
+    } else if ( *p == '{' ) {
+      intDepth++;
+    } else if ( *p == '}' ) {
+      intDepth--;
+    }
+    strLast[0] = '\0';
+    p++;
+  }
+  free(strText);
+}
+
+// Reads the [FILES] of a mikroC project and scans each source
+static void scanProject(const char* strProject) {
+  char strDir[MAX_PATH], strName[MAX_NAME];
+  char* strText = readFile(strProject);
+  char* strSlash;
+  const char* p;
+
+  if ( strText == NULL ) {
+    fprintf(stderr, "memmap: can not read %s\n", strProject);
+    exit(2);
+  }
+  snprintf(strDir, sizeof(strDir), "%s", strProject);
+  strSlash = strrchr(strDir, '/');
+  if ( strSlash != NULL ) {
+    *strSlash = '\0';
+  } else {
+    strcpy(strDir, ".");
+  }
+  p = strstr(strText, "[FILES]");
+  if ( p == NULL ) {
+    fprintf(stderr, "memmap: no [FILES] in %s\n", strProject);
+    exit(2);
+  }
+// Up to the next section
+  strSlash = strstr(p + 1, "\n[");
+  if ( strSlash != NULL ) {
+    *strSlash = '\0';
+  }
+  while( (p = strstr(p, "\nFile")) != NULL ) {
+    p++;
+    if ( sscanf(p, "File%*d=%63[^\r\n]", strName) == 1 ) {
+      scanSource(strDir, strName);
+    }
+  }
+  free(strText);
+}
+
+// Module of a listing symbol, the longest matching definition
+static int findModule(const char* strSymbol) {
+  const char* strName = strSymbol;
+  size_t intBest = 0, intLength;
+  int intModule = -1, i;
+
+  if ( *strName == '_' ) {
+    strName++;
+  }
+  if ( strncmp(strName, "FARG_", 5) == 0 ) {
+    strName += 5;
+  }
+  for( i=0; i<intDefined; i++ ) {
+    intLength = strlen(aryDefined[i].strName);
+
+    if ( strcmp(strName, aryDefined[i].strName) == 0 ) {
+      return aryDefined[i].intModule;
+    }
+    if ( aryDefined[i].intFunction && intLength > intBest
+      && strncmp(strName, aryDefined[i].strName, intLength) == 0
+      && strName[intLength] == '_' ) {
+      intBest = intLength;
+      intModule = aryDefined[i].intModule;
+    }
+  }
+  return intModule;
+}
+
+static int compareSize(const void* a, const void* b) {
+  const symbolDef* pA = a;
+  const symbolDef* pB = b;
+  return (pB->lngSize > pA->lngSize) - (pB->lngSize < pA->lngSize);
+}
+
+int main(int argc, char** argv) {
+  const char* strProject = "../DAQ12.mcppi";
+  long lngRamSize = 1536, lngRomSize = 32768, lngRam = 0, lngRom = 0;
+  int intOpt, intTop = 10, intSection = SECTION_NONE, intLibraries, i;
+  char strLine[256];
+  FILE* pListing;
+
+  while( (intOpt = getopt(argc, argv, "p:r:f:t:h")) != -1 ) {
+    switch( intOpt ) {
+    case 'p': strProject = optarg; break;
+    case 'r': lngRamSize = atol(optarg); break;
+    case 'f': lngRomSize = atol(optarg); break;
+    case 't': intTop = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-p project] [-r ram] [-f rom] [-t top]"
+                      " listing\n", argv[0]);
+      return 2;
+    }
+  }
+  if ( optind >= argc ) {
+    fprintf(stderr, "usage: %s [-p project] [-r ram] [-f rom] [-t top]"
+                    " listing\n", argv[0]);
+    return 2;
+  }
+  scanProject(strProject);
+  intLibraries = addModule("libraries");
+
+  pListing = fopen(argv[optind], "r");
+  if ( pListing == NULL ) {
+    fprintf(stderr, "memmap: can not read %s, build the project in mikroC"
+                    " first\n", argv[optind]);
+    return 2;
+  }
+  while( fgets(strLine, sizeof(strLine), pListing) != NULL ) {
+    unsigned long ulngAddress, ulngSize;
+    char strName[MAX_NAME];
+    int intModule;
+
+    if ( strncmp(strLine, "//**", 4) == 0 ) {
+      intSection = strstr(strLine, "Routines locations") ? SECTION_ROUTINES
+                 : strstr(strLine, "Variables locations") ? SECTION_VARIABLES
+                 : strstr(strLine, "Constants locations") ? SECTION_CONSTANTS
+                 : SECTION_NONE;
+      continue;
+    }
+    if ( intSection == SECTION_NONE
+      || sscanf(strLine, " 0x%lx [%lu] %63s", &ulngAddress, &ulngSize,
+                strName) != 3 ) {
+      continue;
+    }
+    intModule = findModule(strName);
+    if ( intModule < 0 ) {
+      intModule = intLibraries;
+    }
+    if ( intSection == SECTION_VARIABLES ) {
+      if ( (long)ulngAddress >= lngRamSize ) {
+        continue;
+      }
+      aryModules[intModule].lngRam += ulngSize;
+      lngRam += ulngSize;
+
+      if ( intRam < MAX_SYMBOLS ) {
+        snprintf(aryRam[intRam].strName, MAX_NAME, "%s", strName);
+        aryRam[intRam].lngAddress = ulngAddress;
+        aryRam[intRam].lngSize = ulngSize;
+        aryRam[intRam].intModule = intModule;
+        intRam++;
+      }
+    } else {
+      aryModules[intModule].lngRom += ulngSize;
+      lngRom += ulngSize;
+    }
+  }
+  fclose(pListing);
+
+  printf("%-32s %8s %8s\n", "module", "RAM", "ROM");
+  for( i=0; i<intModules; i++ ) {
+    if ( aryModules[i].lngRam || aryModules[i].lngRom ) {
+      printf("%-32s %8ld %8ld\n", aryModules[i].strName,
+             aryModules[i].lngRam, aryModules[i].lngRom);
+    }
+  }
+  printf("%-32s %8ld %8ld\n", "total", lngRam, lngRom);
+  printf("%-32s %8ld %8ld\n", "free", lngRamSize - lngRam, lngRomSize - lngRom);
+
+  qsort(aryRam, intRam, sizeof(symbolDef), compareSize);
+  printf("\nlargest RAM symbols\n");
+  for( i=0; i<intRam && i<intTop; i++ ) {
+    printf("  0x%04lx %6ld  %-32s %s\n", aryRam[i].lngAddress,
+           aryRam[i].lngSize, aryRam[i].strName,
+           aryModules[aryRam[i].intModule].strName);
+  }
+  return lngRam > lngRamSize || lngRom > lngRomSize;
+}
@@ -0,0 +1,163 @@
+/**
+ * File:
+ *  ltcFilter.c
+ *
+ * Notes:
+ *  This file contains the median and first order IIR filters applied to the
+ * LTC2983 results, see ltcFilter.h for the configuration word.  A channel is
+ * primed with its first sample so the filters start from the measured value
+ * instead of zero.
+ *
+ *  RAM is 4 bytes of IIR state, 16 bytes of median history and 2 bytes of
+ * running configuration per channel.
+ *
+ * Functions:
+ *  filterApply   Runs a new result through the channel filters
+ *  filterChanged Takes the written configuration, returns the channels
+ *                whose word changed
+ *  filterInit    Sets every channel to bypass
+ *  filterReset   Discards the filter history of some channels, called when
+ *                their configuration changes
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 filterReset takes a channel mask
+ *  18/10/2026 Median sort in the shared arena
+ *  18/10/2026 filterChanged, a configuration write resets only the channels
+ *             it changed
+ */
+#include "ltcFilter.h"
+#include "arena.h"
+// Per channel configuration
+uint aryuintFilterCfg[FILTER_CHANNELS];
+// The configuration each channel was last running, to find the words written
+static uint aryuintFilterRunning[FILTER_CHANNELS];
+// IIR state, with FILTER_IIR_FRACTION extra bits
+static long arylngFilterState[FILTER_CHANNELS];
+// Previous raw results, newest first
+static long arylngFilterHistory[FILTER_CHANNELS][FILTER_HISTORY];
+// A bit per channel, set once the channel has had its first sample
+static uint uintFilterPrimed = 0;
+/**
+ * Function:
+ *  filterInit
+ */
+void filterInit(void) {
+  memset(aryuintFilterCfg, 0, sizeof(aryuintFilterCfg));
+  memset(aryuintFilterRunning, 0, sizeof(aryuintFilterRunning));
+  filterReset(FILTER_ALL);
+}
+/**
+ * Function:
+ *  filterChanged
+ *
+ * Parameters:
+ *  none
+ *
+ * Returns:
+ *  A bit per channel whose configuration word changed since the last call,
+ *  bit 0 for LTC2983 channel 3
+ *
+ * Remarks: call after aryuintFilterCfg is written, the words are taken as
+ *          the running configuration
+ */
+uint filterChanged(void) {
+  uint uintMask = 0;
+  byte i;
+
+  for( i=0; i<FILTER_CHANNELS; i++ ) {
+    if ( aryuintFilterCfg[i] != aryuintFilterRunning[i] ) {
+      aryuintFilterRunning[i] = aryuintFilterCfg[i];
+      uintMask |= 1 << i;
+    }
+  }
+  return uintMask;
+}
+/**
+ * Function:
+ *  filterReset
+ *
+ * Parameters:
+ *  uintMask, a bit per channel to reset, bit 0 for LTC2983 channel 3
+ *
+ * Remarks: each channel is primed again by its next sample
+ */
+void filterReset(uint uintMask) {
+  uintFilterPrimed &= ~uintMask;
+}
+/**
+ * Function:
+ *  filterApply
+ *
+ * Parameters:
+ *  bytChannel, the channel index, 0 for LTC2983 channel 3
+ *  lngRaw, the signed 24 bit result
+ *
+ * Returns:
+ *  The filtered result, in the same units as lngRaw
+ *
+ * Remarks: the sort uses arena.acq, call from taskAcquisition only
+ */
+long filterApply(byte bytChannel, long lngRaw) {
+  long* arylngSort = arena.acq.arylngSort;
+  long* plngHistory = arylngFilterHistory[bytChannel];
+  long lngValue, lngSwap;
+  uint uintCfg = aryuintFilterCfg[bytChannel];
+  uint uintMask = 1 << bytChannel;
+  byte bytShift, bytTaps, i, j;
+
+  if ( !(uintFilterPrimed & uintMask) ) {
+    uintFilterPrimed |= uintMask;
+
+    for( i=0; i<FILTER_HISTORY; i++ ) {
+      plngHistory[i] = lngRaw;
+    }
+    arylngFilterState[bytChannel] = lngRaw << FILTER_IIR_FRACTION;
+  }
+  lngValue = lngRaw;
+  bytTaps = 0;
+
+  if ( uintCfg & FILTER_MEDIAN5 ) {
+    bytTaps = 5;
+  } else if ( uintCfg & FILTER_MEDIAN3 ) {
+    bytTaps = 3;
+  }
+  if ( bytTaps > 0 ) {
+// Insertion sort of the newest sample and its predecessors
+    arylngSort[0] = lngRaw;
+
+    for( i=1; i<bytTaps; i++ ) {
+      lngSwap = plngHistory[i - 1];
+
+      for( j=i; j>0 && arylngSort[j - 1] > lngSwap; j-- ) {
+        arylngSort[j] = arylngSort[j - 1];
+      }
+      arylngSort[j] = lngSwap;
+    }
+    lngValue = arylngSort[bytTaps >> 1];
+  }
+// The history holds unfiltered results
+  for( i=FILTER_HISTORY - 1; i>0; i-- ) {
+    plngHistory[i] = plngHistory[i - 1];
+  }
+  plngHistory[0] = lngRaw;
+
+  if ( uintCfg & FILTER_IIR ) {
+    bytShift = uintCfg >> 8;
+
+    if ( bytShift == 0 ) {
+      bytShift = 1;
+    } else if ( bytShift > FILTER_IIR_MAX_SHIFT ) {
+      bytShift = FILTER_IIR_MAX_SHIFT;
+    }
+    arylngFilterState[bytChannel] +=
+      ((lngValue << FILTER_IIR_FRACTION) - arylngFilterState[bytChannel])
+      >> bytShift;
+    lngValue = (arylngFilterState[bytChannel]
+             + (1 << (FILTER_IIR_FRACTION - 1))) >> FILTER_IIR_FRACTION;
+  } else {
+// Track the input so switching the IIR on does not step
+    arylngFilterState[bytChannel] = lngValue << FILTER_IIR_FRACTION;
+  }
+  return lngValue;
+}
@@ -0,0 +1,51 @@
+/**
+ * File:
+ *  ltcFilter.h
+ *
+ * Notes:
+ *  This file contains the prototypes for the per channel filters applied to
+ * the LTC2983 results.  Filters work on the raw signed 24 bit results
+ * (1/1024 C for temperatures) in fixed point.
+ *
+ *  Each channel has a configuration word:
+ *   bits 0..2  FILTER_MEDIAN3 or FILTER_MEDIAN5, then FILTER_IIR
+ *   bits 8..11 IIR shift k, y += (x - y) / 2^k, a time constant of about
+ *              2^k scans, 1 to FILTER_IIR_MAX_SHIFT
+ *  0 is bypass.  The median runs first so a spike never reaches the IIR.
+ *
+ * Usage:
+ *  filterInit();
+ *  read_results_block(&ltcMain, 3, 1, arybytResult);
+ *  lngFiltered = filterApply(0, get_raw_from_buffer(arybytResult));
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 filterReset takes a channel mask
+ *  18/10/2026 filterChanged
+ */
+#ifndef LTCFILTER_H
+  #define LTCFILTER_H
+
+  #include "types.h"
+// LTC2983 channels 3 to 14
+  #define FILTER_CHANNELS       12
+// Configuration flags
+  #define FILTER_BYPASS         0x00
+  #define FILTER_IIR            0x01
+  #define FILTER_MEDIAN3        0x02
+  #define FILTER_MEDIAN5        0x04
+  #define FILTER_IIR_MAX_SHIFT  8
+// Extra fraction bits kept in the IIR state, the 24 bit input still fits
+  #define FILTER_IIR_FRACTION   6
+// History kept for the median, the newest sample is not stored
+  #define FILTER_HISTORY        4
+// filterReset mask for every channel, bit 0 is channel 3
+  #define FILTER_ALL            0x0FFF
+// Configuration, one word per channel, read and written as holding registers
+  extern uint aryuintFilterCfg[FILTER_CHANNELS];
+
+  long filterApply(byte bytChannel, long lngRaw);
+  uint filterChanged(void);
+  void filterInit(void);
+  void filterReset(uint uintMask);
+#endif
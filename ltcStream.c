@@ -0,0 +1,138 @@
+/**
+ * File:
+ *  ltcStream.c
+ *
+ * Notes:
+ *  This file contains the single channel streaming ring, see ltcStream.h.
+ * Results are added from taskAcquisition and the registers are read from
+ * the low priority modbus interrupt, so every change to an entry and its
+ * indexes is made with that masked.  A full ring drops new results rather than
+ * overwriting entries the master may be reading.
+ *
+ *  Streaming stops by itself when its time is up, scanning then resumes.
+ * Writing the channel again restarts the time.
+ *
+ * Functions:
+ *  streamChannel   Returns the channel to convert, 0 when not streaming
+ *  streamFree      Frees the oldest entries
+ *  streamInit      Empties the ring, not streaming
+ *  streamPush      Adds a result and its fault byte with the ms tick
+ *  streamStart     Starts streaming a channel for a time
+ *  streamStop      Stops streaming
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Only the low priority interrupts are masked
+ *  18/10/2026 The fault byte is kept in the top of the hi word
+ */
+#include "ltcStream.h"
+#include "scheduler.h"
+// The ring and its indexes, see ltcStream.h
+volatile uint aryuintStream[STREAM_REGS];
+// Uptime streaming started at and how long it lasts, ms
+static ulong ulngStreamStart;
+static ulong ulngStreamTime;
+/**
+ * Function:
+ *  streamInit
+ */
+void streamInit(void) {
+  memset(aryuintStream, 0, sizeof(aryuintStream));
+}
+/**
+ * Function:
+ *  streamStart
+ *
+ * Parameters:
+ *  bytChannel, the LTC2983 channel to convert
+ *  uintSeconds, how long to stream for, 1 to STREAM_TIMEOUT_MAX
+ *
+ * Remarks: the ring is kept, entries of the previous channel stay until
+ *          they are freed
+ */
+void streamStart(byte bytChannel, uint uintSeconds) {
+  if ( uintSeconds == 0 ) {
+    uintSeconds = STREAM_TIMEOUT;
+  } else if ( uintSeconds > STREAM_TIMEOUT_MAX ) {
+    uintSeconds = STREAM_TIMEOUT_MAX;
+  }
+  ulngStreamStart = schedUptime();
+  ulngStreamTime = (ulong)uintSeconds * 1000;
+  GIEL_bit = 0;
+  aryuintStream[STREAM_CHANNEL] = bytChannel;
+  GIEL_bit = 1;
+}
+/**
+ * Function:
+ *  streamStop
+ */
+void streamStop(void) {
+  GIEL_bit = 0;
+  aryuintStream[STREAM_CHANNEL] = 0;
+  GIEL_bit = 1;
+}
+/**
+ * Function:
+ *  streamChannel
+ *
+ * Returns:
+ *  The channel to convert next, 0 to scan
+ */
+byte streamChannel(void) {
+  if ( aryuintStream[STREAM_CHANNEL] != 0
+    && schedUptime() - ulngStreamStart >= ulngStreamTime ) {
+    streamStop();
+  }
+  return aryuintStream[STREAM_CHANNEL];
+}
+/**
+ * Function:
+ *  streamPush
+ *
+ * Parameters:
+ *  bytFault, the fault byte read with the result
+ *  lngRaw, the signed 24 bit result
+ *
+ * Remarks: the entry holds them as the LTC2983 does, see ltcStream.h
+ */
+void streamPush(byte bytFault, long lngRaw) {
+  uint uintMs = schedMillis();
+  byte bytEntry;
+
+  GIEL_bit = 0;
+
+  if ( aryuintStream[STREAM_COUNT] >= STREAM_ENTRIES ) {
+    if ( aryuintStream[STREAM_DROPPED] != 0xFFFF ) {
+      aryuintStream[STREAM_DROPPED]++;
+    }
+    GIEL_bit = 1;
+    return;
+  }
+  bytEntry = STREAM_DATA + 3 * aryuintStream[STREAM_WRITE];
+  aryuintStream[bytEntry] = uintMs;
+  aryuintStream[bytEntry + 1] = ((uint)bytFault << 8)
+                              | ((uint)(lngRaw >> 16) & 0x00FF);
+  aryuintStream[bytEntry + 2] = LoWord(lngRaw);
+
+  if ( ++aryuintStream[STREAM_WRITE] >= STREAM_ENTRIES ) {
+    aryuintStream[STREAM_WRITE] = 0;
+  }
+  aryuintStream[STREAM_COUNT]++;
+  GIEL_bit = 1;
+}
+/**
+ * Function:
+ *  streamFree
+ *
+ * Parameters:
+ *  uintEntries, the number of oldest entries the master has read
+ */
+void streamFree(uint uintEntries) {
+  GIEL_bit = 0;
+
+  if ( uintEntries > aryuintStream[STREAM_COUNT] ) {
+    uintEntries = aryuintStream[STREAM_COUNT];
+  }
+  aryuintStream[STREAM_COUNT] -= uintEntries;
+  GIEL_bit = 1;
+}
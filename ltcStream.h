@@ -0,0 +1,62 @@
+/**
+ * File:
+ *  ltcStream.h
+ *
+ * Notes:
+ *  This file contains the prototypes for the single channel streaming
+ * buffer.  While a channel is streamed the LTC2983 converts only that
+ * channel, every result is added to a ring of STREAM_ENTRIES entries with
+ * the ms tick it arrived at.  The whole ring and its indexes are one block
+ * of input registers so a single FC-04 returns a consistent snapshot, the
+ * master then frees what it has read by writing the number of entries.
+ *
+ *  aryuintStream:
+ *   [STREAM_WRITE]    the entry the next result goes to
+ *   [STREAM_COUNT]    entries not yet freed, the oldest is at
+ *                     (STREAM_WRITE - STREAM_COUNT) mod STREAM_ENTRIES
+ *   [STREAM_DROPPED]  results lost because the ring was full, saturates
+ *   [STREAM_CHANNEL]  the channel being streamed, 0 when scanning
+ *   [STREAM_DATA + 3n] entry n: ms tick, then the result as the LTC2983
+ *                     holds it, hi word first: the fault byte in bits 31..24
+ *                     (VALID, SENSOR_HARD_FAILURE...) and the signed 24 bit
+ *                     result in bits 23..0, sign extend it from bit 23
+ *
+ * Usage:
+ *  streamStart(5, 60);               // channel 5 for a minute
+ *  if ( streamChannel() != 0 ) {     // timed out channels read 0
+ *    convert_channel(&ltcMain, streamChannel());
+ *  }
+ *  read_results_block(&ltcMain, 5, 1, arybytResult); // INT has gone high
+ *  streamPush(arybytResult[0], get_raw_from_buffer(arybytResult));
+ *  streamFree(uintRead);             // the master has read them
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Entries keep the fault byte
+ */
+#ifndef LTCSTREAM_H
+  #define LTCSTREAM_H
+
+  #include "types.h"
+// Ring size, 3 registers each, check memmap before making it bigger
+  #define STREAM_ENTRIES      16
+// aryuintStream indexes
+  #define STREAM_WRITE        0
+  #define STREAM_COUNT        1
+  #define STREAM_DROPPED      2
+  #define STREAM_CHANNEL      3
+  #define STREAM_DATA         4
+  #define STREAM_REGS         (STREAM_DATA + 3 * STREAM_ENTRIES)
+// Default and longest streaming time, seconds
+  #define STREAM_TIMEOUT      60
+  #define STREAM_TIMEOUT_MAX  3600
+
+  extern volatile uint aryuintStream[STREAM_REGS];
+
+  byte streamChannel(void);
+  void streamFree(uint uintEntries);
+  void streamInit(void);
+  void streamPush(byte bytFault, long lngRaw);
+  void streamStart(byte bytChannel, uint uintSeconds);
+  void streamStop(void);
+#endif
@@ -0,0 +1,314 @@
+/**
+ * File:
+ *  ltcTiming.c
+ *
+ * Notes:
+ *  This file contains the LTC2983 scan time model, see ltcTiming.h.  A scan
+ * converts the channels of the mask one after the other, each conversion
+ * takes TIMING_CYCLES conversion cycles, one more when the excitation is
+ * rotated, plus the multiplexer delay of the global parameters.  A
+ * thermocouple also converts its cold junction sensor.  The cycle length
+ * depends on the rejection mode.
+ *
+ *  The model is only nominal, every finished scan updates the ratio of the
+ * measured time to the model so the expected time follows the actual part
+ * and oscillator.  The ratio is kept when the configuration changes, only
+ * the model is worked out again.
+ *
+ *  Times come from schedMillis, a scan is timed from timingScanStart to
+ * timingScanDone and both run from taskAcquisition, so the resolution is
+ * the 1ms tick.  The ratio only learns from the scan itself.  The time to
+ * the next result runs on until timingPublished, each re-conversion
+ * started by timingRetry adds its expected time.
+ *
+ * Functions:
+ *  channelTime     Conversion time of one channel in 0.1ms
+ *  setTiming       Writes one of the published values
+ *  timingInit      Sets the ratio to 1, nothing measured yet
+ *  timingModel     Scan time of a channel mask in ms, from the model only
+ *  timingPublished The results of the scan are out, stops the timing
+ *  timingRetry     Adds the re-conversion of a channel to the scan
+ *  timingScanDone  Measures the scan that has finished, updates the ratio
+ *  timingScanStart Records the start of a scan and its expected time
+ *  timingUpdate    Works out the time left in the scan in progress
+ *  timingWindow    Publishes the conversion counts once a window
+ *
+ *  Throughput is counted from the scans that finish, each converts every
+ * channel of its mask once, so a profile can be checked in the field.
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Conversions per minute per channel
+ *  18/10/2026 Only the low priority interrupts are masked
+ *  18/10/2026 Timed to publication, re-conversions included
+ */
+#include <stdint.h>
+
+#include "ltcTiming.h"
+#include "nodeConfig.h"
+#include "scheduler.h"
+#include "LTC2983_configuration_constants.h"
+// Published values, see ltcTiming.h
+volatile uint aryuintTiming[TIMING_REGS];
+volatile uint aryuintThroughput[CFG_CHANNELS];
+// Conversions in the current window, the mask of the scan in progress
+static uint aryuintConversions[CFG_CHANNELS];
+static ulong ulngScanMask;
+static uint uintWindowStart;
+// Measured / model in Q8
+static uint uintRatio;
+// Start of the scan in progress, its expected time to publication, when the
+// last one was published
+static uint uintScanStart;
+static uint uintScanExpected;
+static uint uintLastDone;
+static boolean blnScanning = FALSE;
+static boolean blnDoneOnce = FALSE;
+static boolean blnRatioSet = FALSE;
+/**
+ * Function:
+ *  setTiming
+ *
+ * Parameters:
+ *  bytIndex, a TIMING_ index
+ *  uintValue, the value
+ *
+ * Remarks: written with low priority interrupts off so a master never
+ *          reads half of it
+ */
+static void setTiming(byte bytIndex, uint uintValue) {
+  GIEL_bit = 0;
+  aryuintTiming[bytIndex] = uintValue;
+  GIEL_bit = 1;
+}
+/**
+ * Function:
+ *  channelTime
+ *
+ * Parameters:
+ *  ulngWord, the channel assignment word
+ *  uintCycle, the conversion cycle in 0.1ms
+ *
+ * Returns:
+ *  The conversion time of the channel in 0.1ms, the multiplexer delay
+ *  included
+ */
+static uint channelTime(ulong ulngWord, uint uintCycle) {
+  byte bytType = CFG_SENSOR_TYPE(ulngWord);
+  byte bytCycles = TIMING_CYCLES;
+
+  if ( bytType >= CFG_TYPE_RTD_FIRST && bytType <= CFG_TYPE_RTD_LAST
+    && CFG_FIELD(ulngWord, RTD_EXCITATION_MODE_LSB, 0x03) == 0x02 ) {
+    bytCycles++;
+  } else if ( bytType >= CFG_TYPE_THERM_FIRST && bytType <= CFG_TYPE_THERM_LAST
+    && CFG_FIELD(ulngWord, THERMISTOR_EXCITATION_MODE_LSB, 0x03) == 0x01 ) {
+    bytCycles++;
+  }
+  return bytCycles * uintCycle + nodeCfg.bytMuxDelay;
+}
+/**
+ * Function:
+ *  timingInit
+ */
+void timingInit(void) {
+  uintRatio = TIMING_RATIO_ONE;
+  blnScanning = FALSE;
+  blnDoneOnce = FALSE;
+  blnRatioSet = FALSE;
+  memset(aryuintTiming, 0, sizeof(aryuintTiming));
+  memset(aryuintThroughput, 0, sizeof(aryuintThroughput));
+  memset(aryuintConversions, 0, sizeof(aryuintConversions));
+  aryuintTiming[TIMING_NEXT] = 0xFFFF;
+  uintWindowStart = schedMillis();
+}
+/**
+ * Function:
+ *  timingModel
+ *
+ * Parameters:
+ *  ulngMask, the scan mask, bit 0 is channel 1
+ *
+ * Returns:
+ *  The expected scan time in ms from the model alone
+ */
+uint timingModel(ulong ulngMask) {
+  uint uintCycle, uintTotal = 0;
+  byte i, bytRef;
+  ulong ulngWord;
+
+  switch( nodeCfg.bytGlobal & 0x03 ) {
+  case REJECTION__60_HZ:
+    uintCycle = TIMING_CYCLE_60;
+    break;
+  case REJECTION__50_HZ:
+    uintCycle = TIMING_CYCLE_50;
+    break;
+  default:
+    uintCycle = TIMING_CYCLE_50_60;
+    break;
+  }
+  for( i=0; i<CFG_CHANNELS; i++ ) {
+    if ( !(ulngMask & ((ulong)1 << i)) ) {
+      continue;
+    }
+    ulngWord = nodeCfg.arylngChannel[i];
+
+    if ( CFG_SENSOR_TYPE(ulngWord) == 0 ) {
+// Unassigned, the LTC2983 only reports the fault
+      continue;
+    }
+    uintTotal += channelTime(ulngWord, uintCycle);
+    bytRef = cfgChannelRef(ulngWord);
+
+    if ( CFG_SENSOR_TYPE(ulngWord) <= CFG_TYPE_TC_LAST && bytRef != 0 ) {
+// The cold junction sensor is converted with the thermocouple
+      uintTotal += channelTime(nodeCfg.arylngChannel[bytRef - 1], uintCycle);
+    }
+  }
+  return (uintTotal + 5) / 10;
+}
+/**
+ * Function:
+ *  timingScanStart
+ *
+ * Parameters:
+ *  ulngMask, the mask of the scan just started
+ */
+void timingScanStart(ulong ulngMask) {
+  uint uintModel = timingModel(ulngMask);
+
+  uintScanStart = schedMillis();
+  ulngScanMask = ulngMask;
+  uintScanExpected = ((ulong)uintModel * uintRatio) >> 8;
+  blnScanning = TRUE;
+  setTiming(TIMING_MODEL, uintModel);
+  setTiming(TIMING_EXPECTED, uintScanExpected);
+  setTiming(TIMING_NEXT, uintScanExpected);
+}
+/**
+ * Function:
+ *  timingRetry
+ *
+ * Parameters:
+ *  bytChannel, the channel re-converted alone, 1 to CFG_CHANNELS
+ *
+ * Remarks: call after convert_channel, between timingScanDone and
+ *          timingPublished
+ */
+void timingRetry(byte bytChannel) {
+  ulong ulngMask = (ulong)1 << (bytChannel - 1);
+
+  if ( !blnScanning ) {
+    return;
+  }
+  aryuintConversions[bytChannel - 1]++;
+  uintScanExpected += ((ulong)timingModel(ulngMask) * uintRatio) >> 8;
+  setTiming(TIMING_EXPECTED, uintScanExpected);
+  timingUpdate();
+}
+/**
+ * Function:
+ *  timingPublished
+ *
+ * Remarks: the end of the scan for 901 and 903, call once its results are
+ *          in the registers
+ */
+void timingPublished(void) {
+  uint uintNow = schedMillis();
+
+  if ( !blnScanning ) {
+    return;
+  }
+  blnScanning = FALSE;
+  setTiming(TIMING_NEXT, 0xFFFF);
+
+  if ( blnDoneOnce ) {
+    setTiming(TIMING_CYCLE, uintNow - uintLastDone);
+  }
+  uintLastDone = uintNow;
+  blnDoneOnce = TRUE;
+}
+/**
+ * Function:
+ *  timingUpdate
+ *
+ * Remarks: call every tick, does nothing unless a scan is running
+ */
+void timingUpdate(void) {
+  uint uintElapsed;
+
+  if ( !blnScanning ) {
+    return;
+  }
+  uintElapsed = schedMillis() - uintScanStart;
+  setTiming(TIMING_NEXT, uintElapsed < uintScanExpected
+                       ? uintScanExpected - uintElapsed : 0);
+}
+/**
+ * Function:
+ *  timingScanDone
+ *
+ * Remarks: the first measurement sets the ratio, later ones are averaged.
+ *          The scan keeps running for 901 until timingPublished, from now
+ *          on it is expected to take what it took plus any re-conversions.
+ */
+void timingScanDone(void) {
+  uint uintNow = schedMillis();
+  uint uintMeasured = uintNow - uintScanStart;
+  uint uintModel = aryuintTiming[TIMING_MODEL];
+  long lngRatio;
+  byte i;
+
+  if ( !blnScanning ) {
+    return;
+  }
+  for( i=0; i<CFG_CHANNELS; i++ ) {
+    if ( ulngScanMask & ((ulong)1 << i) ) {
+      aryuintConversions[i]++;
+    }
+  }
+  uintScanExpected = uintMeasured;
+  setTiming(TIMING_NEXT, 0);
+  setTiming(TIMING_CONVERSION, uintMeasured);
+  setTiming(TIMING_EXPECTED, uintScanExpected);
+
+  if ( uintModel == 0 ) {
+    return;
+  }
+// The new ratio, limited, then an IIR towards it
+  lngRatio = ((ulong)uintMeasured << 8) / uintModel;
+
+  if ( lngRatio < TIMING_RATIO_MIN ) {
+    lngRatio = TIMING_RATIO_MIN;
+  } else if ( lngRatio > TIMING_RATIO_MAX ) {
+    lngRatio = TIMING_RATIO_MAX;
+  }
+  if ( blnRatioSet ) {
+    uintRatio += (int)(lngRatio - uintRatio) >> TIMING_RATIO_SHIFT;
+  } else {
+    uintRatio = lngRatio;
+    blnRatioSet = TRUE;
+  }
+}
+/**
+ * Function:
+ *  timingWindow
+ *
+ * Remarks: call at least every few hundred ms, the window is only as exact
+ *          as the calls
+ */
+void timingWindow(void) {
+  byte i;
+
+  if ( (uint)(schedMillis() - uintWindowStart) < TIMING_WINDOW_MS ) {
+    return;
+  }
+  uintWindowStart += TIMING_WINDOW_MS;
+
+  for( i=0; i<CFG_CHANNELS; i++ ) {
+    GIEL_bit = 0;
+    aryuintThroughput[i] = aryuintConversions[i];
+    GIEL_bit = 1;
+    aryuintConversions[i] = 0;
+  }
+}
@@ -0,0 +1,78 @@
+/**
+ * File:
+ *  ltcTiming.h
+ *
+ * Notes:
+ *  This file contains the prototypes for the LTC2983 scan time model.  The
+ * expected time of a scan is worked out from the channel mask and the node
+ * configuration, corrected by the ratio of measured to modelled scans, and
+ * published so a master can poll right after new results land.
+ *
+ *  aryuintTiming, all in ms:
+ *   [TIMING_NEXT]       until the results of the scan in progress should
+ *                       be published, 0 if they are late, 0xFFFF when no
+ *                       scan is running
+ *   [TIMING_CONVERSION] last scan, start to INT
+ *   [TIMING_CYCLE]      between the last two published scans
+ *   [TIMING_EXPECTED]   scan in progress, start to publication: the model
+ *                       corrected by the measurements, once INT is up the
+ *                       measured time, plus the re-conversions started
+ *   [TIMING_MODEL]      the model alone
+ *
+ *  aryuintThroughput has the conversions of each channel, [0] is channel 1,
+ * counted over a TIMING_WINDOW_MS window and published at its end.
+ *
+ * Usage:
+ *  timingInit();
+ *  timingScanStart(ulngScanMask);  // after convert_channel(0)
+ *  timingUpdate();                 // every tick while the scan runs
+ *  timingScanDone();               // INT has gone high
+ *  timingRetry(5);                 // after convert_channel(5), if any
+ *  timingPublished();              // the results are in the registers
+ *  timingWindow();                 // every 100ms or so
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Conversions per minute per channel
+ *  18/10/2026 timingRetry and timingPublished
+ */
+#ifndef LTCTIMING_H
+  #define LTCTIMING_H
+
+  #include "types.h"
+  #include "nodeConfig.h"
+// aryuintTiming indexes
+  #define TIMING_NEXT         0
+  #define TIMING_CONVERSION   1
+  #define TIMING_CYCLE        2
+  #define TIMING_EXPECTED     3
+  #define TIMING_MODEL        4
+  #define TIMING_REGS         5
+// Conversion cycle in 0.1ms for each rejection mode (global parameters bits
+// 0..1). Nominal, the measured ratio takes care of the part to part spread.
+  #define TIMING_CYCLE_50_60  820
+  #define TIMING_CYCLE_60     680
+  #define TIMING_CYCLE_50     820
+// Cycles per conversion, one more when the excitation is rotated
+  #define TIMING_CYCLES       2
+// Correction, measured / model in Q8, limited to 0.5 to 2
+  #define TIMING_RATIO_ONE    256
+  #define TIMING_RATIO_MIN    128
+  #define TIMING_RATIO_MAX    512
+// The correction follows the measurements over about 2^n scans
+  #define TIMING_RATIO_SHIFT  2
+// Throughput window, conversions per minute
+  #define TIMING_WINDOW_MS    60000
+
+  extern volatile uint aryuintTiming[TIMING_REGS];
+  extern volatile uint aryuintThroughput[CFG_CHANNELS];
+
+  void timingInit(void);
+  uint timingModel(ulong ulngMask);
+  void timingPublished(void);
+  void timingRetry(byte bytChannel);
+  void timingScanDone(void);
+  void timingScanStart(ulong ulngMask);
+  void timingUpdate(void);
+  void timingWindow(void);
+#endif
@@ -8,6 +8,7 @@
  *
  * Functions:
  *  addModbusBlock    Creates an I/O block of a specified type
+ *  calcBufferCRC     Calculates the CRC for any buffer
  *  calcCRC           Calculates the CRC for the message content
  *  modbusSerialInit  Initialise serial port
  *  serviceIOBlocks   Checks I/O blocks, if update flag set, calls callback
@@ -16,9 +17,13 @@
  *
  * History:
  *  09/07/2012 Written by Simon Platten
+ *  18/10/2026 Hardware access through modbusHal.h, C version of calcCRC for
+ *             the host build, modbusSerialInit returns 0 when successful
+ *  18/10/2026 addModbusBlock clears blnBusy, modbusSerialInit no longer
+ *             waits 100ms for the UART
+ *  18/10/2026 addModbusBlock clears bytGeneration
  */
 #include <stdarg.h>
-#include <built_in.h>
 
 #include "modbus.h"
 // Pointer to the I/O linked lists
@@ -37,6 +42,8 @@ uint uintMbRxGapSetPt1;
 uint uintMbRxGapSetPt2;
 uint uintMbRxGapSetPt3;
 uint uintMbRxGapSetPt;
+// Timer0 prescaler as a shift
+byte bytMbTimerShift = 0;
 // Packet timeout in milliseconds
 uint uintPacketTimeout;
 // Calculated CRC
@@ -128,7 +135,40 @@ boolean addModbusBlock(byte bytSlaveAddress,
   pBlock->uintTotal       = uintTotal;
   pBlock->paryData        = paryData;
   pBlock->pCallback       = pCallback;
+  pBlock->blnBusy         = FALSE;
+  pBlock->bytGeneration   = 0;
   pBlock->pNext           = NULL;
+  return TRUE;
+}
+/**
+ * Function:
+ *  calcBufferCRC
+ *
+ * Parameters:
+ *  pBuffer, the message
+ *  bytLength, the number of bytes in the message
+ *
+ * Returns:
+ *  A 16bit CRC for the passed message, low byte is sent first
+ *
+ * Remarks: portable version of calcCRC for buffers other than arybytMbBuffer
+ */
+uint calcBufferCRC(byte* pBuffer, byte bytLength) {
+  uint uintValue = 0xffff;
+  byte bytBit;
+
+  while( bytLength > 0 ) {
+    uintValue ^= *pBuffer++;
+    for( bytBit=0; bytBit<8; bytBit++ ) {
+      if ( uintValue & 1 ) {
+        uintValue = (uintValue >> 1) ^ 0xA001;
+      } else {
+        uintValue >>= 1;
+      }
+    }
+    bytLength--;
+  }
+  return uintValue;
 }
 /**
  * Function:
@@ -146,6 +186,9 @@ boolean addModbusBlock(byte bytSlaveAddress,
 #pragma funcall calcCRC dummy
 
 uint calcCRC(void) {
+#ifdef MODBUS_HOST
+  return calcBufferCRC(arybytMbBuffer, bytMbIndex);
+#else
   asm {
    MBgetCRC:
          movff    _bytMbIndex, R2     // byte count in R2
@@ -173,6 +216,7 @@ uint calcCRC(void) {
          return
   }
   return 0;
+#endif
 }
 /**
  * Function:
@@ -195,7 +239,7 @@ int modbusSerialInit(baudRate eBaud, const byte bytStopBits, ...) {
 // Initialise variable argument list
   va_start(ap, bytStopBits);
 // Assign the slave address
-  bytMbSlaveAddress = va_arg(ap, byte);
+  bytMbSlaveAddress = va_arg(ap, MB_VA_BYTE);
 // Make sure the received array is cleared
   memset(arybytMbBuffer, 0, sizeof(arybytMbBuffer));
 // Initialise the Rx Gap counter
@@ -205,70 +249,63 @@ int modbusSerialInit(baudRate eBaud, const byte bytStopBits, ...) {
 // Initialize UART module for the specified bps
   switch( eBaud ) {
   case BAUD_1200:
-    UART1_Init(BAUD_1200 * 100);
+    MB_UART_INIT(BAUD_1200 * 100);
     lngTimeoutPreset  = GAP_SETPT_1200;
     uintPacketTimeout = PACKET_TIMEOUT_1200;
     break;
   case BAUD_2400:
-    UART1_Init(BAUD_2400 * 100);
+    MB_UART_INIT(BAUD_2400 * 100);
     lngTimeoutPreset  = GAP_SETPT_2400;
     uintPacketTimeout = PACKET_TIMEOUT_2400;
     break;
   case BAUD_4800:
-    UART1_Init(BAUD_4800 * 100);
+    MB_UART_INIT(BAUD_4800 * 100);
     lngTimeoutPreset  = GAP_SETPT_4800;
     uintPacketTimeout = PACKET_TIMEOUT_4800;
     break;
   case BAUD_9600:
-    UART1_Init(BAUD_9600 * 100);
+    MB_UART_INIT(BAUD_9600 * 100);
     lngTimeoutPreset  = GAP_SETPT_9600;
     uintPacketTimeout = PACKET_TIMEOUT_9600;
     break;
   case BAUD_19200:
-    UART1_Init(BAUD_19200 * 100);
+    MB_UART_INIT(BAUD_19200 * 100);
     lngTimeoutPreset  = GAP_SETPT_19200;
     uintPacketTimeout = PACKET_TIMEOUT_19200;
     break;
  case BAUD_38400:
-    UART1_Init(BAUD_38400 * 100);
+    MB_UART_INIT(BAUD_38400 * 100);
     lngTimeoutPreset  = GAP_SETPT_38400;
     uintPacketTimeout = PACKET_TIMEOUT_38400;
     break;
   case BAUD_57600:
-    UART1_Init(BAUD_57600 * 100);
+    MB_UART_INIT(BAUD_57600 * 100);
     lngTimeoutPreset  = GAP_SETPT_57600;
     uintPacketTimeout = PACKET_TIMEOUT_57600;
     break;
   case BAUD_115200:
-    UART1_Init(BAUD_115200 * 100);
+    MB_UART_INIT(BAUD_115200 * 100);
     lngTimeoutPreset  = GAP_SETPT_115200;
     uintPacketTimeout = PACKET_TIMEOUT_115200;
     break;
   default:
     return -1;
   }
-// Wait for UART module to stabilize
-  Delay_ms(100);
 // Timer0 Registers:
 // 16-Bit Mode
 // Prescaler=1:1
-  T0CON.TMR0ON = 0;// Timer0 On/Off Control bit 1=Enables / 0=Stops
-  T0CON.T08BIT = 0;// Timer0 8-bit/16-bit Control bit: 1=8-bit/ 0=16-bit
-  T0CON.T0CS   = 0;// TMR0 Clock Source Select bit: 0=Internal
-  T0CON.T0SE   = 0;// TMR0 Source Edge Select bit: 0=low/high
-  T0CON.PSA    = 1;// Prescaler Assignment bit: 1=NOT assigned/bypassed
-  T0CON.T0PS2  = 0;// bits 2-0  PS2:PS0: Prescaler Select bits
-  T0CON.T0PS1  = 0;
-  T0CON.T0PS0  = 0;
+  MB_TIMER_INIT();
 // Set prescaler if needed
   bytTemp = 0;
   while( lngTimeoutPreset > 29126 ) {
     lngTimeoutPreset >>= 1;
     bytTemp++;
   }
+  bytMbTimerShift = 0;
   if ( bytTemp > 0 && bytTemp <= 8 ) {
-    T0CON.PSA = 0;   // Prescaler assigned
-    T0CON = T0CON | (--bytTemp & 0x07);
+    bytMbTimerShift = bytTemp;
+    bytTemp--;
+    MB_TIMER_PRESCALE(bytTemp);
   }
   uintMbRxGapSetPt1 = (uint)-(lngTimeoutPreset >> 1);   // 1 char
   uintMbRxGapSetPt2 = (uint)-lngTimeoutPreset;          // 2 chars
@@ -276,17 +313,15 @@ int modbusSerialInit(baudRate eBaud, const byte bytStopBits, ...) {
   uintMbRxGapSetPt  = (uint)-(lngTimeoutPreset*9 >> 2); // 4.5 chars
 // Double STOP bit while transmitting?
   if ( bytStopBits != 1 ) {
-    TX9_bit  = 1;
-    TX9D_bit = 1;
+    MB_TX_TWO_STOP_BITS();
   }
 // Clear errors, Rx buffer & Rx phase indicator
 // and start silent interval in case bus is active
   restartRx();
-  TMR0IE_bit = 1;
-// Enable peripheral interrupts
-  PEIE_bit   = 1;
-// Enable GLOBAL interrupts
-  GIE_bit    = 1;
+  MB_TIMER_INT_ENABLE();
+// Enable peripheral and GLOBAL interrupts
+  MB_INTERRUPTS_INIT();
+  return 0;
 }
 /**
  * Function:
@@ -300,11 +335,11 @@ int modbusSerialInit(baudRate eBaud, const byte bytStopBits, ...) {
  */
 void restartRx(void) {
 // Clear FIFO
-  bytMbRxphase = RCREG;
-  bytMbRxphase = RCREG;
+  bytMbRxphase = MB_RX_READ();
+  bytMbRxphase = MB_RX_READ();
 // Clear errors and enable Rx
-  CREN_bit = 0;
-  CREN_bit = 1;
+  MB_RX_ENABLE(0);
+  MB_RX_ENABLE(1);
 // Set RS-485 direction
   //Tx_dir = 0;
 // Set parity check
@@ -315,10 +350,10 @@ void restartRx(void) {
   bytMbRxphase = 0;
   bytMbIndex = 0;
 // Disable Tx
-  TXEN_bit = 0;
-  TXIE_bit = 0;
+  MB_TX_ENABLE(0);
+  MB_TX_INT_ENABLE(0);
 // Enable Rx interrupts
-  RCIE_bit = 1;
+  MB_RX_INT_ENABLE(1);
   startTimeout();
 }
 /**
@@ -378,23 +413,19 @@ void serviceIOBlocks(void) {
  */
 void startTimeout(void) {
 // Disable interrupt
-  TMR0ON_bit = 0;
+  MB_TIMER_RUN(0);
 // Set timer presets
-  if ( bytMbRxphase.B1 ) {
-    TMR0H = Hi(uintMbRxGapSetPt3);
-    TMR0L = Lo(uintMbRxGapSetPt3);
-  } else if ( bytMbRxphase.B2 ) {
-    TMR0H = Hi(uintMbRxGapSetPt2);
-    TMR0L = Lo(uintMbRxGapSetPt2);
-  } else if ( bytMbRxphase.B7 ) {
-    TMR0H = Hi(uintMbRxGapSetPt1);
-    TMR0L = Lo(uintMbRxGapSetPt1);
+  if ( bytMbRxphase & RXPHASE_CHAR ) {
+    MB_TIMER_LOAD(uintMbRxGapSetPt3);
+  } else if ( bytMbRxphase & RXPHASE_FRAME ) {
+    MB_TIMER_LOAD(uintMbRxGapSetPt2);
+  } else if ( bytMbRxphase & RXPHASE_TX ) {
+    MB_TIMER_LOAD(uintMbRxGapSetPt1);
   } else {
-    TMR0H = Hi(uintMbRxGapSetPt);
-    TMR0L = Lo(uintMbRxGapSetPt);
+    MB_TIMER_LOAD(uintMbRxGapSetPt);
   }
 // Clear the interrupt mask
-  TMR0IF_bit = 0;
+  MB_TIMER_CLEAR();
 // Enable interrupt
-  TMR0ON_bit = 1;
+  MB_TIMER_RUN(1);
 }
\ No newline at end of file
@@ -24,16 +24,42 @@
  *  15/02/2013 Added MODBUS_MASTER and MODBUS_SLAVE definitions
  *             Modified modbusBlockDef adding blnUpdate flag
  *             Added routine serviceIOBlocks
+ *  18/10/2026 Added MODBUS_BROADCAST, write functions sent to address 0 are
+ *             now executed without a response
+ *  18/10/2026 Added MODBUS_GATEWAY, a slave that also polls downstream slaves
+ *             through the master engine in ModbusMaster.c:
+ *               addModbusPoll
+ *               modbusMasterInit
+ *               modbusMasterTick
+ *               serviceModbusMaster
+ *             Added calcBufferCRC
+ *  18/10/2026 Hardware access moved behind modbusHal.h so the stack also
+ *             builds natively, added the RXPHASE_ bit definitions
+ *  18/10/2026 Added DIAGNOSTICS (FC08), the diagnostic counters and the
+ *             turnaround histogram
+ *  18/10/2026 Modified modbusBlockDef adding blnBusy flag
+ *  18/10/2026 Modified modbusBlockDef adding bytGeneration, added the read
+ *             response cache and modbusBlockChanged
+ *  18/10/2026 Added modbusRxIsr and modbusFrameIsr, the two halves of
+ *             decodePacket for the high and low priority vectors
+ *  18/10/2026 The downstream port transfers in the background, added
+ *             mbMasterPortStatus, mbMasterPortStop and the PORT_ values
+ *  18/10/2026 Two response cache entries, long enough for 31 registers
  */
 #ifndef MODBUS_H
   #define MODBUS_H
 
+  #include "modbusHal.h"
   #include "types.h"
 // Implementation, comment out the one you don't need
 //  #define MODBUS_MASTER               1
   #define MODBUS_SLAVE                1
+// Gateway, a slave that also polls downstream slaves on a second port and
+// serves their registers from local blocks, requires MODBUS_SLAVE
+//  #define MODBUS_GATEWAY              1
 // Constants
   #define EXCEPTION_FLAG              0x80
+  #define MODBUS_BROADCAST            0
   #define MAX_PACKET_LENGTH           256
   #define MAX_DISCRETES_IN_FC15       1968
   #define MAX_REGISTERS_IN_FC16       123
@@ -41,6 +67,41 @@
   #define MAX_REGISTERS_IN_3_AND_4    125
   #define MODBUS_2CHAR                2   // in chars
   #define MAX_RETRIES                 3
+// bytMbRxphase bits
+  #define RXPHASE_TIMEOUT             0x01 // timer expired
+  #define RXPHASE_CHAR                0x02 // inter-char interval running
+  #define RXPHASE_FRAME               0x04 // inter-frame remainder running
+  #define RXPHASE_DECODE              0x40 // frame waiting for modbusFrameIsr
+  #define RXPHASE_TX                  0x80 // transmitting
+// FC08 sub-functions
+  #define DIAG_RETURN_QUERY_DATA      0x00
+  #define DIAG_CLEAR_COUNTERS         0x0A
+  #define DIAG_BUS_MESSAGE_COUNT      0x0B
+  #define DIAG_BUS_ERROR_COUNT        0x0C
+  #define DIAG_EXCEPTION_COUNT        0x0D
+  #define DIAG_SLAVE_MESSAGE_COUNT    0x0E
+  #define DIAG_NO_RESPONSE_COUNT      0x0F
+  #define DIAG_OVERRUN_COUNT          0x12
+// Turnaround histogram, bin 0 is below 64 instruction cycles, then doubling
+  #define MB_LATENCY_BINS             8
+// Response cache, repeated reads of unchanged blocks are answered with the
+// frame and CRC sent last time.  A frame of MB_CACHE_LENGTH holds an FC03/04
+// of 31 registers, the whole of input registers 1..31.  Two entries keep
+// the FC04 poll and the FC02 status poll cached side by side, 79 bytes of
+// RAM each.
+  #define MB_CACHE_ENTRIES            2
+  #define MB_CACHE_LENGTH             (5 + 2 * 31)
+  #define MB_CACHE_BLOCKS             2
+// Master engine
+  #define MASTER_TICK_MS              100 // modbusMasterTick() period
+  #define MAX_REGISTERS_IN_POLL       32
+  #define MAX_MASTER_PACKET_LENGTH    (5 + 2 * MAX_REGISTERS_IN_POLL)
+  #define POLL_BAD_RESPONSE           0xFE
+  #define POLL_TIMEOUT                0xFF
+// mbMasterPortStatus
+  #define PORT_BUSY                   0
+  #define PORT_DONE                   1
+  #define PORT_ERROR                  2
 // Interpacket delays
   #define GAP_SETPT_1200    (long)(MODBUS_2CHAR*110*Clock_kHz()/(4*BAUD_1200))
   #define GAP_SETPT_2400    (long)(MODBUS_2CHAR*110*Clock_kHz()/(4*BAUD_2400))
@@ -86,6 +147,7 @@
     READ_INPUT_REGISTERS      = 4,
     FORCE_SINGLE_COIL         = 5,
     PRESET_SINGLE_REGISTER    = 6,
+    DIAGNOSTICS               = 8,
     FORCE_MULTIPLE_COILS      = 15,
     PRESET_MULTIPLE_REGISTERS = 16
   } mbFunction;
@@ -115,6 +177,11 @@
     void*  paryData;
 // Flag to indicate update of block, used to flag call-back
     boolean blnUpdate;
+// Flag to indicate the data is not ready, requests answer SLAVE_DEVICE_BUSY
+    boolean blnBusy;
+// Bumped by modbusBlockChanged, 0 until the first call, reads of a block
+// whose changes are not announced are never cached
+    byte   bytGeneration;
 // Pointer to funciton to call when block updated
 #ifdef MODBUS_MASTER
     void (*pCallback)();
@@ -124,6 +191,60 @@
 // Link to next block
     struct _modbusBlock* pNext;
   } modbusBlockDef;
+// Diagnostic counters, FC08, all wrap at 0xffff
+  typedef struct _modbusDiag {
+// Frames seen on the bus, any address
+    uint   uintBusMessages;
+// CRC failures on frames for this slave and framing errors
+    uint   uintCommErrors;
+// Exception responses sent
+    uint   uintExceptions;
+// Frames for this slave or broadcast that passed the CRC check
+    uint   uintSlaveMessages;
+// Requests that were not answered, broadcasts
+    uint   uintNoResponses;
+// Receiver overruns
+    uint   uintOverruns;
+  } modbusDiagDef;
+// Cached read response
+  typedef struct _modbusCache {
+// Start address and item count of the request, as received
+    byte   arybytRequest[4];
+// The blocks read and their generations at the time
+    modbusBlockDef* aryBlocks[MB_CACHE_BLOCKS];
+    byte   arybytGeneration[MB_CACHE_BLOCKS];
+    byte   bytBlocks;
+// Length of the response including the CRC, 0 when the entry is unused
+    byte   bytLength;
+// The response, address and function code first
+    byte   arybytFrame[MB_CACHE_LENGTH];
+  } modbusCacheDef;
+#if defined MODBUS_MASTER || defined MODBUS_GATEWAY
+// Downstream poll definition
+  typedef struct _modbusPoll {
+// The downstream slave address 1 to 247
+    byte   bytSlaveAddress;
+// The read function used, READ_COILS to READ_INPUT_REGISTERS
+    mbFunction eFunction;
+// The first address to read, base 1
+    uint   uintAddress;
+// The total number of items to read
+    uint   uintTotal;
+// Where the data is cached, for discretes an array of bytes, packed as in the
+// response, for registers an array of uints
+    void*  paryData;
+// Poll period and time left to the next poll, in master ticks
+    uint   uintPeriod;
+    uint   uintCountdown;
+// Master ticks since the cache was last refreshed, saturates at 0xffff
+    uint   uintAge;
+// Result of the last poll, NO_EXCEPTION, the slave's exception code,
+// POLL_BAD_RESPONSE or POLL_TIMEOUT
+    byte   bytStatus;
+// Link to next poll
+    struct _modbusPoll* pNext;
+  } modbusPollDef;
+#endif
 // Prototypes
   boolean addModbusBlock(byte bytSlaveAddress,
                          mbType eType,
@@ -137,17 +258,46 @@
                          void (*pCallback)(struct _modbusBlock* pBlock)
 #endif
                          );
+  uint    calcBufferCRC(byte* pBuffer, byte bytLength);
   uint    calcCRC(void);
   void    decodePacket(void);
+  void    modbusBlockChanged(modbusBlockDef* pBlock);
+  void    modbusFrameIsr(void);
+  void    modbusRxIsr(void);
   int     modbusSerialInit(baudRate eBaud, const byte bytStopBits, ...);
   void    restartRx(void);
   void    serviceIOBlocks(void);
   void    startTimeout(void);
+#if defined MODBUS_MASTER || defined MODBUS_GATEWAY
+  boolean addModbusPoll(modbusPollDef* pPoll,
+                        byte bytSlaveAddress,
+                        mbFunction eFunction,
+                        uint uintAddress,
+                        uint uintTotal,
+                        void* paryData,
+                        uint uintPeriod);
+  int     modbusMasterInit(baudRate eBaud);
+  void    modbusMasterTick(void);
+  void    serviceModbusMaster(void);
+// Downstream port, implemented by the application, transfers run in the
+// background
+  void    mbMasterPortInit(ulong ulngBaud);
+  void    mbMasterPortRead(byte* pBuffer, byte bytLength);
+  byte    mbMasterPortStatus(void);
+  void    mbMasterPortStop(void);
+  void    mbMasterPortWrite(byte* pBuffer, byte bytLength);
+#endif
 // Globals
 #ifdef MODBUS_MASTER
 // Pointer to the last block that was addressed
   extern modbusBlockDef* pCurrBlock;
 #endif
+#if defined MODBUS_MASTER || defined MODBUS_GATEWAY
+// The downstream poll list
+  extern modbusPollDef* pPolls;
+// Downstream response timeout in milliseconds
+  extern uint uintMbMasterTimeout;
+#endif
 // Pointer to the I/O linked lists
   extern modbusBlockDef* pHoldingRegs;
   extern modbusBlockDef* pStatusBits;
@@ -155,6 +305,13 @@
   extern modbusBlockDef* pCoils;
 // Exception code
   extern mbException eMbExceptionCode;
+// Diagnostic counters and turnaround histogram, see ModbusSlave.c
+  extern modbusDiagDef mbDiag;
+  extern uint aryuintMbLatency[MB_LATENCY_BINS];
+// Requests answered from the response cache, wraps at 0xffff
+  extern uint uintMbCacheHits;
+// Timer0 prescaler as a shift, a tick is 1 << bytMbTimerShift cycles
+  extern byte bytMbTimerShift;
 // Receiver & transmitter GAP set-points
   extern uint uintMbRxGapSetPt1;
   extern uint uintMbRxGapSetPt2;
@@ -0,0 +1,72 @@
+/**
+ * File:
+ *  modbusHal.h
+ *
+ * Notes:
+ *  This file contains the hardware abstraction used by the modbus RTU stack.
+ * By default the macros map straight onto the PIC18 EUSART, Timer0 and
+ * interrupt control bits so the firmware compiles to the same code as before.
+ * Defining MODBUS_HOST selects the simulated UART and timer in host/halHost.h,
+ * used to run the stack natively, see host/Makefile.
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Added MB_RX_OVERRUN, MB_TIMER_ZERO and MB_TIMER_READ
+ *  18/10/2026 Two interrupt priorities, added MB_FRAME_REQUEST and
+ *             MB_FRAME_CLEAR
+ */
+#ifndef MODBUS_HAL_H
+  #define MODBUS_HAL_H
+
+#ifdef MODBUS_HOST
+  #include "halHost.h"
+#else
+  #include <built_in.h>
+// Receiver
+  #define MB_RX_READY                 RCIF_bit
+  #define MB_RX_ERROR                 (OERR_bit || FERR_bit)
+  #define MB_RX_OVERRUN               OERR_bit
+  #define MB_RX_READ()                RCREG
+  #define MB_RX_ENABLE(x)             CREN_bit = (x)
+  #define MB_RX_INT_ENABLE(x)         RCIE_bit = (x)
+// Transmitter
+  #define MB_TX_READY                 TXIF_bit
+  #define MB_TX_WRITE(x)              TXREG = (x)
+  #define MB_TX_ENABLE(x)             TXEN_bit = (x)
+  #define MB_TX_INT_ENABLE(x)         TXIE_bit = (x)
+  #define MB_TX_TWO_STOP_BITS()       { TX9_bit = 1; TX9D_bit = 1; }
+  #define MB_UART_INIT(x)             UART1_Init(x)
+// Timer0, 16 bit, internal clock, no prescaler and stopped
+  #define MB_TIMER_INIT()             T0CON = 0x08
+// Assign the prescaler, x is the T0PS2:T0PS0 value
+  #define MB_TIMER_PRESCALE(x)        T0CON = (T0CON & 0xF0) | ((x) & 0x07)
+  #define MB_TIMER_LOAD(x)            { TMR0H = Hi(x); TMR0L = Lo(x); }
+  #define MB_TIMER_ZERO()             { TMR0H = 0; TMR0L = 0; }
+// Reading TMR0L latches TMR0H
+  #define MB_TIMER_READ(x)            { Lo(x) = TMR0L; Hi(x) = TMR0H; }
+  #define MB_TIMER_RUN(x)             TMR0ON_bit = (x)
+  #define MB_TIMER_EXPIRED            TMR0IF_bit
+  #define MB_TIMER_CLEAR()            TMR0IF_bit = 0
+  #define MB_TIMER_INT_ENABLE()       TMR0IE_bit = 1
+// Interrupts, the EUSART and Timer0 on the high priority vector.  Anything
+// else the application enables must be set to low priority before this.
+  #define MB_INTERRUPTS_INIT()        { IPEN_bit = 1; RCIP_bit = 1; \
+                                        TXIP_bit = 1; TMR0IP_bit = 1; \
+                                        TMR3IF_bit = 0; TMR3IP_bit = 0; \
+                                        TMR3IE_bit = 1; \
+                                        GIEL_bit = 1; GIEH_bit = 1; }
+// Only the low priority vector shares data with the main line, reception
+// carries on while it is masked
+  #define MB_DISABLE_INTERRUPTS()     GIEL_bit = 0
+  #define MB_ENABLE_INTERRUPTS()      GIEL_bit = 1
+// A frame for modbusFrameIsr, requested through the Timer3 flag, a low
+// priority interrupt.  Timer3 itself is never started.
+  #define MB_FRAME_REQUEST()          TMR3IF_bit = 1
+  #define MB_FRAME_CLEAR()            TMR3IF_bit = 0
+// Misc
+  #define MB_DELAY_MS(x)              Delay_ms(x)
+// The type a byte argument is read back as from a variable argument list
+  #define MB_VA_BYTE                  byte
+#endif
+
+#endif
@@ -0,0 +1,368 @@
+/**
+ * File:
+ *  nodeConfig.c
+ *
+ * Notes:
+ *  This file contains the load and save of the node configuration image,
+ * see nodeConfig.h.  The defaults are the configuration DAQ12 was built
+ * with: a 1k sense resistor on channel 2 and 2 wire PT-100s on channels 3
+ * to 14.
+ *
+ *  cfgChannelValid checks a channel assignment word against the encoding in
+ * LTC2983_configuration_constants.h and against the channels it refers to,
+ * so a word written over modbus can be sent to the LTC2983 as it is.  A
+ * sense resistor, and a differential thermocouple, thermistor, diode or ADC
+ * input, also takes channel N-1, which must then be unassigned.
+ * Custom tables and Steinhart-Hart coefficients are never written by this
+ * firmware, so the sensor types that need them are refused.
+ *
+ * Functions:
+ *  cfgChannelPair  Checks if a sensor also takes the channel below
+ *  cfgChannelRef   Returns the sense resistor or cold junction channel
+ *  cfgChannelValid Checks a channel assignment word
+ *  cfgDefaults     Sets the compiled in configuration
+ *  cfgLoad         Reads the image from EEPROM, or sets the defaults
+ *  cfgProfile      Returns the profile the image matches
+ *  cfgRead         Reads one image slot and checks it
+ *  cfgSave         Writes the image to the EEPROM slot not in use
+ *  cfgScanMask     Returns the channels with a sensor to convert
+ *  cfgSetProfile   Sets the rejection and multiplexer delay of a profile
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Channel assignment word validation
+ *  18/10/2026 Speed and noise profiles
+ *  18/10/2026 Two image slots, cfgLoad takes the newest that passes the CRC
+ *  18/10/2026 Two channel sensors, cfgScanMask
+ *  18/10/2026 cfgSave writes a bounded number of bytes per call
+ */
+#include <stdint.h>
+
+#include "modbus.h"
+#include "nodeConfig.h"
+#include "LTC2983_configuration_constants.h"
+// The configuration in use
+configDef nodeCfg;
+// The slot nodeCfg was loaded from or last saved to, and its sequence
+static byte bytCfgSlot = 0;
+static byte bytCfgSequence = 0;
+// Next byte of the image to save to the slot not in use
+static byte bytCfgSaveAt = 0;
+// EEPROM address of each image slot
+static const byte arybytCfgSlots[2] = { CFG_EE_IMAGE, CFG_EE_IMAGE2 };
+// Rejection and multiplexer delay of each CFG_PROFILE_
+static const byte arybytProfiles[CFG_PROFILES][2] = {
+  { REJECTION__50_60_HZ, CFG_MUX_DELAY },
+  { REJECTION__50_HZ,    CFG_MUX_DELAY },
+  { REJECTION__60_HZ,    CFG_MUX_DELAY },
+  { REJECTION__60_HZ,    0 }
+};
+/**
+ * Function:
+ *  cfgChannelPair
+ *
+ * Parameters:
+ *  ulngWord, a channel assignment word
+ *
+ * Returns:
+ *  TRUE if the sensor is connected between its channel and the one below
+ */
+static boolean cfgChannelPair(ulong ulngWord) {
+  byte bytType = CFG_SENSOR_TYPE(ulngWord);
+
+  if ( bytType == CFG_TYPE_RSENSE ) {
+    return TRUE;
+  }
+  if ( bytType >= CFG_TYPE_TC_FIRST && bytType <= CFG_TYPE_TC_LAST ) {
+    return (ulngWord & (TC_SINGLE_ENDED)) == 0;
+  }
+  if ( bytType >= CFG_TYPE_THERM_FIRST && bytType <= CFG_TYPE_THERM_LAST ) {
+    return (ulngWord & (THERMISTOR_SINGLE_ENDED)) == 0;
+  }
+  if ( bytType == CFG_TYPE_DIODE ) {
+    return (ulngWord & (DIODE_SINGLE_ENDED)) == 0;
+  }
+  if ( bytType == CFG_TYPE_ADC ) {
+    return (ulngWord & (DIRECT_ADC_SINGLE_ENDED)) == 0;
+  }
+  return FALSE;
+}
+/**
+ * Function:
+ *  cfgChannelRef
+ *
+ * Parameters:
+ *  ulngWord, a channel assignment word
+ *
+ * Returns:
+ *  The sense resistor channel of an RTD or thermistor, the cold junction
+ *  channel of a thermocouple, otherwise 0
+ */
+byte cfgChannelRef(ulong ulngWord) {
+  byte bytType = CFG_SENSOR_TYPE(ulngWord);
+
+  if ( (bytType >= CFG_TYPE_TC_FIRST && bytType <= CFG_TYPE_TC_LAST)
+    || (bytType >= CFG_TYPE_RTD_FIRST && bytType <= CFG_TYPE_RTD_LAST)
+    || (bytType >= CFG_TYPE_THERM_FIRST && bytType <= CFG_TYPE_THERM_LAST) ) {
+    return CFG_REF_CHANNEL(ulngWord);
+  }
+  return 0;
+}
+/**
+ * Function:
+ *  cfgChannelValid
+ *
+ * Parameters:
+ *  bytChannel, the LTC2983 channel, 1 to CFG_CHANNELS
+ *  plngWords, the words of every channel, [0] is channel 1, so references
+ *             are checked against what the other channels will be
+ *
+ * Returns:
+ *  TRUE if the word of bytChannel can be written to the LTC2983
+ */
+boolean cfgChannelValid(byte bytChannel, ulong* plngWords) {
+  ulong ulngWord = plngWords[bytChannel - 1];
+  byte bytType = CFG_SENSOR_TYPE(ulngWord);
+  byte bytRef = cfgChannelRef(ulngWord);
+  byte bytRefType = 0, bytField;
+
+  if ( bytType == 0 ) {
+// Unassigned, the rest of the word is ignored
+    return TRUE;
+  }
+// Channel N-1 must be free for a two channel sensor, and this channel must
+// not be the lower half of one on N+1
+  if ( cfgChannelPair(ulngWord)
+    && (bytChannel < 2 || CFG_SENSOR_TYPE(plngWords[bytChannel - 2]) != 0) ) {
+    return FALSE;
+  }
+  if ( bytChannel < CFG_CHANNELS && cfgChannelPair(plngWords[bytChannel]) ) {
+    return FALSE;
+  }
+  if ( bytRef != 0 ) {
+    if ( bytRef == bytChannel || bytRef > CFG_CHANNELS ) {
+      return FALSE;
+    }
+    bytRefType = CFG_SENSOR_TYPE(plngWords[bytRef - 1]);
+  }
+  if ( bytType >= CFG_TYPE_TC_FIRST && bytType <= CFG_TYPE_TC_LAST ) {
+// The cold junction is optional, it must be a temperature sensor
+    return bytRef == 0
+        || bytRefType == CFG_TYPE_DIODE
+        || (bytRefType >= CFG_TYPE_RTD_FIRST && bytRefType <= CFG_TYPE_RTD_LAST)
+        || (bytRefType >= CFG_TYPE_THERM_FIRST
+         && bytRefType <= CFG_TYPE_THERM_LAST);
+  }
+  if ( bytType >= CFG_TYPE_RTD_FIRST && bytType <= CFG_TYPE_RTD_LAST ) {
+    bytField = CFG_FIELD(ulngWord, RTD_EXCITATION_CURRENT_LSB, 0x0F);
+
+    if ( bytField == 0 || bytField > 0x08
+      || CFG_FIELD(ulngWord, RTD_EXCITATION_MODE_LSB, 0x03) > 0x02 ) {
+      return FALSE;
+    }
+    return bytRef >= 2 && bytRefType == CFG_TYPE_RSENSE;
+  }
+  if ( bytType >= CFG_TYPE_THERM_FIRST && bytType <= CFG_TYPE_THERM_LAST ) {
+    bytField = CFG_FIELD(ulngWord, THERMISTOR_EXCITATION_CURRENT_LSB, 0x0F);
+
+    if ( bytField == 0 || bytField > 0x0C
+      || CFG_FIELD(ulngWord, THERMISTOR_EXCITATION_MODE_LSB, 0x03) > 0x02 ) {
+      return FALSE;
+    }
+    return bytRef >= 2 && bytRefType == CFG_TYPE_RSENSE;
+  }
+  if ( bytType == CFG_TYPE_RSENSE ) {
+// Uses channels N-1 and N, the value (ohms, 17.10) must be set
+    return (ulngWord & 0x07FFFFFF) != 0;
+  }
+  return bytType == CFG_TYPE_DIODE || bytType == CFG_TYPE_ADC;
+}
+/**
+ * Function:
+ *  cfgDefaults
+ */
+void cfgDefaults(void) {
+  byte i;
+
+  memset(&nodeCfg, 0, sizeof(nodeCfg));
+  nodeCfg.bytVersion      = CFG_VERSION;
+  nodeCfg.bytSlaveAddress = CFG_SLAVE_ADDRESS;
+  nodeCfg.uintBaud        = CFG_BAUD;
+  nodeCfg.bytGlobal       = TEMP_UNIT__C | REJECTION__50_60_HZ;
+  nodeCfg.bytMuxDelay     = CFG_MUX_DELAY;
+// Channel 2, sense resistor, 1000 ohm
+  nodeCfg.arylngChannel[1] = SENSOR_TYPE__SENSE_RESISTOR
+                           | (uint32_t) 0xFA000 << SENSE_RESISTOR_VALUE_LSB;
+// Channels 3 to 14, PT-100 using the channel 2 sense resistor
+  for( i=2; i<CFG_CHANNELS; i++ ) {
+    nodeCfg.arylngChannel[i] = SENSOR_TYPE__RTD_PT_100
+                             | RTD_RSENSE_CHANNEL__2
+                             | RTD_NUM_WIRES__2_WIRE
+                             | RTD_EXCITATION_MODE__NO_ROTATION_SHARING
+                             | RTD_EXCITATION_CURRENT__100UA
+                             | RTD_STANDARD__AMERICAN;
+  }
+}
+/**
+ * Function:
+ *  cfgRead
+ *
+ * Parameters:
+ *  bytSlot, 0 or 1
+ *
+ * Returns:
+ *  TRUE if the image in the slot has the current version and a good CRC
+ *
+ * Remarks: the image is read into nodeCfg whether it is good or not
+ */
+static boolean cfgRead(byte bytSlot) {
+  byte* pImage = (byte*)&nodeCfg;
+  byte i;
+
+  for( i=0; i<sizeof(nodeCfg); i++ ) {
+    pImage[i] = EEPROM_Read(arybytCfgSlots[bytSlot] + i);
+  }
+  return nodeCfg.bytVersion == CFG_VERSION
+      && nodeCfg.uintCRC == calcBufferCRC(pImage, sizeof(nodeCfg)
+                                                  - sizeof(uint));
+}
+/**
+ * Function:
+ *  cfgLoad
+ *
+ * Returns:
+ *  TRUE if an EEPROM image was used, FALSE if the defaults were set
+ *
+ * Remarks: the newer slot is tried first, the older is used if it fails
+ */
+boolean cfgLoad(void) {
+  byte arybytSequence[2];
+
+  arybytSequence[0] = EEPROM_Read(CFG_EE_SEQUENCE);
+  arybytSequence[1] = EEPROM_Read(CFG_EE_SEQUENCE + 1);
+  bytCfgSlot = 0;
+
+  if ( (signed char)(arybytSequence[1] - arybytSequence[0]) > 0 ) {
+    bytCfgSlot = 1;
+  }
+// The next save is numbered after the newer slot, even if that one failed
+  bytCfgSequence = arybytSequence[bytCfgSlot];
+
+  if ( cfgRead(bytCfgSlot) ) {
+    return TRUE;
+  }
+  bytCfgSlot ^= 1;
+
+  if ( cfgRead(bytCfgSlot) ) {
+    return TRUE;
+  }
+  cfgDefaults();
+  return FALSE;
+}
+/**
+ * Function:
+ *  cfgProfile
+ *
+ * Returns:
+ *  The CFG_PROFILE_ that matches the global parameters and multiplexer
+ *  delay, CFG_PROFILE_CUSTOM if none does
+ */
+byte cfgProfile(void) {
+  byte i;
+
+  for( i=0; i<CFG_PROFILES; i++ ) {
+    if ( (nodeCfg.bytGlobal & 0x03) == arybytProfiles[i][0]
+      && nodeCfg.bytMuxDelay == arybytProfiles[i][1] ) {
+      return i;
+    }
+  }
+  return CFG_PROFILE_CUSTOM;
+}
+/**
+ * Function:
+ *  cfgScanMask
+ *
+ * Returns:
+ *  A bit per channel that has a sensor giving a result, bit 0 is channel 1.
+ *  Unassigned channels and sense resistors are left out.
+ */
+ulong cfgScanMask(void) {
+  ulong ulngMask = 0;
+  byte bytType, i;
+
+  for( i=0; i<CFG_CHANNELS; i++ ) {
+    bytType = CFG_SENSOR_TYPE(nodeCfg.arylngChannel[i]);
+
+    if ( bytType != 0 && bytType != CFG_TYPE_RSENSE ) {
+      ulngMask |= (ulong)1 << i;
+    }
+  }
+  return ulngMask;
+}
+/**
+ * Function:
+ *  cfgSetProfile
+ *
+ * Parameters:
+ *  bytProfile, a CFG_PROFILE_
+ *
+ * Returns:
+ *  FALSE if there is no such profile, nodeCfg is not changed
+ *
+ * Remarks: only nodeCfg is changed, the temperature unit is kept
+ */
+boolean cfgSetProfile(byte bytProfile) {
+  if ( bytProfile >= CFG_PROFILES ) {
+    return FALSE;
+  }
+  nodeCfg.bytGlobal = (nodeCfg.bytGlobal & ~0x03)
+                    | arybytProfiles[bytProfile][0];
+  nodeCfg.bytMuxDelay = arybytProfiles[bytProfile][1];
+  return TRUE;
+}
+/**
+ * Function:
+ *  cfgSave
+ *
+ * Parameters:
+ *  bytWrites, the most bytes to write in this call
+ *
+ * Returns:
+ *  TRUE once the save is complete, call again until it is
+ *
+ * Remarks: the image goes to the other slot, then its sequence byte is set
+ *          one past the slot in use.  Only bytes that differ are written,
+ *          each takes about 4ms, call from the main loop only.  A call after
+ *          nodeCfg changed starts the image over.
+ */
+boolean cfgSave(byte bytWrites) {
+  byte* pImage = (byte*)&nodeCfg;
+  byte bytAddress;
+  uint uintCRC;
+
+  nodeCfg.bytVersion = CFG_VERSION;
+  uintCRC = calcBufferCRC(pImage, sizeof(nodeCfg) - sizeof(uint));
+  if ( uintCRC != nodeCfg.uintCRC ) {
+    nodeCfg.uintCRC = uintCRC;
+    bytCfgSaveAt = 0;
+  }
+  bytAddress = arybytCfgSlots[bytCfgSlot ^ 1];
+
+  for( ; bytCfgSaveAt<sizeof(nodeCfg); bytCfgSaveAt++ ) {
+    if ( EEPROM_Read(bytAddress + bytCfgSaveAt) != pImage[bytCfgSaveAt] ) {
+      if ( bytWrites == 0 ) {
+        return FALSE;
+      }
+      bytWrites--;
+      EEPROM_Write(bytAddress + bytCfgSaveAt, pImage[bytCfgSaveAt]);
+    }
+  }
+  if ( bytWrites == 0 ) {
+    return FALSE;
+  }
+  bytCfgSaveAt = 0;
+  bytCfgSlot ^= 1;
+  bytCfgSequence++;
+  EEPROM_Write(CFG_EE_SEQUENCE + bytCfgSlot, bytCfgSequence);
+  return TRUE;
+}
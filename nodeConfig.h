@@ -0,0 +1,100 @@
+/**
+ * File:
+ *  nodeConfig.h
+ *
+ * Notes:
+ *  This file contains the persisted node configuration: the modbus address
+ * and baud rate, the LTC2983 global parameters and the channel assignment
+ * words.  The image is kept in EEPROM with a CRC, an image that fails the
+ * check is replaced by the compiled in defaults.
+ *
+ *  There are two image slots and each save goes to the one not in use, its
+ * sequence byte is written last.  A save cut short by a reset leaves the
+ * previous image to load.  A save can be spread over several calls, each
+ * writing a bounded number of bytes.
+ *
+ * Usage:
+ *  cfgLoad();
+ *  modbusSerialInit((baudRate)nodeCfg.uintBaud, 1, nodeCfg.bytSlaveAddress);
+ *
+ *  if ( cfgChannelValid(3, arylngWords) ) {
+ *    nodeCfg.arylngChannel[2] = arylngWords[2];
+ *  }
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 Channel assignment word validation
+ *  18/10/2026 Channel word field macros shared with ltcTiming.c
+ *  18/10/2026 Speed and noise profiles
+ *  18/10/2026 Two image slots with a sequence byte each
+ *  18/10/2026 cfgScanMask
+ *  18/10/2026 cfgSave resumes over several calls
+ */
+#ifndef NODECONFIG_H
+  #define NODECONFIG_H
+
+  #include "types.h"
+// Layout version, change when configDef changes
+  #define CFG_VERSION         1
+// EEPROM addresses of the two 64 byte images, after the ADC calibration
+// and after the alarm limits
+  #define CFG_EE_IMAGE        0x20
+  #define CFG_EE_IMAGE2       0xC0
+// Sequence byte of each image, the newer has the higher number, modulo 256
+  #define CFG_EE_SEQUENCE     0x1E
+// Channel assignment words kept, LTC2983 channels 1 to CFG_CHANNELS
+  #define CFG_CHANNELS        14
+// Defaults
+  #define CFG_SLAVE_ADDRESS   1
+  #define CFG_BAUD            96      // BAUD_9600
+  #define CFG_MUX_DELAY       2       // x100us between conversions
+// Speed and noise profiles, the rejection and multiplexer delay together
+  #define CFG_PROFILE_50_60   0       // 50 and 60Hz rejection, the default
+  #define CFG_PROFILE_50      1       // 50Hz only
+  #define CFG_PROFILE_60      2       // 60Hz only
+  #define CFG_PROFILE_FAST    3       // 60Hz only and no multiplexer delay,
+                                      // low impedance sensors only
+  #define CFG_PROFILES        4
+  #define CFG_PROFILE_CUSTOM  0xFF    // the image matches none of them
+// Fields of a channel assignment word, LTC2983_configuration_constants.h
+  #define CFG_SENSOR_TYPE(w)    ((byte)((w) >> SENSOR_TYPE_LSB) & 0x1F)
+  #define CFG_REF_CHANNEL(w)    ((byte)((w) >> RTD_RSENSE_CHANNEL_LSB) & 0x1F)
+  #define CFG_FIELD(w, lsb, m)  ((byte)((w) >> (lsb)) & (m))
+// Sensor type ranges, SENSOR_TYPE__ values >> SENSOR_TYPE_LSB
+  #define CFG_TYPE_TC_FIRST     0x01
+  #define CFG_TYPE_TC_LAST      0x08
+  #define CFG_TYPE_RTD_FIRST    0x0A
+  #define CFG_TYPE_RTD_LAST     0x11
+  #define CFG_TYPE_THERM_FIRST  0x13
+  #define CFG_TYPE_THERM_LAST   0x19
+  #define CFG_TYPE_DIODE        0x1C
+  #define CFG_TYPE_RSENSE       0x1D
+  #define CFG_TYPE_ADC          0x1E
+
+  typedef struct _configImage {
+// CFG_VERSION
+    byte  bytVersion;
+// Modbus slave address 1 to 247
+    byte  bytSlaveAddress;
+// Modbus baud rate, a baudRate value
+    uint  uintBaud;
+// LTC2983 global configuration (0xF0) and multiplexer delay (0xFF)
+    byte  bytGlobal;
+    byte  bytMuxDelay;
+// Channel assignment words, [0] is channel 1, 0 is unassigned
+    ulong arylngChannel[CFG_CHANNELS];
+// calcBufferCRC of everything above
+    uint  uintCRC;
+  } configDef;
+// The configuration in use
+  extern configDef nodeCfg;
+
+  byte    cfgChannelRef(ulong ulngWord);
+  boolean cfgChannelValid(byte bytChannel, ulong* plngWords);
+  void    cfgDefaults(void);
+  boolean cfgLoad(void);
+  byte    cfgProfile(void);
+  boolean cfgSave(byte bytWrites);
+  ulong   cfgScanMask(void);
+  boolean cfgSetProfile(byte bytProfile);
+#endif
@@ -0,0 +1,230 @@
+/**
+ * File:
+ *  scheduler.c
+ *
+ * Notes:
+ *  This file contains a cooperative, deadline checked task scheduler.  Each
+ * task has a period and a deadline, releases are spaced by the period from
+ * the previous release, not from when the task actually ran, so a late task
+ * does not drift.  A task that finishes after its deadline has its overrun
+ * counter incremented.  If it also missed a whole period its releases start
+ * again from now, that is the same overrun and is not counted twice.
+ *
+ *  Timer1 is cleared by the CCP1 special event trigger, so the tick period
+ * is set by the compare register and not by when the interrupt reloads the
+ * timer.  The accuracy is that of the oscillator.
+ *
+ *  The wall clock is kept as the epoch seconds the master wrote and the
+ * uptime when it was written.  Until it is set, timestamps count from power
+ * up.
+ *
+ *  Statistics are kept in a uint array so they can be published directly as
+ * modbus registers:
+ *   [2n]     overruns of task n, saturates at 0xffff
+ *   [2n+1]   worst run time of task n in us, interrupts included,
+ *            saturates at 0xffff
+ *   [2N]     time spent in tasks over the last SCHED_LOAD_WINDOW, 0.1%
+ *
+ * Functions:
+ *  schedInit     Sets up the task table, releases every task now
+ *  schedMicros   Microsecond clock, wraps at 0xffff
+ *  schedMillis   Reads the millisecond tick
+ *  schedRun      Runs every task that is due, call from the main loop
+ *  schedSetEpoch Sets the wall clock
+ *  schedTick     Called from the CCP1 interrupt every ms
+ *  schedTimestamp Reads the wall clock as three registers
+ *  schedUptime   Reads the millisecond uptime
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 CCP1 special event timebase, uptime and wall clock
+ *  18/10/2026 The tick is a low priority interrupt, only that is masked
+ *  18/10/2026 A run that ends on the deadline is not an overrun, a missed
+ *             period is not counted again.  Run times of 65ms or more are
+ *             timed in ms, the statistic saturates.
+ */
+#include "scheduler.h"
+// Milliseconds since schedInit
+volatile uint uintSchedMs = 0;
+volatile ulong ulngSchedUptime = 0;
+// Wall clock, epoch seconds and the uptime when they were set
+static ulong ulngSchedEpoch = 0;
+static ulong ulngSchedEpochAt = 0;
+// The task table and its statistics
+static taskDef* pSchedTasks = NULL;
+static byte bytSchedCount = 0;
+static uint* puintSchedStats = NULL;
+// Load measurement
+static ulong ulngSchedBusyUs = 0;
+static uint uintSchedWindow = 0;
+/**
+ * Function:
+ *  schedInit
+ *
+ * Parameters:
+ *  pTasks, the task table
+ *  bytCount, the number of tasks in the table
+ *  puintStats, 2 * bytCount + 1 uints for the statistics
+ */
+void schedInit(taskDef* pTasks, byte bytCount, uint* puintStats) {
+  byte i;
+
+  pSchedTasks = pTasks;
+  bytSchedCount = bytCount;
+  puintSchedStats = puintStats;
+  memset(puintStats, 0, (2 * bytCount + 1) * sizeof(uint));
+
+  for( i=0; i<bytCount; i++ ) {
+    pTasks[i].uintNext = schedMillis();
+  }
+  ulngSchedBusyUs = 0;
+  uintSchedWindow = schedMillis();
+}
+/**
+ * Function:
+ *  schedTick
+ */
+void schedTick(void) {
+  uintSchedMs++;
+  ulngSchedUptime++;
+}
+/**
+ * Function:
+ *  schedUptime
+ *
+ * Returns:
+ *  Milliseconds since power up, read with low priority interrupts off
+ */
+ulong schedUptime(void) {
+  ulong ulngMs;
+
+  GIEL_bit = 0;
+  ulngMs = ulngSchedUptime;
+  GIEL_bit = 1;
+  return ulngMs;
+}
+/**
+ * Function:
+ *  schedSetEpoch
+ *
+ * Parameters:
+ *  ulngSeconds, the time now in seconds since the epoch
+ */
+void schedSetEpoch(ulong ulngSeconds) {
+  ulngSchedEpochAt = schedUptime();
+  ulngSchedEpoch = ulngSeconds;
+}
+/**
+ * Function:
+ *  schedTimestamp
+ *
+ * Parameters:
+ *  puintOut, three uints for epoch seconds (hi word first) and ms
+ */
+void schedTimestamp(uint* puintOut) {
+  ulong ulngMs = schedUptime() - ulngSchedEpochAt;
+  ulong ulngSeconds = ulngSchedEpoch + ulngMs / 1000;
+
+  puintOut[0] = ulngSeconds >> 16;
+  puintOut[1] = ulngSeconds;
+  puintOut[2] = ulngMs % 1000;
+}
+/**
+ * Function:
+ *  schedMillis
+ *
+ * Returns:
+ *  The millisecond tick, read with low priority interrupts off
+ */
+uint schedMillis(void) {
+  uint uintMs;
+
+  GIEL_bit = 0;
+  uintMs = uintSchedMs;
+  GIEL_bit = 1;
+  return uintMs;
+}
+/**
+ * Function:
+ *  schedMicros
+ *
+ * Returns:
+ *  Microseconds from the tick and the Timer1 count, for measuring intervals
+ *  shorter than 65ms
+ *
+ * Remarks: Timer1 must be in 16 bit read mode (RD16), a tick that is
+ *          pending but not yet counted is allowed for
+ */
+uint schedMicros(void) {
+  uint uintCount, uintMs;
+
+  GIEL_bit = 0;
+  uintMs = uintSchedMs;
+// Reading TMR1L latches TMR1H
+  Lo(uintCount) = TMR1L;
+  Hi(uintCount) = TMR1H;
+
+  if ( CCP1IF_bit ) {
+// The timer has been cleared, read it again after the match
+    uintMs++;
+    Lo(uintCount) = TMR1L;
+    Hi(uintCount) = TMR1H;
+  }
+  GIEL_bit = 1;
+  return uintMs * SCHED_TICK_COUNTS + uintCount;
+}
+/**
+ * Function:
+ *  schedRun
+ *
+ * Remarks: runs every due task once, in table order
+ */
+void schedRun(void) {
+  taskDef* pTask;
+  uint* puintStats;
+  uint uintNow, uintStart, uintStartMs, uintRun;
+  byte i;
+
+  for( i=0; i<bytSchedCount; i++ ) {
+    pTask = &pSchedTasks[i];
+    puintStats = &puintSchedStats[2 * i];
+    uintNow = schedMillis();
+
+    if ( (int)(uintNow - pTask->uintNext) < 0 ) {
+      continue;
+    }
+    uintStartMs = uintNow;
+    uintStart = schedMicros();
+    (*pTask->pTask)();
+    uintRun = schedMicros() - uintStart;
+    uintNow = schedMillis();
+// The microsecond clock wraps at 65.5ms, a longer run is timed in ms
+    if ( uintNow - uintStartMs >= 65 ) {
+      ulngSchedBusyUs += (ulong)(uintNow - uintStartMs) * 1000;
+      uintRun = 0xffff;
+    } else {
+      ulngSchedBusyUs += uintRun;
+    }
+    if ( uintRun > puintStats[1] ) {
+      puintStats[1] = uintRun;
+    }
+// Finished after the deadline
+    if ( uintNow - pTask->uintNext > pTask->uintDeadline
+      && puintStats[0] < 0xffff ) {
+      puintStats[0]++;
+    }
+    pTask->uintNext += pTask->uintPeriod;
+// A whole period was missed, start again from now, the overrun was counted
+    if ( (int)(uintNow - pTask->uintNext) >= 0 ) {
+      pTask->uintNext = uintNow + pTask->uintPeriod;
+    }
+  }
+  uintNow = schedMillis();
+
+  if ( uintNow - uintSchedWindow >= SCHED_LOAD_WINDOW ) {
+    puintSchedStats[2 * bytSchedCount] =
+      ulngSchedBusyUs / SCHED_LOAD_WINDOW;
+    ulngSchedBusyUs = 0;
+    uintSchedWindow = uintNow;
+  }
+}
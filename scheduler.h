@@ -0,0 +1,67 @@
+/**
+ * File:
+ *  scheduler.h
+ *
+ * Notes:
+ *  This file contains the prototypes for a cooperative scheduler driven by
+ * a 1ms Timer1 tick.  Tasks are run to completion from the main loop in
+ * table order, the interrupt only counts milliseconds.
+ *
+ *  The tick comes from the CCP1 special event trigger, which clears Timer1
+ * in hardware on the compare match, so it does not drift with the interrupt
+ * latency.  The tick also keeps a 32 bit uptime and a wall clock that the
+ * master sets as seconds since the epoch.
+ *
+ * Usage:
+ *  taskDef aryTasks[2] = { { taskFast, 1, 5 }, { taskSlow, 100, 20 } };
+ *  schedInit(aryTasks, 2, aryuintStats);
+ *  void interrupt_low() {
+ *    if ( CCP1IF_bit ) {
+ *      CCP1IF_bit = 0;
+ *      schedTick();
+ *    }
+ *  }
+ *  while(1) {
+ *    schedRun();
+ *  }
+ *
+ * History:
+ *  18/10/2026 Written
+ *  18/10/2026 CCP1 special event timebase, uptime and wall clock
+ *  18/10/2026 Runs from the low priority interrupt
+ */
+#ifndef SCHEDULER_H
+  #define SCHEDULER_H
+
+  #include "types.h"
+// Timer1 at Fosc/4 with a 1:1 prescaler, 1000 counts to the tick at 4MHz.
+// Timer1 is cleared on the count after the match, CCPR1 is one less.
+  #define SCHED_TICK_COUNTS   1000
+  #define SCHED_TICK_COMPARE  (SCHED_TICK_COUNTS - 1)
+// Length of the load measurement window in ms
+  #define SCHED_LOAD_WINDOW   1000
+
+  typedef struct _task {
+// Called when the task is due
+    void (*pTask)(void);
+// Interval between releases in ms
+    uint uintPeriod;
+// The task must have finished this many ms after its release
+    uint uintDeadline;
+// Next release, in schedule ms
+    uint uintNext;
+  } taskDef;
+// Milliseconds since schedInit, wraps at 0xffff
+  extern volatile uint uintSchedMs;
+// Milliseconds since power up, wraps after 49 days
+  extern volatile ulong ulngSchedUptime;
+
+  void schedInit(taskDef* pTasks, byte bytCount, uint* puintStats);
+  uint schedMicros(void);
+  uint schedMillis(void);
+  void schedRun(void);
+  void schedSetEpoch(ulong ulngSeconds);
+  void schedTick(void);
+  void schedTimestamp(uint* puintOut);
+  ulong schedUptime(void);
+#endif